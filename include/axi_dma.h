@@ -5,9 +5,13 @@
 #include "sg_descriptor.h"
 #include "udmabuf.h"
 #include "uio.h"
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <sys/poll.h>
+#include <vector>
 
 class axi_dma
 {
@@ -39,19 +43,208 @@ public:
         error = 1u << 14
     };
 
+    /**
+     * @brief Interrupt coalescing settings
+     */
+    struct irq_coalescing
+    {
+        uint32_t threshold; //!< Number of completed descriptors per interrupt (1-255)
+        uint32_t delay;     //!< Delay timer ticks before an interrupt is raised for pending completions (0 disables it, max 255)
+        bool adaptive;      //!< Let the library adjust the threshold at runtime depending on the observed load
+    };
+
+    /**
+     * @brief Snapshot of the runtime counters of a channel
+     */
+    struct channel_stats
+    {
+        uint64_t packets;         //!< Buffers transferred: acquired from the hardware for RX, submitted for TX
+        uint64_t bytes;           //!< Payload bytes transferred
+        uint64_t interrupts;      //!< Interrupts taken
+        uint64_t poll_timeouts;   //!< Waits on the interrupt that timed out
+        uint64_t poll_retries;    //!< Waits on the interrupt interrupted by a signal and retried
+        uint64_t blocked_ns;      //!< Time spent waiting for buffer completion, spinning or sleeping
+        uint64_t ring_high_water; //!< Largest ring occupancy seen on acquisition: buffers received and not
+                                  //!< acquired yet for RX, submitted and not transmitted yet for TX
+        uint64_t desc_errors;     //!< Completed descriptors reporting a DMA error
+        uint64_t recoveries;      //!< Channel restarts after the core halted on a DMA error
+        uint64_t overruns;        //!< Times the hardware lapped the application in cyclic mode
+        uint64_t lost_buffers;    //!< Received buffers overwritten before the application could acquire them
+        uint64_t skipped_buffers; //!< Received buffers passed over to jump to the newest data after an overrun
+        uint64_t sync_errors;     //!< Failed cache maintenance requests, leaving stale data to the device or the CPU
+        uint32_t desc_error_bits; //!< Union of the statusf::dma_errors bits reported by descriptors
+    };
+
+    /**
+     * @brief Runtime counters of a channel
+     * They are only updated by the thread driving the channel, with relaxed loads and stores rather than
+     * read-modify-write instructions, so that they're cheap enough to be always on. Any thread may read them.
+     */
+    struct channel_counters
+    {
+        std::atomic<uint64_t> packets {0};
+        std::atomic<uint64_t> bytes {0};
+        std::atomic<uint64_t> interrupts {0};
+        std::atomic<uint64_t> poll_timeouts {0};
+        std::atomic<uint64_t> poll_retries {0};
+        std::atomic<uint64_t> blocked_ns {0};
+        std::atomic<uint64_t> ring_high_water {0};
+        std::atomic<uint64_t> desc_errors {0};
+        std::atomic<uint64_t> recoveries {0};
+        std::atomic<uint64_t> overruns {0};
+        std::atomic<uint64_t> lost_buffers {0};
+        std::atomic<uint64_t> skipped_buffers {0};
+        std::atomic<uint64_t> sync_errors {0};
+        std::atomic<uint32_t> desc_error_bits {0};
+
+        template <typename T>
+        static void add(std::atomic<T>& counter, T n)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        template <typename T>
+        static void raise(std::atomic<T>& counter, T value)
+        {
+            if (value > counter.load(std::memory_order_relaxed))
+            {
+                counter.store(value, std::memory_order_relaxed);
+            }
+        }
+
+        channel_stats snapshot() const;
+    };
+
+    /**
+     * @brief Error flags of the DMA status register, as named in the AXI DMA product guide
+     * Any of them halts the channel until the core is reset.
+     */
+    enum class dma_error : uint32_t
+    {
+        dma_internal = 1u << 4,  //!< DMAIntErr: e.g. a descriptor with a zero buffer length
+        dma_slave = 1u << 5,     //!< DMASlvErr: error response from the memory slave on a data transfer
+        dma_decode = 1u << 6,    //!< DMADecErr: data buffer address not decoded by the interconnect
+        sg_internal = 1u << 8,   //!< SGIntErr: fetched a descriptor that was already completed
+        sg_slave = 1u << 9,      //!< SGSlvErr: error response from the memory slave on a descriptor access
+        sg_decode = 1u << 10,    //!< SGDecErr: descriptor address not decoded by the interconnect
+        all = 0x770u
+    };
+
+    /**
+     * @brief What went wrong on a channel, and how it was recovered
+     */
+    struct error_report
+    {
+        uint32_t dma_status;   //!< DMA status register when the error was detected, see dma_error
+        uint32_t desc_errors;  //!< statusf::dma_errors bits of the descriptor the channel stopped at
+        size_t desc_index;     //!< Position in the ring of the descriptor the channel was restarted from
+        size_t rebuilt;        //!< Descriptors handed back to the hardware on restart
+        uint64_t downtime_ns;  //!< Time from error detection until the channel was running again
+        bool recovered;        //!< False if the channel couldn't be restarted
+    };
+
+    static constexpr uint32_t max_irq_threshold = 255u;
+    static constexpr uint32_t max_irq_delay = 255u;
+
+    /**
+     * @brief Alignment of the data buffers, in physical memory
+     */
+    enum class buffer_alignment : size_t
+    {
+        bus = 8UL,                //!< AXI-4 bus width: buffers are packed right after each other
+        cache_line = 64UL,        //!< No buffer shares a cache line with a descriptor or another buffer
+        page = 4UL << 10,         //!< Page aligned buffers, e.g. for O_DIRECT I/O
+        huge_page = 2UL << 20     //!< Huge page aligned buffers
+    };
+
+    /**
+     * @brief Placement of descriptors and data buffers in the u-dma-buf region of a channel, and the
+     * space lost to alignment
+     */
+    struct layout_report
+    {
+        size_t buffer_count;       //!< Number of descriptor/buffer pairs
+        size_t buffer_size;        //!< Usable bytes per buffer
+        size_t buffer_stride;      //!< Distance between the start of two consecutive buffers
+        size_t descriptors_size;   //!< Bytes taken by the descriptors
+        size_t descriptor_padding; //!< Bytes between the last descriptor and the first buffer
+        size_t buffer_padding;     //!< Bytes lost by rounding every buffer up to the stride
+        size_t tail_waste;         //!< Unused bytes at the end of the region, and before the first buffer of data-only regions
+        size_t region_size;        //!< Size of the region, or total size of all regions when buffers are spread over several
+        size_t wasted() const { return descriptor_padding + buffer_padding + tail_waste; }
+    };
+
+    /**
+     * @brief Memory area of a u-dma-buf buffer
+     */
+    struct memory_area
+    {
+        uintptr_t phys_addr; //!< Physical address
+        uint8_t *virt_addr;  //!< Virtual address, in the cacheable mapping
+        size_t size;         //!< Size in bytes
+    };
+
+    /**
+     * @brief Computes where descriptors and buffers go in a region, without touching any hardware
+     * Descriptors are placed at the start of the region, and buffers after them, starting at the first
+     * physical address aligned to <em>alignment</em> and with a stride rounded up to <em>alignment</em>.
+     * @return the layout. Its buffer_count is 0 if not even one descriptor/buffer pair fits in the region.
+     */
+    static layout_report plan_layout(uintptr_t region_phys_addr, size_t region_size, size_t buffer_size,
+                                     buffer_alignment alignment);
+
+    /**
+     * @brief Spells out the error flags of the DMA status register and of a descriptor
+     * @return comma-separated flag names, e.g. "DMASlvErr, desc:DMASlvErr", or an empty string
+     */
+    static std::string describe_errors(uint32_t dma_status, uint32_t desc_errors);
+
+    class core;
+
     explicit axi_dma(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& uio_device_name,
-            dma_mode mode, transfer_direction direction, size_t buffer_size);
+            dma_mode mode, transfer_direction direction, size_t buffer_size, const irq_coalescing& coalescing,
+            buffer_alignment alignment);
+    explicit axi_dma(const std::vector<std::string>& udmabuf_names, const std::string& uio_device_name,
+            dma_mode mode, transfer_direction direction, size_t buffer_size, const irq_coalescing& coalescing,
+            buffer_alignment alignment);
+    explicit axi_dma(std::shared_ptr<core> shared_core, size_t region_offset, size_t region_size,
+            dma_mode mode, transfer_direction direction, size_t buffer_size, const irq_coalescing& coalescing,
+            buffer_alignment alignment);
     axi_dma() = delete;
     ~axi_dma();
     bool initialize();
+    bool initialize_descriptors(size_t descriptor_count);
     bool start();
+    bool reset();
     void clean_interrupt();
+    bool mask_interrupt();
+    bool unmask_interrupt();
     acquisition_result poll_interrupt(int timeout);
+    acquisition_result acknowledge_interrupt();
+    int get_interrupt_fd() const;
     void transfer_buffer(sg_descriptor &desc, size_t len);
+    void prepare_buffer(sg_descriptor &desc, size_t len, bool sof = true, bool eof = true);
+    void prepare_buffer(sg_descriptor &desc, uintptr_t buf_phys_addr, size_t len, bool sof = true, bool eof = true);
+    void ring_doorbell(sg_descriptor &tail);
+    void swap_buffers(sg_descriptor &a, sg_descriptor &b);
     size_t get_buffer_size() const;
     uint8_t *get_virt_buffer_pointer(sg_descriptor &desc) const;
+    bool is_buffer_uncached(sg_descriptor &desc);
+    bool sync_for_cpu(sg_descriptor &desc, size_t len);
+    bool sync_for_device(sg_descriptor &desc, size_t len);
+    bool sync_for_device(uintptr_t buf_phys_addr, size_t len);
+    memory_area get_buffer_area() const;
+    const irq_coalescing& get_irq_coalescing() const;
+    uint32_t get_irq_threshold() const;
+    const layout_report& get_layout() const;
+    void set_irq_threshold(uint32_t thresh);
+    uint32_t get_dma_status() const;
+    uint32_t get_dma_errors() const;
+    size_t get_current_desc_index() const;
+    bool recover(size_t first, size_t count);
 
     sg_descriptor_chain sg_desc_chain;   //!< Scatter/Gather descriptor chain
+    channel_counters counters;           //!< Runtime counters
 
 private:
 
@@ -84,7 +277,8 @@ private:
         void reset() { set_flags(dmacontrolf::reset); }
         bool in_reset_state() { return check_flags(dmacontrolf::reset); }
         void enable_irqs(dma_irqs irqs) { set_flags(dmacontrolf::all_irq_en & static_cast<dmacontrolf>(irqs)); }
-        void set_irq_threshold(uint32_t thresh) { set_flags(dmacontrolf::irq_thresh & thresh); }
+        void set_irq_threshold(uint32_t thresh) { update_field(dmacontrolf::irq_thresh, static_cast<dmacontrolf>(thresh << 16)); }
+        void set_irq_delay(uint32_t delay) { update_field(dmacontrolf::irq_delay, static_cast<dmacontrolf>(delay << 24)); }
         void enable_cyclic_mode() { set_flags(dmacontrolf::cyclic_bd_en); }
     };
 
@@ -99,7 +293,9 @@ private:
         void reset() { set_flags(dmacontrolf::reset); }
         bool in_reset_state() { return check_flags(dmacontrolf::reset); }
         void enable_irqs(dma_irqs irqs) { set_flags(dmacontrolf::all_irq_en & static_cast<dmacontrolf>(irqs)); }
-        void set_irq_threshold(uint32_t thresh) volatile { set_flags(dmacontrolf::irq_thresh & thresh); }
+        void set_irq_threshold(uint32_t thresh) volatile { update_field(dmacontrolf::irq_thresh, static_cast<dmacontrolf>(thresh << 16)); }
+        uint32_t get_irq_threshold() const volatile { return static_cast<uint32_t>(get_field(dmacontrolf::irq_thresh)) >> 16; }
+        void set_irq_delay(uint32_t delay) volatile { update_field(dmacontrolf::irq_delay, static_cast<dmacontrolf>(delay << 24)); }
         void enable_cyclic_mode() { set_flags(dmacontrolf::cyclic_bd_en); }
     };
 
@@ -142,7 +338,9 @@ private:
     struct vdmastatusf_wrapper : public vflags_wrapper<dmastatusf>
     {
         vdmastatusf_wrapper(volatile dmastatusf& f) : vflags_wrapper<dmastatusf>{f} {}
-        void clear_irqs(dma_irqs irqs) { set_flags(dmastatusf::all_irqs & static_cast<dmastatusf>(irqs)); }
+        // Interrupt flags are write-1-to-clear: only the bits to be cleared shall be written
+        void clear_irqs(dma_irqs irqs) { vflags = dmastatusf::all_irqs & static_cast<dmastatusf>(irqs); }
+        bool check_irqs(dma_irqs irqs) { return check_flags(dmastatusf::all_irqs & static_cast<dmastatusf>(irqs)); }
     };
 
     /**
@@ -163,27 +361,70 @@ private:
      */
     struct memory_map
     {
-        sg_registers mm2s; //!< MM2S registers
-        uint32_t sg_ctl;   //!< Scatter/Gather User and Cache
-        sg_registers s2mm; //!< S2MM registers
+        sg_registers mm2s;     //!< MM2S registers @0x00
+        uint32_t reserved[5];  //!< Reserved @0x18 - 0x28
+        uint32_t sg_ctl;       //!< Scatter/Gather User and Cache @0x2C
+        sg_registers s2mm;     //!< S2MM registers @0x30
     };
 
-    u_dma_buf udmabuf;                   //!< Associated u-dma-buf buffer
-    uio_device device;                   //!< AXI DMA UIO device
+    /**
+     * @brief Run of consecutive data buffers within one u-dma-buf buffer
+     */
+    struct buffer_area
+    {
+        uintptr_t phys_addr; //!< Physical address of the first buffer
+        uint8_t *virt_addr;  //!< Cacheable virtual address of the first buffer
+        size_t count;        //!< Number of buffers
+    };
+
+    std::shared_ptr<core> dma_core;      //!< AXI DMA core resources, possibly shared with the opposite direction
+    bool shared;                         //!< True if dma_core is shared with a channel driving the opposite direction
+    uintptr_t region_phys_addr;          //!< Physical address of the u-dma-buf region used by this channel
+    uint8_t *region_virt_addr;           //!< Virtual address of the u-dma-buf region used by this channel
+    uint8_t *region_cached_addr;         //!< Cacheable virtual address of the u-dma-buf region, used for data buffers
+    size_t region_size;                  //!< Size in bytes of the u-dma-buf region used by this channel
     dma_mode mode;                       //!< Operational Mode
     transfer_direction direction;        //!< Channel direction
     size_t buffer_size;                  //!< Scatter/Gather buffer size
     uint8_t *buffers;                    //!< Scatter/Gather buffers
     volatile memory_map *registers_base; //!< Memory mapped AXI DMA registers
     pollfd fds;                          //!< Used for polling the UIO device interrupt file descriptor
+    irq_coalescing coalescing;           //!< Interrupt coalescing settings
+    buffer_alignment alignment;          //!< Alignment of the data buffers
+    layout_report layout;                //!< Placement of descriptors and data buffers in the region
+    std::vector<buffer_area> buffer_areas; //!< Data buffers of the ring, in descriptor order
 
+    explicit axi_dma(std::shared_ptr<core> dma_core, bool shared, size_t region_offset, size_t region_size,
+            dma_mode mode, transfer_direction direction, size_t buffer_size, const irq_coalescing& coalescing,
+            buffer_alignment alignment);
+    bool setup_core();
+    void plan_regions();
+    u_dma_buf& udmabuf_of(uintptr_t buf_phys_addr);
+    dma_irqs enabled_irqs() const;
     bool stop();
+    void create_desc_ring();
+    bool start_normal(size_t first, size_t count);
+    bool start_cyclic(size_t first);
+};
+
+/**
+ * @brief Resources of an AXI DMA core: u-dma-buf buffers, UIO device and register mapping.
+ * They may be shared by the channels driving the MM2S and S2MM directions of the same core.
+ */
+class axi_dma::core
+{
+public:
+    explicit core(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& uio_device_name);
+    explicit core(const std::vector<std::string>& udmabuf_names, const std::string& uio_device_name);
+    core() = delete;
+    ~core();
+    bool map();
     bool reset();
-    bool mask_interrupt();
-    bool unmask_interrupt();
-    void create_desc_ring(std::size_t buffer_count);
-    bool start_normal();
-    bool start_cyclic();
+
+    u_dma_buf udmabuf;                   //!< Associated u-dma-buf buffer, holding the descriptors
+    std::vector<std::unique_ptr<u_dma_buf>> data_udmabufs; //!< Extra u-dma-buf buffers holding data buffers only
+    uio_device device;                   //!< AXI DMA UIO device
+    volatile memory_map *registers_base; //!< Memory mapped AXI DMA registers, nullptr until mapped
 };
 
 #endif //#ifndef _AXI_DMA_H
\ No newline at end of file
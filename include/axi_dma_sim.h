@@ -0,0 +1,150 @@
+#ifndef _AXI_DMA_SIM_H
+#define _AXI_DMA_SIM_H
+
+#include "uio.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Anonymous shared memory standing in for the u-dma-buf buffer of the same name
+ * Each buffer gets its own range of fake physical addresses, aligned to 2 MiB, which sim_axi_dma
+ * resolves when walking descriptors.
+ * @note The object shall outlive every channel using it
+ */
+class sim_udmabuf
+{
+public:
+    /**
+     * @brief Allocates the memory and registers it under the given name
+     * @param name of the u-dma-buf buffer to stand in for
+     * @param size in bytes
+     */
+    sim_udmabuf(const std::string& name, size_t size);
+    ~sim_udmabuf();
+
+    sim_udmabuf(const sim_udmabuf&) = delete;
+    sim_udmabuf& operator=(const sim_udmabuf&) = delete;
+
+    /**
+     * @brief Resolves a range of fake physical addresses of any live sim_udmabuf
+     * @return virtual address of the range, nullptr if it doesn't lie entirely within one buffer
+     */
+    static uint8_t *translate(uintptr_t phys_addr, size_t len);
+
+    const std::string name;
+    uintptr_t phys_addr; //!< Fake physical address
+    uint8_t *virt_addr;  //!< Virtual address
+    size_t size;         //!< Size in bytes
+};
+
+/**
+ * @brief Software model of a Scatter/Gather AXI DMA core, standing in for the UIO device of the same name
+ *
+ * A thread watches the register space like the hardware would: it honours soft resets, the run/stop bit,
+ * the current and tail descriptor pointers, cyclic mode and the IRQ threshold and delay settings, walks
+ * descriptor chains held in sim_udmabuf memory, and raises the interrupt through an eventfd.
+ * MM2S transfers are consumed. S2MM transfers are filled with one packet per buffer, whose first
+ * 8 bytes hold a sequence number.
+ * @note The object shall outlive every channel using it
+ */
+class sim_axi_dma : public uio_backend
+{
+public:
+    /**
+     * @brief Traffic model
+     */
+    struct settings
+    {
+        size_t packet_length;        //!< Bytes per S2MM packet, 0 to fill every buffer
+        uint64_t packets_per_second; //!< Line rate of each direction, 0 for as fast as possible
+    };
+
+    /**
+     * @brief Transfers performed so far
+     */
+    struct stats
+    {
+        uint64_t mm2s_packets;
+        uint64_t mm2s_bytes;
+        uint64_t s2mm_packets;
+        uint64_t s2mm_bytes;
+        uint64_t interrupts;
+    };
+
+    /**
+     * @brief Starts the model and registers it under the given name
+     * @param name of the UIO device to stand in for
+     * @param config traffic model
+     */
+    explicit sim_axi_dma(const std::string& name, const settings& config = {0, 0});
+    ~sim_axi_dma() override;
+
+    sim_axi_dma(const sim_axi_dma&) = delete;
+    sim_axi_dma& operator=(const sim_axi_dma&) = delete;
+
+    stats get_stats() const;
+
+    /**
+     * @brief Makes the next descriptor processed by a direction fail with a slave error, which halts the
+     * direction until the next core reset, as on the hardware
+     * @param s2mm true for the S2MM direction, false for MM2S
+     */
+    void inject_slave_error(bool s2mm);
+
+    uint8_t *registers() override;
+    int interrupt_fd() override;
+    bool set_interrupt(bool enabled) override;
+    bool acknowledge_interrupt() override;
+
+private:
+    /**
+     * @brief State of one direction of the core
+     */
+    struct channel
+    {
+        size_t regs;                    //!< Offset of the channel registers in the register space
+        bool s2mm;                      //!< True for the S2MM direction
+        bool running;                   //!< Run/stop bit as last seen
+        uintptr_t current;              //!< Next descriptor to be processed
+        uintptr_t tail;                 //!< Tail descriptor pointer as last seen
+        bool doorbell;                  //!< Descriptors up to tail are waiting to be processed
+        uint32_t status;                //!< Status register as last published
+        uint32_t completions;           //!< Completions not signalled by an interrupt yet
+        uint64_t sequence;              //!< Number of S2MM packets produced
+        std::chrono::steady_clock::time_point last_completion;
+        std::chrono::steady_clock::time_point next_packet; //!< Earliest time the line rate allows a transfer
+    };
+
+    void run();
+    void reset_core();
+    bool step(channel& ch);
+    void process(channel& ch, uint32_t control, bool cyclic);
+    void fail(channel& ch, uint32_t errors);
+    void update_status(channel& ch, uint32_t set, uint32_t clear);
+    void raise_interrupt();
+    std::atomic_ref<uint32_t> reg(size_t offset);
+    uintptr_t reg_address(size_t offset);
+    uintptr_t take_tail(channel& ch);
+
+    const std::string name_;
+    const settings config_;
+    uint8_t *registers_;               //!< Register space
+    int event_fd_;                     //!< Readable while an interrupt is pending
+    std::array<channel, 2> channels_;  //!< MM2S and S2MM
+    std::array<std::atomic<bool>, 2> inject_error_; //!< Fail the next descriptor of MM2S and S2MM
+    std::atomic<bool> irq_enabled_;    //!< Interrupt unmasked, as with UIO it's masked again once raised
+    std::atomic<bool> quit_;
+    std::atomic<uint64_t> mm2s_packets_;
+    std::atomic<uint64_t> mm2s_bytes_;
+    std::atomic<uint64_t> s2mm_packets_;
+    std::atomic<uint64_t> s2mm_bytes_;
+    std::atomic<uint64_t> interrupts_;
+    std::thread engine_;
+};
+
+#endif // #ifndef _AXI_DMA_SIM_H
@@ -0,0 +1,67 @@
+#ifndef _DMA_COPY_H
+#define _DMA_COPY_H
+
+#include <cstddef>
+
+/**
+ * @brief Copy kernels suited to memory shared with a device, selected at run time by CPU feature
+ *
+ * Buffers mapped uncached or write-combined, as u-dma-buf does for devices that aren't cache-coherent, make
+ * memcpy() crawl: its loads stall on every cache line, and its stores may be split by the alignment handling.
+ * to_device() writes with full-width non-temporal stores, which fill whole write-combining lines and keep
+ * device data out of the cache; from_device() reads with streaming loads where the CPU has them, i.e.
+ * MOVNTDQA on x86 with SSE4.1 and LDNP on AArch64. The device side of the copy is aligned to the vector width
+ * with a short memcpy() head, and the other side may have any alignment.
+ * On cached memory, memcpy() is faster: non-temporal stores evict the data, and the fence they need costs more
+ * than a small copy.
+ * @note to_device() orders its stores before any later store, e.g. the doorbell of the transfer, on x86.
+ * ARM already needs the barrier the library puts before handing buffers to the hardware.
+ */
+class dma_copy
+{
+public:
+    /**
+     * @brief Copy kernels, from the most portable one
+     */
+    enum class kernel
+    {
+        generic, //!< memcpy()
+        sse2,    //!< 16-byte non-temporal stores, regular loads
+        sse41,   //!< 16-byte non-temporal stores and streaming loads
+        avx2,    //!< 32-byte non-temporal stores and streaming loads
+        neon     //!< 16-byte NEON loads and stores, non-temporal pairs on AArch64
+    };
+
+    /**
+     * @brief Copies <em>len</em> bytes to memory the device reads
+     */
+    static void to_device(void *dst, const void *src, std::size_t len);
+
+    /**
+     * @brief Copies <em>len</em> bytes from memory the device wrote
+     */
+    static void from_device(void *dst, const void *src, std::size_t len);
+
+    /**
+     * @brief Returns the kernel in use: the fastest one the CPU supports, unless another one was selected
+     */
+    static kernel active();
+
+    /**
+     * @brief Returns true if the CPU can run the given kernel
+     */
+    static bool supported(kernel k);
+
+    /**
+     * @brief Makes every later copy use the given kernel, e.g. to compare them
+     * @return false if the CPU can't run it
+     */
+    static bool select(kernel k);
+
+    /**
+     * @brief Returns the name of a kernel
+     */
+    static const char *name(kernel k);
+};
+
+#endif // #ifndef _DMA_COPY_H
@@ -0,0 +1,158 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Latency histogram with logarithmic buckets split into linear sub-buckets, in the spirit of HdrHistogram
+ *
+ * Values below 2 * sub_buckets nanoseconds are counted exactly. Above, each power of two is split into
+ * sub_buckets buckets, so that the value reported for any recorded latency is off by less than 1 / sub_buckets
+ * of it. Values above max_ns are counted in the last bucket.
+ * Recording a value is a few arithmetic instructions and an increment, with no allocation.
+ */
+class latency_histogram
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 4;
+    static constexpr uint64_t sub_buckets = 1ULL << sub_bucket_bits;
+    static constexpr unsigned max_ns_bits = 36; //!< About 68 s
+    static constexpr uint64_t max_ns = (1ULL << max_ns_bits) - 1;
+    static constexpr std::size_t bucket_count = (max_ns_bits - sub_bucket_bits + 1) * sub_buckets;
+
+    /**
+     * @brief Counts a latency
+     */
+    void record(uint64_t ns)
+    {
+        ns = std::min(ns, max_ns);
+        counts_[bucket_of(ns)]++;
+        total_++;
+        sum_ns_ += ns;
+        max_ns_ = std::max(max_ns_, ns);
+        min_ns_ = (total_ == 1) ? ns : std::min(min_ns_, ns);
+    }
+
+    /**
+     * @brief Adds the counts of another histogram to this one
+     */
+    void merge(const latency_histogram& other)
+    {
+        if (other.total_ == 0)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < bucket_count; i++)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        min_ns_ = (total_ == 0) ? other.min_ns_ : std::min(min_ns_, other.min_ns_);
+        max_ns_ = std::max(max_ns_, other.max_ns_);
+        total_ += other.total_;
+        sum_ns_ += other.sum_ns_;
+    }
+
+    /**
+     * @brief Clears every count
+     */
+    void reset()
+    {
+        *this = latency_histogram{};
+    }
+
+    /**
+     * @brief Returns the number of latencies recorded
+     */
+    uint64_t count() const { return total_; }
+
+    uint64_t min() const { return min_ns_; }
+
+    uint64_t max() const { return max_ns_; }
+
+    uint64_t mean() const { return total_ ? sum_ns_ / total_ : 0; }
+
+    /**
+     * @brief Returns the latency below which a fraction <em>p</em> of the recorded latencies fall
+     * @param p between 0 and 1, e.g. 0.999 for the 99.9th percentile
+     * @return upper bound of the bucket holding the percentile, 0 if nothing was recorded
+     */
+    uint64_t percentile(double p) const
+    {
+        if (total_ == 0)
+        {
+            return 0;
+        }
+
+        const double clamped = std::clamp(p, 0.0, 1.0);
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(clamped * static_cast<double>(total_) + 0.5));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; i++)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+            {
+                return std::clamp(bucket_upper_bound(i), min_ns_, max_ns_);
+            }
+        }
+        return max_ns_;
+    }
+
+    /**
+     * @brief Returns the number of latencies counted in a bucket
+     */
+    uint64_t bucket(std::size_t index) const { return counts_[index]; }
+
+    /**
+     * @brief Returns the bucket counting a latency
+     */
+    static constexpr std::size_t bucket_of(uint64_t ns)
+    {
+        if (ns < 2 * sub_buckets)
+        {
+            return static_cast<std::size_t>(ns);
+        }
+
+        const unsigned shift = static_cast<unsigned>(std::bit_width(ns)) - (sub_bucket_bits + 1);
+        return static_cast<std::size_t>(shift * sub_buckets + (ns >> shift));
+    }
+
+    /**
+     * @brief Returns the smallest latency counted in a bucket
+     */
+    static constexpr uint64_t bucket_lower_bound(std::size_t index)
+    {
+        if (index < 2 * sub_buckets)
+        {
+            return index;
+        }
+
+        const unsigned shift = static_cast<unsigned>(index / sub_buckets) - 1;
+        return (index % sub_buckets + sub_buckets) << shift;
+    }
+
+    /**
+     * @brief Returns the largest latency counted in a bucket
+     */
+    static constexpr uint64_t bucket_upper_bound(std::size_t index)
+    {
+        return (index + 1 < bucket_count) ? bucket_lower_bound(index + 1) - 1 : max_ns;
+    }
+
+private:
+    std::array<uint64_t, bucket_count> counts_ {};
+    uint64_t total_ = 0;
+    uint64_t sum_ns_ = 0;
+    uint64_t min_ns_ = 0;
+    uint64_t max_ns_ = 0;
+};
+
+static_assert(latency_histogram::bucket_of(latency_histogram::max_ns) == latency_histogram::bucket_count - 1);
+static_assert(latency_histogram::bucket_lower_bound(latency_histogram::bucket_of(1000)) <= 1000);
+static_assert(latency_histogram::bucket_upper_bound(latency_histogram::bucket_of(1000)) >= 1000);
+
+#endif // #ifndef _LATENCY_HISTOGRAM_H
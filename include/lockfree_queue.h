@@ -0,0 +1,126 @@
+#ifndef _LOCKFREE_QUEUE_H
+#define _LOCKFREE_QUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+
+/**
+ * @brief Bounded lock-free FIFO queue, safe for any number of producers and consumers
+ *
+ * Each cell carries a sequence number telling whether it's ready to be written or read for the current
+ * lap, so producers and consumers only contend on their own position counter.
+ * The capacity is rounded up to the next power of two.
+ */
+template <typename T>
+class lockfree_queue
+{
+public:
+    explicit lockfree_queue(std::size_t capacity)
+        : cells_(std::make_unique<cell[]>(std::bit_ceil(capacity < 2 ? 2 : capacity))),
+          mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1), push_pos_(0), pop_pos_(0)
+    {
+        for (std::size_t i = 0; i <= mask_; i++)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    lockfree_queue(const lockfree_queue&) = delete;
+    lockfree_queue& operator=(const lockfree_queue&) = delete;
+
+    /**
+     * @brief Appends an element to the queue
+     * @return false if the queue is full
+     */
+    bool try_push(const T& value)
+    {
+        std::size_t pos = push_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell& c = cells_[pos & mask_];
+            const std::size_t seq = c.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0)
+            {
+                if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    c.value = value;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = push_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Removes the oldest element from the queue
+     * @return false if the queue is empty
+     */
+    bool try_pop(T& value)
+    {
+        std::size_t pos = pop_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell& c = cells_[pos & mask_];
+            const std::size_t seq = c.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0)
+            {
+                if (pop_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = c.value;
+                    c.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = pop_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Returns true if no element has been pushed and not popped yet
+     * @note The result is only a snapshot when other threads are pushing or popping concurrently. An element
+     *       being pushed makes the queue non-empty even before try_pop() can return it.
+     */
+    bool empty() const
+    {
+        const std::size_t pop_pos = pop_pos_.load(std::memory_order_seq_cst);
+        return push_pos_.load(std::memory_order_seq_cst) == pop_pos;
+    }
+
+    /**
+     * @brief Returns the maximum number of elements the queue can hold
+     */
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct cell
+    {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> cells_;
+    const std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> push_pos_; //!< Next position to be written, shared by producers
+    alignas(64) std::atomic<std::size_t> pop_pos_;  //!< Next position to be read, shared by consumers
+};
+
+#endif // #ifndef _LOCKFREE_QUEUE_H
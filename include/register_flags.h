@@ -4,9 +4,16 @@
 #include <cstdint>
 
 template <typename flags>
-inline constexpr flags operator|= (flags f1, flags f2)
+inline constexpr flags& operator|= (flags& f1, flags f2)
 {
-    return static_cast<flags>(static_cast<uint32_t>(f1) | static_cast<uint32_t>(f2));
+    f1 = static_cast<flags>(static_cast<uint32_t>(f1) | static_cast<uint32_t>(f2));
+    return f1;
+}
+
+template <typename flags>
+inline void operator|= (volatile flags& f1, flags f2)
+{
+    f1 = static_cast<flags>(static_cast<uint32_t>(f1) | static_cast<uint32_t>(f2));
 }
 
 template <typename flags>
@@ -22,9 +29,16 @@ inline constexpr flags operator& (flags f1, flags f2)
 }
 
 template <typename flags>
-inline constexpr flags operator&= (flags f1, flags f2)
+inline constexpr flags& operator&= (flags& f1, flags f2)
 {
-    return static_cast<flags>(static_cast<uint32_t>(f1) & static_cast<uint32_t>(f2));
+    f1 = static_cast<flags>(static_cast<uint32_t>(f1) & static_cast<uint32_t>(f2));
+    return f1;
+}
+
+template <typename flags>
+inline void operator&= (volatile flags& f1, flags f2)
+{
+    f1 = static_cast<flags>(static_cast<uint32_t>(f1) & static_cast<uint32_t>(f2));
 }
 
 template <typename flags>
@@ -34,9 +48,10 @@ inline constexpr flags operator& (flags f, uint32_t v)
 }
 
 template <typename flags>
-inline constexpr flags operator&= (flags f, uint32_t v)
+inline constexpr flags& operator&= (flags& f, uint32_t v)
 {
-    return static_cast<flags>(static_cast<uint32_t>(f) & v);
+    f = static_cast<flags>(static_cast<uint32_t>(f) & v);
+    return f;
 }
 
 template <typename flags>
@@ -55,6 +70,7 @@ struct flags_wrapper
     void set_flags(T f) { flags |= f; }
     bool check_flags(T f) { return ((flags & f) == f); }
     void clear_flags(T f) { flags &= ~f; }
+    void update_field(T mask, T value) { flags = (flags & ~mask) | (value & mask); }
     T& flags;
 };
 
@@ -79,6 +95,8 @@ struct vflags_wrapper
     void set_flags(T f) volatile { vflags |= f; }
     bool check_flags(T f) volatile { return ((vflags & f) == f); }
     void clear_flags(T f) volatile { vflags &= ~f; }
+    void update_field(T mask, T value) volatile { vflags = (vflags & ~mask) | (value & mask); }
+    T get_field(T mask) const volatile { return (vflags & mask); }
     volatile T& vflags;
 };
 
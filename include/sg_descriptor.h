@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <cstddef>
 #include <iterator>
+#include <vector>
 
 /**
  * @brief Scatter/Gather control register flags
@@ -47,11 +48,22 @@ struct alignas(64) sg_descriptor
     uint32_t buf_addr_msb;  //!< MSB of Buffer address @0x0C
     uint32_t reserved1[2];  //!< Reserved @0x10 - 0x14
     controlf control;       //!< Control @0x18
-    statusf status;         //!< Status field @0x1C
+    uint32_t status;        //!< Status field @0x1C, see statusf
     uint32_t app[5];        //!< User Application Fields @0x20 - 0x30
     uint32_t reserved2[3];  //!< Used to ensure 16-word alignment
 };
 
+/**
+ * @brief Addresses associated to a descriptor, computed once when the descriptor ring is created
+ */
+struct sg_descriptor_info
+{
+    std::size_t index;        //!< Position of the descriptor in the chain
+    uintptr_t desc_phys_addr; //!< Physical address of the descriptor
+    uint8_t *buf_virt_addr;   //!< Virtual address of the associated data buffer
+    uintptr_t buf_phys_addr;  //!< Physical address of the associated data buffer
+};
+
 /**
  * @brief Thin wrapper over a sg_descriptor to provide field setters and getters
  */
@@ -60,7 +72,11 @@ struct sg_descriptor_handle
     sg_descriptor_handle(sg_descriptor &desc);
     bool completed() const;
     void clear_complete_flag();
+    void clear_complete_flag_unordered();
     size_t get_buffer_len() const;
+    bool start_of_frame() const;
+    bool end_of_frame() const;
+    uint32_t errors() const;
     sg_descriptor &d;
 };
 
@@ -107,10 +123,15 @@ public:
     iterator next(iterator& it);
     const iterator next(const iterator& it) const;
     std::size_t offset(const iterator& it) const;
+    std::size_t index(const sg_descriptor& desc) const;
+    void set_info(std::size_t idx, uintptr_t desc_phys_addr, uint8_t *buf_virt_addr, uintptr_t buf_phys_addr);
+    const sg_descriptor_info& info(std::size_t idx) const;
+    const sg_descriptor_info& info(const sg_descriptor& desc) const;
 
 private:
     sg_descriptor* head_;
     std::size_t size_;
+    std::vector<sg_descriptor_info> info_; //!< Per-descriptor address table, indexed by descriptor position
 };
 
 /**
@@ -119,7 +140,7 @@ private:
 struct controlf_wrapper : public flags_wrapper<controlf>
 {
     controlf_wrapper(controlf& f) : flags_wrapper<controlf>{f} {}
-    void set_buf_len(size_t len) { set_flags(controlf::buf_len & len); }
+    void set_buf_len(size_t len) { update_field(controlf::buf_len, static_cast<controlf>(len)); }
 };
 
 /**
@@ -128,43 +149,32 @@ struct controlf_wrapper : public flags_wrapper<controlf>
 struct vcontrolf_wrapper : public vflags_wrapper<controlf>
 {
     vcontrolf_wrapper(volatile controlf& f) : vflags_wrapper<controlf>{f} {}
-    void set_buf_len(size_t len) volatile { set_flags(controlf::buf_len & len); }
-};
-
-/**
- * @brief Thin wrapper around a statusf object to provide field setters and getters
- */
-struct statusf_wrapper : public flags_wrapper<statusf>
-{
-    statusf_wrapper(statusf& f) : flags_wrapper<statusf>{f} {}
-    size_t get_xfer_bytes() const { return static_cast<size_t>(flags & statusf::xfer_bytes); }
-};
-
-/**
- * @brief Thin wrapper around a const statusf object to provide field setters and getters
- */
-struct cstatusf_wrapper : public cflags_wrapper<statusf>
-{
-    cstatusf_wrapper(const statusf& f) : cflags_wrapper<statusf>{f} {}
-    size_t get_xfer_bytes() const { return static_cast<size_t>(cflags & statusf::xfer_bytes); }
+    void set_buf_len(size_t len) volatile { update_field(controlf::buf_len, static_cast<controlf>(len)); }
 };
 
 /**
- * @brief Thin wrapper around a volatile statusf object to provide field setters and getters
+ * @brief Thin wrapper around a status field, stored as a plain uint32_t, to provide statusf setters and getters
  */
-struct vstatusf_wrapper : public vflags_wrapper<statusf>
+struct statusf_wrapper
 {
-    vstatusf_wrapper(volatile statusf& f) : vflags_wrapper<statusf>{f} {}
-    size_t get_xfer_bytes() const volatile { return static_cast<size_t>(vflags & statusf::xfer_bytes); }
+    statusf_wrapper(uint32_t& f) : flags(f) {}
+    void set_flags(statusf f) { flags |= static_cast<uint32_t>(f); }
+    bool check_flags(statusf f) const { return ((flags & static_cast<uint32_t>(f)) == static_cast<uint32_t>(f)); }
+    void clear_flags(statusf f) { flags &= ~static_cast<uint32_t>(f); }
+    size_t get_xfer_bytes() const { return static_cast<size_t>(flags & static_cast<uint32_t>(statusf::xfer_bytes)); }
+    uint32_t& flags;
 };
 
 /**
- * @brief Thin wrapper around a const volatile statusf object to provide field setters and getters
+ * @brief Thin wrapper around a const status field, stored as a plain uint32_t, to provide statusf getters
  */
-struct cvstatusf_wrapper : public cvflags_wrapper<statusf>
+struct cstatusf_wrapper
 {
-    cvstatusf_wrapper(const volatile statusf& f) : cvflags_wrapper<statusf>{f} {}
-    size_t get_xfer_bytes() const volatile { return static_cast<size_t>(cvflags & statusf::xfer_bytes); }
+    cstatusf_wrapper(const uint32_t& f) : cflags(f) {}
+    bool check_flags(statusf f) const { return ((cflags & static_cast<uint32_t>(f)) == static_cast<uint32_t>(f)); }
+    size_t get_xfer_bytes() const { return static_cast<size_t>(cflags & static_cast<uint32_t>(statusf::xfer_bytes)); }
+    uint32_t get_errors() const { return cflags & static_cast<uint32_t>(statusf::dma_errors); }
+    const uint32_t& cflags;
 };
 
 #endif
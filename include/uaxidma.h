@@ -2,9 +2,16 @@
 #define _UAXIDMA_H
 
 #include "axi_dma.h"
+#include "dma_copy.h"
+#include "latency_histogram.h"
 #include "udmabuf.h"
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
+#include <sys/uio.h>
 #include <vector>
 
 class uaxidma
@@ -30,12 +37,98 @@ public:
         timeout = static_cast<int>(axi_dma::acquisition_result::timeout)
     };
 
+    /**
+     * @brief Strategy used to wait for buffer completion
+     */
+    enum class wait_policy
+    {
+        interrupt = 0, //!< Sleep until the AXI DMA raises an interrupt
+        busy_poll = 1, //!< Spin on the descriptor complete flag with the interrupt masked
+        hybrid = 2     //!< Spin for a while with the interrupt masked, then fall back to sleeping on the interrupt
+    };
+
+    /**
+     * @brief Outcome of arm()
+     */
+    enum class arm_result
+    {
+        armed = 0, //!< The interrupt is unmasked: wait for fd() to become readable
+        ready = 1, //!< A buffer is already completed: acquire it without waiting
+        error = 2  //!< The interrupt could not be unmasked, errno is set
+    };
+
+    /**
+     * @brief Interrupt coalescing settings
+     *
+     * An interrupt is raised every <em>threshold</em> completed buffers, or <em>delay</em> timer ticks
+     * after the last completion if fewer than <em>threshold</em> buffers are pending.
+     * When <em>threshold</em> is greater than 1, <em>delay</em> should be non-zero, otherwise the last
+     * buffers of a burst will not be notified until further traffic arrives.
+     * If <em>adaptive</em> is set, the library halves the threshold when wakeups deliver fewer buffers
+     * than the threshold and doubles it when they deliver more than twice the threshold. Adaptive
+     * mode requires a non-zero <em>delay</em>.
+     */
+    using irq_coalescing = axi_dma::irq_coalescing;
+
+    /**
+     * @brief Alignment of the data buffers, see axi_dma::buffer_alignment
+     *
+     * Larger alignments keep descriptors and payload on separate cache lines and allow aligned SIMD
+     * loads and O_DIRECT I/O straight from the buffers, at the cost of some u-dma-buf space.
+     * @note Alignment is guaranteed for physical addresses. Virtual addresses share the same alignment
+     * up to the page size.
+     */
+    using buffer_alignment = axi_dma::buffer_alignment;
+
+    /**
+     * @brief Placement of descriptors and data buffers, and the space lost to alignment
+     */
+    using layout_report = axi_dma::layout_report;
+
+    /**
+     * @brief Counters describing how many buffers each interrupt wakeup delivered
+     */
+    struct irq_stats
+    {
+        uint64_t wakeups;                //!< Number of interrupt wakeups taken
+        uint64_t buffers;                //!< Number of buffers acquired
+        uint64_t last_wakeup_buffers;    //!< Buffers delivered by the last finished wakeup
+        uint64_t max_wakeup_buffers;     //!< Largest number of buffers delivered by a single wakeup
+        uint32_t irq_threshold;          //!< Interrupt threshold currently in use
+        std::array<uint64_t, 10> histogram; //!< Wakeups per buffers delivered: bucket 0 holds spurious wakeups, bucket i holds [2^(i-1), 2^i)
+    };
+
+    /**
+     * @brief Snapshot of the runtime counters of the channel, see axi_dma::channel_stats
+     */
+    using channel_stats = axi_dma::channel_stats;
+
+    /**
+     * @brief DMA error the channel halted on, and how it was recovered, see axi_dma::error_report
+     */
+    using error_report = axi_dma::error_report;
+
+    /**
+     * @brief Reads the sequence number the data source stamped a received buffer with, e.g. a frame counter
+     * in a stream header. Consecutive buffers of the stream shall carry consecutive numbers.
+     */
+    using sequence_reader = std::function<uint64_t(const uint8_t *data, size_t length)>;
+
+    /**
+     * @brief Latency distributions measured by the channel, see buffer::completion_time()
+     */
+    struct latency_histograms
+    {
+        latency_histogram irq_to_user;        //!< From buffer completion being observed until it's handed to the application
+        latency_histogram submit_to_complete; //!< From TX buffer submission until its completion is observed
+    };
+
     class buffer
     {
     friend class uaxidma;
     public:
-        buffer(uint8_t *data, size_t max_len, sg_descriptor& desc)
-            : data_(data), length_(0), capacity_(max_len), desc_handle_{desc} {}
+        buffer(uint8_t *data, size_t max_len, sg_descriptor& desc, bool uncached = false)
+            : data_(data), length_(0), capacity_(max_len), desc_handle_{desc}, sequence_(0), uncached_(uncached) {}
         /**
          * @brief Returns the pointer to the beginning of data
          * @return nullptr on errors
@@ -52,11 +145,95 @@ public:
          * @return false if len exceeds the buffer's capacity
          */
         bool set_payload(size_t len);
+        /**
+         * @brief Fills the buffer and sets the data length, with the dma_copy kernel if the buffer is mapped
+         * uncached, memcpy() otherwise
+         * @param src data to be sent
+         * @param len number of bytes
+         * @return false if len exceeds the buffer's capacity
+         */
+        bool copy_in(const void *src, size_t len);
+        /**
+         * @brief Fills the buffer with the concatenation of several pieces of data, see copy_in()
+         * @return false if they exceed the buffer's capacity
+         */
+        bool copy_in(std::span<const iovec> src);
+        /**
+         * @brief Copies received data out of the buffer, with the dma_copy kernel if the buffer is mapped uncached,
+         * memcpy() otherwise
+         * @param dst destination
+         * @param len bytes to copy at most
+         * @param offset of the first byte to copy
+         * @return number of bytes copied, less than len if the data ends first
+         */
+        size_t copy_out(void *dst, size_t len, size_t offset = 0);
+        /**
+         * @brief Scatters received data over several destinations, filling each one in turn, see copy_out()
+         * @return number of bytes copied
+         */
+        size_t copy_out(std::span<const iovec> dst, size_t offset = 0);
+        /**
+         * @brief Returns when the channel observed the buffer completed, either on the interrupt wakeup or while
+         * polling the descriptor
+         * @note Completion is only observed when the application asks for buffers, or waits for them. TX waits
+         * look at every submitted buffer, not only at the one they wait for, so that TX completions are
+         * observed on the first wait after they happen rather than when the buffer comes around again.
+         */
+        std::chrono::steady_clock::time_point completion_time() const;
+        /**
+         * @brief Returns when the buffer was handed to the application
+         */
+        std::chrono::steady_clock::time_point handoff_time() const;
+        /**
+         * @brief Returns when the buffer was last submitted for transmission, i.e. the submission whose completion
+         * is reported by completion_time()
+         * @note Only meaningful in mem_to_dev transfers. The epoch is returned until the buffer is first submitted.
+         */
+        std::chrono::steady_clock::time_point submit_time() const;
+        /**
+         * @brief Returns the position of the buffer in the received stream
+         * @note Only meaningful in cyclic transfers. It's the number returned by the sequence_reader if one was
+         * set with set_overrun_policy(), otherwise the number of buffers acquired, lost and skipped before this one.
+         */
+        uint64_t sequence() const;
     private:
         uint8_t *data_;
         size_t length_;
         size_t capacity_;
         sg_descriptor_handle desc_handle_;
+        std::chrono::steady_clock::time_point completed_at_;
+        std::chrono::steady_clock::time_point handed_at_;
+        std::chrono::steady_clock::time_point submitted_at_;
+        uint64_t sequence_;
+        bool uncached_; //!< Data mapped uncached or write-combined, which copies shall go through dma_copy for
+    };
+
+    /**
+     * @brief Zero-copy view over the buffers holding a single AXI stream packet, from SOF to EOF
+     */
+    class packet
+    {
+    friend class uaxidma;
+    public:
+        packet() = default;
+        /**
+         * @brief Returns the buffers holding the packet, in stream order
+         */
+        std::span<buffer*> fragments() const;
+        /**
+         * @brief Returns the total number of bytes of the packet
+         */
+        size_t length() const;
+        /**
+         * @brief Describes the packet as an I/O vector suitable for readv()/writev()-like calls
+         * @param iov storage for the I/O vector, with at least fragments().size() elements
+         * @return number of elements written to <em>iov</em>
+         */
+        size_t to_iovec(std::span<iovec> iov) const;
+    private:
+        packet(std::span<buffer*> fragments, size_t length) : fragments_(fragments), length_(length) {}
+        std::span<buffer*> fragments_;
+        size_t length_ = 0;
     };
 
     /**
@@ -81,12 +258,149 @@ public:
      * @param direction can be a value of @ref direction
      * 
      * @param buffer_size size of each buffer in bytes
+     *
+     * @param coalescing interrupt coalescing settings, see @ref irq_coalescing.
+     * Defaults to one interrupt per buffer.
+     *
+     * @param alignment of the data buffers, see @ref buffer_alignment.
+     * Defaults to buffers packed right after each other.
      */
     uaxidma(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& axidma_uio_name,
-            dma_mode mode, transfer_direction direction, size_t buffer_size);
+            dma_mode mode, transfer_direction direction, size_t buffer_size,
+            const irq_coalescing& coalescing = {1u, 0u, false},
+            buffer_alignment alignment = buffer_alignment::bus);
+
+    /**
+     * @brief Creates a DMA channel whose ring is spread over several udmabuf buffers, e.g. when memory
+     * fragmentation prevents reserving a single buffer large enough.
+     * @param udmabuf_names of the udmabuf buffers to use, each of them in full. The descriptors of the
+     * whole ring go in the first one, followed by as many data buffers as fit. The remaining data buffers
+     * are placed in the following udmabuf buffers, in order. Execution is aborted if the list is empty.
+     *
+     * The other parameters have the same meaning as for the single udmabuf buffer constructor.
+     */
+    uaxidma(const std::vector<std::string>& udmabuf_names, const std::string& axidma_uio_name,
+            dma_mode mode, transfer_direction direction, size_t buffer_size,
+            const irq_coalescing& coalescing = {1u, 0u, false},
+            buffer_alignment alignment = buffer_alignment::bus);
 
     bool initialize();
 
+    /**
+     * @brief Returns the file descriptor to be monitored for readability (e.g. with epoll) when the
+     * channel is driven by an external event loop
+     *
+     * The expected sequence is:
+     * -# call arm(). If it returns arm_result::ready, a buffer is already completed: acquire it right away.
+     * -# wait until the file descriptor becomes readable.
+     * -# call on_readable(), then acquire completed buffers with a zero timeout, and go back to step 1.
+     */
+    int fd() const;
+
+    /**
+     * @brief Prepares the channel to notify the next buffer completion through fd()
+     * @return arm_result::armed if the caller shall wait for fd() to become readable, arm_result::ready if a
+     *         buffer can already be acquired without waiting, arm_result::error if the interrupt can't be unmasked
+     */
+    arm_result arm();
+
+    /**
+     * @brief Acknowledges the interrupt notified through fd()
+     * @return success if the interrupt was consumed, error otherwise
+     */
+    acquisition_result on_readable();
+
+    /**
+     * @brief Selects how get_buffer() and get_buffers() wait for buffer completion
+     * @note Busy-polling burns a CPU core, and is meant for latency-critical loops running on isolated cores.
+     * @param policy can be a value of @ref wait_policy. Defaults to wait_policy::interrupt.
+     * @param spin_time how long to spin before falling back to the interrupt. Only used with wait_policy::hybrid.
+     */
+    void set_wait_policy(wait_policy policy, std::chrono::nanoseconds spin_time = std::chrono::nanoseconds::zero());
+
+    /**
+     * @brief Returns a snapshot of the interrupt wakeup counters
+     */
+    irq_stats get_irq_stats() const;
+
+    /**
+     * @brief Returns a snapshot of the runtime counters
+     * @note Can be called from any thread, e.g. to export them while the channel is running
+     */
+    channel_stats get_stats() const;
+
+    /**
+     * @brief Returns the latency histograms of the channel
+     * Every acquired buffer adds its IRQ-to-user latency, and every TX buffer acquired again adds the
+     * submit-to-complete latency of its previous transmission.
+     * @note Not thread-safe: shall be called from the thread driving the channel
+     */
+    const latency_histograms& get_latency_histograms() const;
+
+    /**
+     * @brief Clears the latency histograms, e.g. after a warm-up phase
+     */
+    void reset_latency_histograms();
+
+    /**
+     * @brief Selects whether waits for buffer completion restart the channel on their own when the core halts
+     * on a DMA error, e.g. a transient slave error. Enabled by default.
+     * When disabled, the wait returns an error and sets errno to EIO, and the application may call recover().
+     */
+    void set_error_recovery(bool automatic);
+
+    /**
+     * @brief Restarts the channel if the core halted on a DMA error
+     * The descriptors that were in flight are rebuilt and handed back to the hardware, starting from the one
+     * the channel stopped at. Buffers held by the application stay valid, and completed buffers not acquired
+     * yet are kept. The RX buffer or TX packet being transferred when the error occurred is lost or sent again.
+     * @note Only channels with exclusive use of the AXI DMA core can recover, as resetting the core would
+     * halt the opposite direction as well
+     * @return true if the channel is running, false if it couldn't be restarted
+     */
+    bool recover();
+
+    /**
+     * @brief Returns the last DMA error the channel halted on, see get_stats() for how many there were
+     */
+    const error_report& get_last_error() const;
+
+    /**
+     * @brief Selects how a cyclic channel deals with the hardware overwriting buffers the application didn't
+     * acquire yet
+     * The hardware lapping the application is detected on acquisition, counted in get_stats(), and the ring is
+     * resynchronized so that buffers are still handed over in stream order.
+     * @param skip_to_newest if set, the next buffer acquired after an overrun is the newest one completed, and
+     * the older ones still intact are counted as skipped. Otherwise it's the oldest one left, a few buffers
+     * away from the one being written.
+     * @param reader of the sequence numbers stamped by the data source, if any. Without it, the buffers lost on
+     * an overrun are inferred from the position of the hardware in the ring, which undercounts if it went more
+     * than a full lap ahead. With it, every gap in the sequence is counted as lost, so that accounting is exact.
+     */
+    void set_overrun_policy(bool skip_to_newest, sequence_reader reader = {});
+
+    /**
+     * @brief Returns the number of buffers in the ring
+     * @note Only meaningful once the channel has been initialized
+     */
+    size_t buffer_count() const;
+
+    /**
+     * @brief Returns the placement of descriptors and data buffers in the u-dma-buf buffer(s)
+     * @note Only meaningful once the channel has been initialized
+     */
+    const layout_report& get_layout() const;
+
+    /**
+     * @brief Computes the layout a channel would get, e.g. to compare the space wasted by each alignment
+     * before reserving u-dma-buf memory
+     * @param udmabuf_size in bytes of the u-dma-buf buffer, whose physical address is assumed to be aligned to
+     * <em>alignment</em>
+     * @param buffer_size size of each buffer in bytes
+     * @param alignment of the data buffers
+     */
+    static layout_report plan_layout(size_t udmabuf_size, size_t buffer_size, buffer_alignment alignment);
+
     /**
      * @brief Acquires the next buffer from the list
      * In mem_to_dev transfers, the user must first call this function, then write the
@@ -98,8 +412,14 @@ public:
      * calling submit_buffer()), the user may get up to <em>N</em> buffers - where the value 
      * of <em>N</em> depends on the size of each buffer and the size of the u-dma-buf memory segment 
      * reserved for the DMA - before the API returns an error and sets errno to EAGAIN.
-     * An attempt to submit buffers in a different order than the one in which said buffers were 
-     * obtained results in undefined behaviour.
+     * Buffers may be submitted or marked reusable in a different order than the one in which they were
+     * obtained. A buffer is handed back to the hardware as soon as every buffer obtained before it has been
+     * handed back too.
+     * @note On u-dma-buf buffers that aren't cache-coherent, data buffers are mapped cacheable, and the
+     *       received bytes are handed over to the CPU here. Buffer ownership is handed back to the device by
+     *       mark_reusable() and submit_buffer(), over the payload length only, so that the CPU shall not touch
+     *       a buffer after releasing it. If a received buffer can't be handed over, it's dropped and the API
+     *       returns an error. Failed hand-overs in either direction are counted in channel_stats::sync_errors.
      * @note The semantics of the timeout parameter is the same as for the poll() function.
      *       It is given in milliseconds, and -1 indicates no timeout, while 0 indicates non-blocking behaviour.
      * @param timeout 
@@ -114,13 +434,81 @@ public:
      */
     void mark_reusable(buffer &buf);
 
+    /**
+     * @brief Acquires every consecutive completed buffer from the list, waiting at most once for an interrupt
+     * Buffers are returned in the same order get_buffer() would have returned them, and may be released
+     * either one by one or with the batch variants of mark_reusable() and submit_buffers().
+     * @note The semantics of the timeout parameter is the same as for get_buffer(). The wait only takes
+     *       place if no buffer is completed on entry.
+     * @note A received buffer that can't be handed over to the CPU is dropped, and ends the batch. The API
+     *       only returns an error if it's the first one.
+     * @param bufs storage for the acquired buffer pointers. At most bufs.size() buffers are acquired.
+     * @param timeout
+     * @return Pair of acquisition_result object representing the success of the operation and number of
+     *         buffers written to <em>bufs</em>
+     */
+    std::pair<acquisition_result, size_t> get_buffers(std::span<buffer*> bufs, int timeout);
+
+    /**
+     * @brief Returns the ownership of a batch of buffers to the DMA library
+     * @note To be used only when direction has been set to dev_to_mem
+     */
+    void mark_reusable(std::span<buffer*> bufs);
+
+    /**
+     * @brief Submits a batch of buffers for transmission to the device end-point
+     * All descriptors are prepared first, and the AXI DMA is then notified once, with a single tail
+     * descriptor update pointing to the last buffer of the batch.
+     * @note To be used only when direction has been set to mem_to_dev
+     */
+    void submit_buffers(std::span<buffer*> bufs);
+
     /**
      * @brief Submits a buffer for transmission to the device end-point
      * @note To be used only when direction has been set to mem_to_dev
      */
     void submit_buffer(buffer &buf);
 
+    /**
+     * @brief Acquires the next complete packet, which may span several buffers
+     * The packet is only acquired once every buffer from its start (SOF) to its end (EOF) is completed.
+     * Buffers preceding the start of a packet, e.g. the tail of a packet partially overwritten in cyclic
+     * mode, are released and skipped.
+     * @note To be used only when direction has been set to dev_to_mem
+     * @note If the packet spans more buffers than <em>storage</em> or the whole ring can hold, it's dropped,
+     *       and the API returns an error and sets errno to EMSGSIZE. It's dropped as well if any of its buffers
+     *       can't be handed over to the CPU.
+     * @param storage for the pointers to the buffers holding the packet. The returned packet refers to it.
+     * @param timeout with the same semantics as for get_buffer()
+     * @return Pair of acquisition_result object representing the success of the operation and the packet
+     */
+    std::pair<acquisition_result, packet> get_packet(std::span<buffer*> storage, int timeout);
+
+    /**
+     * @brief Returns ownership of every buffer of a packet to the DMA library
+     * @note To be used only when direction has been set to dev_to_mem
+     */
+    void mark_reusable(const packet &pkt);
+
+    /**
+     * @brief Submits a packet spanning several buffers for transmission to the device end-point
+     * The first buffer is flagged as start of packet and the last one as end of packet, and the AXI DMA
+     * is notified once for the whole packet.
+     * @note To be used only when direction has been set to mem_to_dev
+     * @note Buffers shall be consecutive buffers of the ring, given in the same order in which they were obtained
+     */
+    void submit_packet(std::span<buffer*> bufs);
+
 private:
+    friend class uaxidma_duplex;
+    friend class uaxidma_tx_queue;
+
+    /**
+     * @brief Creates a DMA channel sharing an AXI DMA core with the channel driving the opposite direction
+     */
+    uaxidma(std::shared_ptr<axi_dma::core> shared_core, size_t region_offset, size_t region_size,
+            dma_mode mode, transfer_direction direction, size_t buffer_size, const irq_coalescing& coalescing,
+            buffer_alignment alignment);
 
     class buffer_ring
     {
@@ -149,25 +537,93 @@ private:
          * @brief Provides a read-only view of the next available buffer from the list
          */
         const buffer &peek_next() const;
+        /**
+         * @brief Provides a read-only view of the n-th buffer after the next available one
+         */
+        const buffer &peek(std::size_t n) const;
+        /**
+         * @brief Returns the number of buffers that can be acquired before the list runs out of buffers
+         */
+        std::size_t available() const;
         /**
          * @brief Obtains the next available buffer. The buffer returned won't be available again until released.
          */
         buffer& acquire();
         /**
-         * @brief Releases a buffer, making it available for future use
+         * @brief Releases a buffer. Buffers may be released in any order, but a buffer only becomes available
+         * again once every buffer acquired before it has been released too.
+         * @return the last buffer of the run of buffers that became available again, nullptr if none did
+         */
+        buffer *release(buffer& buf);
+        /**
+         * @brief Returns the buffer bound to the oldest ring position acquired and not available yet
+         */
+        buffer& oldest_held();
+        /**
+         * @brief Exchanges the ring positions of two buffers, i.e. the descriptors they're bound to
+         */
+        void swap(buffer& a, buffer& b);
+        /**
+         * @brief Returns the first available buffer not seen completed yet by mark_seen(), nullptr if none
          */
-        void release(buffer& buf);
+        buffer *peek_unseen();
+        /**
+         * @brief Records that the buffer returned by peek_unseen() was seen completed
+         */
+        void mark_seen();
+        /**
+         * @brief Moves past the next <em>n</em> buffers without acquiring them
+         * @note Only meant for lists without reference limits, whose buffers are never withheld from the hardware
+         */
+        void skip(std::size_t n);
     private:
         std::vector<buffer> buffers_;
-        std::vector<buffer>::iterator next_;
+        std::vector<buffer*> slots_;          //!< Buffer bound to each ring position, i.e. to each descriptor
+        std::vector<std::size_t> positions_;  //!< Ring position of each buffer
+        std::vector<buffer>::iterator next_;  //!< Next ring position to be acquired
+        std::vector<bool> released_; //!< Buffers released by the application, waiting for older ones to be released
+        std::size_t oldest_;         //!< Position of the oldest buffer acquired and not available yet
         std::size_t available_;
+        std::size_t seen_;           //!< Available buffers, from the next one, already seen completed
         bool limit_refs_;
     };
 
+    bool next_completed() const;
+    acquisition_result wait_for_completion(int timeout);
+    acquisition_result wait_for_completion(const sg_descriptor_handle& next, int timeout);
+    acquisition_result block_for_completion(const sg_descriptor_handle& next, int timeout);
+    acquisition_result check_channel();
+    void account_wakeup();
+    void account_transfer(size_t count, size_t bytes);
+    void account_acquired(const buffer& buf);
+    void account_ring_occupancy();
+    void stamp_acquired(buffer& buf, std::chrono::steady_clock::time_point handed);
+    void stamp_completed(buffer& buf, std::chrono::steady_clock::time_point seen);
+    void observe_completions(std::chrono::steady_clock::time_point seen);
+    bool receive(buffer& buf);
+    void check_overrun();
+    void track_sequence(buffer& buf);
+    void rebind(buffer& a, buffer& b);
+    void submit_in_order(std::span<buffer*> bufs);
+
     axi_dma axidma;
     dma_mode mode;
     transfer_direction direction;
     buffer_ring buffers;
+    irq_stats wakeup_stats;        //!< Interrupt wakeup counters
+    uint64_t wakeup_buffers;       //!< Buffers delivered since the last wakeup
+    uint32_t max_adaptive_thresh;  //!< Upper bound for the adaptive interrupt threshold
+    wait_policy wait_mode;         //!< Strategy used to wait for buffer completion
+    std::chrono::nanoseconds spin_time; //!< Spinning time before sleeping in hybrid wait mode
+    std::chrono::steady_clock::time_point completion_seen; //!< When the last wait observed a buffer completed
+    latency_histograms latency;    //!< IRQ-to-user and submit-to-complete latencies
+    bool auto_recovery;            //!< Restart the channel on DMA errors while waiting
+    error_report last_error;       //!< Last DMA error the channel halted on
+    bool skip_to_newest;           //!< Jump to the newest buffer after an overrun in cyclic mode
+    sequence_reader read_sequence; //!< Sequence numbers stamped by the data source, if any
+    uint64_t next_sequence;        //!< Sequence number expected for the next buffer in cyclic mode
+    bool sequence_started;         //!< A sequence number was read already
+    uint64_t pending_skips;        //!< Buffers skipped on purpose, not to be counted in the next sequence gap
 };
 
 #endif // #ifndef _DMA_H
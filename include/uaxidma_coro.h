@@ -0,0 +1,214 @@
+#ifndef _UAXIDMA_CORO_H
+#define _UAXIDMA_CORO_H
+
+#include "uaxidma.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+class coro_executor;
+class coro_channel;
+
+/**
+ * @brief Intrusive node used to queue suspended coroutines without allocating memory
+ */
+struct coro_node
+{
+    std::coroutine_handle<> handle; //!< Coroutine to be resumed
+    coro_node *next;                //!< Next node in the queue
+    void *owner;                    //!< Awaiter the node belongs to, if any
+};
+
+/**
+ * @brief Intrusive FIFO queue of suspended coroutines
+ */
+class coro_queue
+{
+public:
+    bool empty() const { return head_ == nullptr; }
+    void push(coro_node *node);
+    coro_node *pop();
+private:
+    coro_node *head_ = nullptr;
+    coro_node *tail_ = nullptr;
+};
+
+/**
+ * @brief Fire-and-forget coroutine type run by a coro_executor
+ *
+ * A coro_task doesn't start running until handed to coro_executor::spawn(), and its frame is
+ * destroyed as soon as it returns.
+ */
+class coro_task
+{
+public:
+    struct promise_type
+    {
+        coro_task get_return_object() { return coro_task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept;
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        coro_executor *executor = nullptr; //!< Executor running the task
+        coro_node node {};                 //!< Used to schedule the task for the first time
+    };
+
+    coro_task(coro_task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    coro_task(const coro_task&) = delete;
+    coro_task& operator=(const coro_task&) = delete;
+    ~coro_task();
+
+private:
+    friend class coro_executor;
+    explicit coro_task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @brief Single-threaded executor driving coroutines waiting on AXI DMA channels
+ *
+ * Ready coroutines are resumed in FIFO order. When none is ready, the executor sleeps in epoll_wait()
+ * on the interrupt file descriptors of the channels that have waiters.
+ */
+class coro_executor
+{
+public:
+    /**
+     * @brief Awaitable that reschedules the current coroutine behind every other ready coroutine
+     */
+    class yield_awaiter
+    {
+    public:
+        explicit yield_awaiter(coro_executor& ex) : ex_(ex) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const noexcept {}
+    private:
+        coro_executor& ex_;
+        coro_node node_ {};
+    };
+
+    coro_executor();
+    ~coro_executor();
+    coro_executor(const coro_executor&) = delete;
+    coro_executor& operator=(const coro_executor&) = delete;
+
+    /**
+     * @brief Hands a task over to the executor. It will start running on the next call to run().
+     */
+    void spawn(coro_task task);
+
+    /**
+     * @brief Runs the spawned tasks until all of them return
+     * @return false on errors
+     */
+    bool run();
+
+    /**
+     * @brief Lets other ready coroutines run before resuming the current one
+     */
+    yield_awaiter yield() { return yield_awaiter{*this}; }
+
+private:
+    friend class coro_task;
+    friend class coro_channel;
+
+    void schedule(coro_node *node);
+    void set_pending(coro_channel *ch);
+    bool watch(coro_channel *ch);
+    void unwatch(coro_channel *ch);
+    void task_done();
+
+    int epfd_;               //!< epoll instance watching channel interrupt file descriptors
+    coro_queue ready_;       //!< Coroutines ready to be resumed
+    coro_channel *pending_;  //!< Channels whose waiters may be served without waiting for an interrupt
+    std::size_t live_tasks_; //!< Tasks spawned and not returned yet
+};
+
+/**
+ * @brief Awaitable interface over a uaxidma channel
+ *
+ * The uaxidma channel shall be initialized before use, and be driven only through this interface while
+ * the executor is running.
+ */
+class coro_channel
+{
+public:
+    using acquisition_result = uaxidma::acquisition_result;
+    using buffer = uaxidma::buffer;
+
+    /**
+     * @brief Awaitable returned by acquire()
+     */
+    class acquire_awaiter
+    {
+    public:
+        explicit acquire_awaiter(coro_channel& ch) : ch_(ch), result_{acquisition_result::error, nullptr} {}
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> h);
+        std::pair<acquisition_result, buffer*> await_resume() const noexcept { return result_; }
+    private:
+        friend class coro_channel;
+        coro_channel& ch_;
+        std::pair<acquisition_result, buffer*> result_;
+        coro_node node_ {};
+    };
+
+    /**
+     * @brief Awaitable returned by submit()
+     */
+    class submit_awaiter
+    {
+    public:
+        submit_awaiter(coro_channel& ch, buffer& buf) : ch_(ch), buf_(buf) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const noexcept {}
+    private:
+        coro_channel& ch_;
+        buffer& buf_;
+        coro_node node_ {};
+    };
+
+    coro_channel(coro_executor& ex, uaxidma& dma);
+    ~coro_channel();
+    coro_channel(const coro_channel&) = delete;
+    coro_channel& operator=(const coro_channel&) = delete;
+
+    /**
+     * @brief Waits for the next buffer, like uaxidma::get_buffer() with no timeout, without blocking the thread
+     * @return Pair of acquisition_result object representing the success of the operation and pointer to the buffer,
+     *         nullptr on error
+     */
+    acquire_awaiter acquire() { return acquire_awaiter{*this}; }
+
+    /**
+     * @brief Submits a buffer for transmission, then lets other ready coroutines run
+     * @note To be used only when direction has been set to mem_to_dev
+     */
+    submit_awaiter submit(buffer& buf) { return submit_awaiter{*this, buf}; }
+
+    /**
+     * @brief Returns buffer ownership to the DMA library
+     * @note To be used only when direction has been set to dev_to_mem
+     */
+    void release(buffer& buf);
+
+private:
+    friend class coro_executor;
+
+    void dispatch();
+    void on_readable();
+
+    coro_executor& ex_;
+    uaxidma& dma_;
+    coro_queue waiters_;          //!< Coroutines waiting for a buffer, in arrival order
+    coro_channel *next_pending_;  //!< Next channel in the executor's pending list
+    bool pending_;                //!< True if queued in the executor's pending list
+    bool armed_;                  //!< True if the interrupt has been unmasked and not yet consumed
+};
+
+#endif // #ifndef _UAXIDMA_CORO_H
@@ -0,0 +1,121 @@
+#ifndef _UAXIDMA_DISPATCH_H
+#define _UAXIDMA_DISPATCH_H
+
+#include "lockfree_queue.h"
+#include "uaxidma.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fans the buffers received by a dev_to_mem channel out to a pool of worker threads
+ *
+ * A dispatcher thread acquires completed buffers and hands them to the workers over lock-free queues.
+ * Workers give buffers back with release(), from any thread, and the dispatcher thread returns them to
+ * the ring. The uaxidma channel is only ever driven by the dispatcher thread.
+ *
+ * Without a flow function, all workers pull buffers from a single shared queue, and buffers may be
+ * processed in any order. With a flow function, every flow is pinned to one worker, so buffers of the
+ * same flow are processed in the order in which they were received.
+ */
+class uaxidma_dispatcher
+{
+public:
+    using buffer = uaxidma::buffer;
+
+    /**
+     * @brief Processes a buffer on a worker thread. The buffer shall eventually be given back with release().
+     */
+    using handler = std::function<void(buffer& buf, std::size_t worker)>;
+
+    /**
+     * @brief Maps a buffer to the flow it belongs to
+     */
+    using flow_function = std::function<std::size_t(buffer& buf)>;
+
+    /**
+     * @brief Counters describing the dispatcher activity
+     */
+    struct stats
+    {
+        uint64_t dispatched; //!< Buffers handed to the workers
+        uint64_t released;   //!< Buffers returned to the ring
+        uint64_t stalls;     //!< Times the dispatcher had to wait for a full worker queue
+    };
+
+    /**
+     * @brief Creates a dispatcher
+     * @param dma initialized channel, with direction set to dev_to_mem
+     * @param workers number of worker threads
+     * @param process handler run by the workers for each buffer
+     * @param flow optional flow function enabling per-flow ordering
+     * @param queue_depth maximum number of buffers waiting in each worker queue
+     */
+    uaxidma_dispatcher(uaxidma& dma, std::size_t workers, handler process, flow_function flow = {},
+                       std::size_t queue_depth = 256);
+
+    ~uaxidma_dispatcher();
+    uaxidma_dispatcher(const uaxidma_dispatcher&) = delete;
+    uaxidma_dispatcher& operator=(const uaxidma_dispatcher&) = delete;
+
+    /**
+     * @brief Starts the dispatcher and worker threads
+     * @return false if already running
+     */
+    bool start();
+
+    /**
+     * @brief Stops every thread. Buffers not processed yet are returned to the ring.
+     */
+    void stop();
+
+    /**
+     * @brief Returns ownership of a buffer to the DMA library
+     * @note Can be called from any thread
+     */
+    void release(buffer& buf);
+
+    /**
+     * @brief Returns a snapshot of the dispatcher counters
+     */
+    stats get_stats() const;
+
+private:
+    /**
+     * @brief Queue of buffers to be processed, and the means to put idle consumers to sleep
+     */
+    struct work_queue
+    {
+        explicit work_queue(std::size_t depth) : items(depth), signal(0), sleepers(0) {}
+        lockfree_queue<buffer*> items;
+        alignas(64) std::atomic<uint32_t> signal; //!< Bumped on every push, consumers sleep on it
+        std::atomic<uint32_t> sleepers;           //!< Consumers sleeping or about to sleep on signal
+    };
+
+    void dispatch_loop();
+    void worker_loop(std::size_t id);
+    bool push(work_queue& q, buffer *buf);
+    buffer *pop(work_queue& q);
+    void wake(work_queue& q, bool all);
+    void drain_returns();
+
+    uaxidma& dma_;
+    handler process_;
+    flow_function flow_;
+    std::vector<std::unique_ptr<work_queue>> queues_; //!< One per worker with a flow function, a single shared one otherwise
+    lockfree_queue<buffer*> returns_;                 //!< Buffers released by the workers
+    std::vector<std::thread> workers_;
+    std::thread dispatcher_;
+    std::size_t worker_count_;
+    std::atomic<bool> running_;
+    std::atomic<std::size_t> live_workers_;
+    std::atomic<uint64_t> dispatched_;
+    std::atomic<uint64_t> released_;
+    std::atomic<uint64_t> stalls_;
+};
+
+#endif // #ifndef _UAXIDMA_DISPATCH_H
@@ -0,0 +1,88 @@
+#ifndef _UAXIDMA_DUPLEX_H
+#define _UAXIDMA_DUPLEX_H
+
+#include "uaxidma.h"
+#include <memory>
+#include <string>
+#include <utility>
+
+/**
+ * @brief Full-duplex DMA channel driving both the MM2S and S2MM directions of a single AXI DMA
+ *
+ * Both directions share one UIO device mapping, one u-dma-buf buffer split into a TX and a RX region,
+ * a single reset/start sequence and the interrupt line, which is demultiplexed by wait().
+ */
+class uaxidma_duplex
+{
+public:
+    using acquisition_result = uaxidma::acquisition_result;
+    using dma_mode = uaxidma::dma_mode;
+    using irq_coalescing = uaxidma::irq_coalescing;
+    using buffer_alignment = uaxidma::buffer_alignment;
+
+    /**
+     * @brief Directions with at least one buffer ready to be acquired, or directions to wait for
+     */
+    struct readiness
+    {
+        bool tx; //!< A TX buffer can be acquired from tx() without waiting
+        bool rx; //!< A RX buffer can be acquired from rx() without waiting
+    };
+
+    /**
+     * @brief Creates a full-duplex DMA channel.
+     * @param udmabuf_name of the udmabuf buffer to use, see uaxidma::uaxidma()
+     * @param udmabuf_size in bytes of the udmabuf buffer to use, see uaxidma::uaxidma()
+     * @param axidma_uio_name of the UIO device associated to the AXI-DMA. Its interrupt shall be raised by
+     * both the MM2S and S2MM channels.
+     * @param tx_region_size in bytes of the udmabuf buffer used by the TX ring, starting from the udmabuf
+     * buffer base address. It shall be a multiple of 64 bytes. The RX ring uses the rest of the buffer.
+     * @param tx_buffer_size size of each TX buffer in bytes
+     * @param rx_buffer_size size of each RX buffer in bytes
+     * @param rx_mode can be a value of uaxidma::dma_mode
+     * @param coalescing interrupt coalescing settings applied to both directions
+     * @param alignment of the data buffers of both directions, see uaxidma::buffer_alignment
+     */
+    uaxidma_duplex(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& axidma_uio_name,
+                   size_t tx_region_size, size_t tx_buffer_size, size_t rx_buffer_size,
+                   dma_mode rx_mode = dma_mode::normal, const irq_coalescing& coalescing = {1u, 0u, false},
+                   buffer_alignment alignment = buffer_alignment::bus);
+
+    /**
+     * @brief Resets the AXI DMA core once, then initializes and starts both directions
+     * @return false on errors
+     */
+    bool initialize();
+
+    /**
+     * @brief MM2S (mem_to_dev) direction of the channel
+     */
+    uaxidma& tx();
+
+    /**
+     * @brief S2MM (dev_to_mem) direction of the channel
+     */
+    uaxidma& rx();
+
+    /**
+     * @brief Waits until a buffer can be acquired from any of the given directions
+     * Buffers shall then be acquired with a zero timeout. Since both directions share one interrupt, waiting
+     * on tx() and rx() with a non-zero timeout from different threads is not supported.
+     * A TX buffer can be acquired as long as the TX ring isn't full of submitted buffers: waiting for TX only
+     * blocks when it is. Request/response designs shall wait for RX only, so that free TX buffers don't make
+     * this call return right away.
+     * @note The semantics of the timeout parameter is the same as for uaxidma::get_buffer().
+     * @param timeout
+     * @param directions to wait for, only reported as ready when requested
+     * @return Pair of acquisition_result object representing the success of the operation and the directions
+     *         having buffers ready
+     */
+    std::pair<acquisition_result, readiness> wait(int timeout, readiness directions = {true, true});
+
+private:
+    std::shared_ptr<axi_dma::core> core_;
+    uaxidma tx_;
+    uaxidma rx_;
+};
+
+#endif // #ifndef _UAXIDMA_DUPLEX_H
@@ -0,0 +1,156 @@
+#ifndef _UAXIDMA_FORWARDER_H
+#define _UAXIDMA_FORWARDER_H
+
+#include "uaxidma.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Sends the buffers received by a dev_to_mem channel to a connected socket, without copying them
+ *
+ * A forwarder thread acquires completed buffers and sends them in batches straight from the u-dma-buf mapping:
+ * one datagram per buffer with sendmmsg() on datagram sockets, e.g. UDP, and one sendmsg() gathering the whole
+ * batch on stream sockets, e.g. TCP. With MSG_ZEROCOPY, the kernel keeps referencing the buffers after the call
+ * returns, so that each of them is only returned to the ring once the socket error queue reports its
+ * transmission completed, even past stop(). The thread sleeps on the channel interrupt and on the socket with a single poll(),
+ * and the uaxidma channel is only ever driven by it.
+ */
+class uaxidma_forwarder
+{
+public:
+    using buffer = uaxidma::buffer;
+
+    /**
+     * @brief Forwarder settings
+     */
+    struct config
+    {
+        std::size_t batch_size;    //!< Buffers sent per system call at most
+        std::size_t max_in_flight; //!< Buffers held by the forwarder at most, sent or not
+        bool zerocopy;             //!< Send with MSG_ZEROCOPY, if the socket supports it
+    };
+
+    /**
+     * @brief Counters describing the forwarder activity
+     */
+    struct stats
+    {
+        uint64_t buffers;          //!< Buffers sent and returned to the ring
+        uint64_t bytes;            //!< Bytes sent
+        uint64_t send_calls;       //!< sendmmsg() or sendmsg() calls that sent something
+        uint64_t copied_sends;     //!< Zero-copy sends the kernel completed with a copy, e.g. over loopback
+        uint64_t send_errors;      //!< Buffers dropped on send errors
+        uint64_t would_block;      //!< Times the socket couldn't take more data and the forwarder had to wait
+    };
+
+    /**
+     * @brief Creates a forwarder
+     * @param dma initialized channel, with direction set to dev_to_mem. The ring shall hold more buffers than
+     * <em>max_in_flight</em>.
+     * @param socket connected socket, owned by the caller, which shall keep it open until stop() returns.
+     * Datagram sockets shall accept datagrams as large as the buffers.
+     * @param cfg forwarder settings, see @ref config
+     */
+    uaxidma_forwarder(uaxidma& dma, int socket, const config& cfg = {32, 64, true});
+
+    /**
+     * @brief Stops the forwarder, see stop()
+     * @note Buffers still referenced by zero-copy sends are left out of the ring for good: call reclaim() until
+     * it returns 0 beforehand to get them back.
+     */
+    ~uaxidma_forwarder();
+    uaxidma_forwarder(const uaxidma_forwarder&) = delete;
+    uaxidma_forwarder& operator=(const uaxidma_forwarder&) = delete;
+
+    /**
+     * @brief Enables zero-copy sends on the socket if requested, and starts the forwarder thread
+     * @return false if already running or if the socket type can't be read, with errno set
+     */
+    bool start();
+
+    /**
+     * @brief Stops acquiring buffers, sends the ones held and waits for their zero-copy completions
+     * @note Waiting for completions lasts a second at most, e.g. if the peer stopped reading. Buffers whose
+     * completion didn't come by then stay out of the ring, since the kernel may still read them: reclaim()
+     * returns them once it arrives, as does the forwarder thread if started again.
+     */
+    void stop();
+
+    /**
+     * @brief Returns the buffers whose zero-copy completion arrived since stop() to the ring
+     * @note Only to be called while the forwarder is stopped
+     * @return the number of buffers still referenced by zero-copy sends
+     */
+    std::size_t reclaim();
+
+    /**
+     * @brief Returns true if sends go through MSG_ZEROCOPY, valid once started
+     */
+    bool zerocopy() const;
+
+    /**
+     * @brief Returns a snapshot of the forwarder counters
+     */
+    stats get_stats() const;
+
+    /**
+     * @brief Returns the errno of the last failed send or acquisition, 0 if none failed
+     */
+    int get_last_error() const;
+
+private:
+    /**
+     * @brief Buffer acquired and not returned to the ring yet
+     */
+    struct held_buffer
+    {
+        buffer *buf;
+        std::size_t sent;    //!< Bytes sent so far, stream sockets may take part of a buffer
+        uint32_t last_id;    //!< Zero-copy notification id of the last send referencing the buffer
+    };
+
+    void forward_loop();
+    bool send_datagrams();
+    bool send_stream();
+    bool send_failed(int err);
+    uint32_t take_id();
+    void sent(held_buffer& held, uint32_t id);
+    void drop_unsent(int err);
+    void read_notifications();
+    void release_completed();
+    void flush_done();
+
+    uaxidma& dma_;
+    int socket_;
+    config cfg_;
+    bool stream_;
+    bool zerocopy_;
+    std::deque<held_buffer> unsent_;     //!< Acquired buffers waiting to be sent, in stream order
+    std::deque<held_buffer> in_flight_;  //!< Buffers sent, waiting for their zero-copy completion
+    std::deque<bool> completed_ids_;     //!< Completion of the notification ids from completed_upto_ onwards
+    uint32_t next_id_;                   //!< Notification id of the next zero-copy send
+    uint32_t completed_upto_;            //!< Every notification id before it completed
+    std::vector<buffer*> done_;          //!< Buffers to be returned to the ring
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+    bool armed_;                         //!< The channel interrupt is armed
+    short blocked_on_;                   //!< Poll events the socket shall report before sending again, 0 if
+                                         //!< sends aren't blocked
+    std::thread forwarder_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> buffers_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> send_calls_;
+    std::atomic<uint64_t> copied_sends_;
+    std::atomic<uint64_t> send_errors_;
+    std::atomic<uint64_t> would_block_;
+    std::atomic<int> last_error_;
+};
+
+#endif // #ifndef _UAXIDMA_FORWARDER_H
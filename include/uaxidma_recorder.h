@@ -0,0 +1,192 @@
+#ifndef _UAXIDMA_RECORDER_H
+#define _UAXIDMA_RECORDER_H
+
+#include "uaxidma.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @brief Streams the buffers received by a dev_to_mem channel to a file through io_uring, without copying them
+ *
+ * A recorder thread acquires completed buffers and submits their writes straight from the u-dma-buf mapping,
+ * at consecutive file offsets, so that the file holds the received stream. Each buffer is returned to the ring
+ * as soon as its write completes. The thread sleeps on the channel interrupt and on the write completions with
+ * a single io_uring wait, and the uaxidma channel is only ever driven by it.
+ *
+ * With O_DIRECT, writes bypass the page cache, provided buffer addresses, lengths and file offsets are multiples
+ * of the block size, e.g. with page-aligned buffers filled up by the device. Writes that don't meet it go through
+ * the page cache instead: a buffer whose length isn't a multiple of the block size sends every following one
+ * there too, as their offsets aren't aligned anymore.
+ */
+class uaxidma_recorder
+{
+public:
+    using buffer = uaxidma::buffer;
+
+    /**
+     * @brief Recorder settings
+     */
+    struct config
+    {
+        std::size_t queue_depth; //!< Writes in flight at most, i.e. buffers held by the recorder
+        bool direct;             //!< Write with O_DIRECT where possible
+        std::size_t block_size;  //!< Alignment O_DIRECT requires from buffer addresses, lengths and file offsets
+    };
+
+    /**
+     * @brief Counters describing the recorder activity
+     */
+    struct stats
+    {
+        uint64_t buffers;         //!< Buffers written
+        uint64_t bytes;           //!< Bytes written
+        uint64_t buffered_writes; //!< Writes that went through the page cache
+        uint64_t write_errors;    //!< Writes that failed, losing their buffer
+        uint64_t queue_full;      //!< Times the recorder had every write in flight and had to wait for the disk
+    };
+
+    /**
+     * @brief Creates a recorder
+     * @param dma initialized channel, with direction set to dev_to_mem. The ring shall hold more buffers than
+     * the queue depth.
+     * @param path of the file to write. It's created if needed, and truncated.
+     * @param cfg recorder settings, see @ref config
+     */
+    uaxidma_recorder(uaxidma& dma, const std::string& path, const config& cfg = {64, true, 4096});
+
+    ~uaxidma_recorder();
+    uaxidma_recorder(const uaxidma_recorder&) = delete;
+    uaxidma_recorder& operator=(const uaxidma_recorder&) = delete;
+
+    /**
+     * @brief Opens the file and starts the recorder thread
+     * @return false if already running, or if the file or the io_uring instance can't be set up, with errno set
+     */
+    bool start();
+
+    /**
+     * @brief Stops acquiring buffers, waits for the writes in flight and flushes the file to disk
+     */
+    void stop();
+
+    /**
+     * @brief Returns a snapshot of the recorder counters
+     */
+    stats get_stats() const;
+
+    /**
+     * @brief Returns the errno of the last failed write or acquisition, 0 if none failed
+     */
+    int get_last_error() const;
+
+private:
+    /**
+     * @brief Minimal io_uring instance, driven through the raw system calls
+     */
+    class io_ring
+    {
+    public:
+        io_ring() = default;
+        /**
+         * @brief Creates the instance and maps its rings
+         * @return false on errors, with errno set
+         */
+        bool setup(unsigned entries);
+        /**
+         * @brief Destroys the instance, cancelling whatever is still in flight
+         */
+        void teardown();
+        /**
+         * @brief Returns a cleared submission queue entry, queued by the next call to submit()
+         * @return nullptr if the submission queue is full
+         */
+        io_uring_sqe *get_sqe();
+        /**
+         * @brief Submits the queued entries, along with those the kernel didn't consume earlier, and waits for at
+         * least <em>wait_nr</em> completions
+         * @param timeout_ms bounding the wait
+         * @return false on errors other than the timeout expiring or a signal, with errno set
+         */
+        bool submit(unsigned wait_nr, int timeout_ms);
+        /**
+         * @brief Returns the oldest completion not seen yet, nullptr if there's none
+         */
+        io_uring_cqe *peek_cqe();
+        /**
+         * @brief Consumes the completion returned by peek_cqe()
+         */
+        void cqe_seen();
+    private:
+        int fd_ = -1;
+        void *sq_map_ = nullptr;
+        std::size_t sq_map_size_ = 0;
+        void *cq_map_ = nullptr;
+        std::size_t cq_map_size_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        std::size_t sqes_size_ = 0;
+        uint32_t *sq_head_ = nullptr;
+        uint32_t *sq_tail_ = nullptr;
+        uint32_t sq_mask_ = 0;
+        uint32_t sq_entries_ = 0;
+        uint32_t *sq_array_ = nullptr;
+        uint32_t *cq_head_ = nullptr;
+        uint32_t *cq_tail_ = nullptr;
+        uint32_t cq_mask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+        uint32_t to_submit_ = 0;
+    };
+
+    /**
+     * @brief Write of a buffer in flight
+     */
+    struct write_slot
+    {
+        buffer *buf;
+        uint64_t offset;   //!< File offset of the buffer
+        std::size_t done;  //!< Bytes written so far, in case of short writes
+        bool direct;       //!< Written through the O_DIRECT file descriptor
+    };
+
+    void record_loop();
+    void handle_completion(uint64_t tag, int res);
+    io_uring_sqe *get_sqe();
+    void submit_write(buffer& buf);
+    void queue_write(std::size_t slot);
+    void complete_write(std::size_t slot, int res);
+    void arm_interrupt();
+
+    uaxidma& dma_;
+    std::string path_;
+    config cfg_;
+    io_ring ring_;
+    int direct_fd_;
+    bool direct_failed_;                 //!< Direct I/O turned out unsupported, direct_fd_ is closed once idle
+    std::size_t direct_in_flight_;       //!< Writes queued through direct_fd_ and not completed yet
+    int buffered_fd_;
+    uint64_t offset_;                    //!< File offset of the next buffer
+    std::vector<write_slot> slots_;
+    std::vector<std::size_t> free_slots_;
+    std::vector<buffer*> done_;          //!< Buffers whose write completed, to be returned to the ring
+    std::deque<std::pair<uint64_t, int>> reaped_; //!< Completions taken off the ring to make room, tag and
+                                                  //!< result, not handled yet
+    bool polling_;                       //!< A poll on the channel interrupt is in flight
+    std::thread recorder_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> buffers_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> buffered_writes_;
+    std::atomic<uint64_t> write_errors_;
+    std::atomic<uint64_t> queue_full_;
+    std::atomic<int> last_error_;
+};
+
+#endif // #ifndef _UAXIDMA_RECORDER_H
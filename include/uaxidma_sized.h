@@ -0,0 +1,127 @@
+#ifndef _UAXIDMA_SIZED_H
+#define _UAXIDMA_SIZED_H
+
+#include "uaxidma.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Transmit (mem_to_dev) DMA channel whose buffers come in several sizes
+ *
+ * The u-dma-buf buffer is carved into one pool per size class, and descriptors aren't tied to any buffer:
+ * a buffer is attached to the next descriptor of the ring when it's submitted, and goes back to its pool
+ * once the AXI DMA has sent it. Small and large messages can therefore share one channel without sizing
+ * every buffer for the largest message.
+ */
+class uaxidma_sized_tx
+{
+public:
+    using acquisition_result = uaxidma::acquisition_result;
+    using irq_coalescing = uaxidma::irq_coalescing;
+    using buffer_alignment = uaxidma::buffer_alignment;
+
+    /**
+     * @brief Pool of buffers of the same size
+     */
+    struct size_class
+    {
+        size_t buffer_size; //!< Size of each buffer in bytes
+        size_t count;       //!< Number of buffers
+    };
+
+    class buffer
+    {
+    friend class uaxidma_sized_tx;
+    public:
+        /**
+         * @brief Returns the pointer to the beginning of data
+         */
+        uint8_t *data();
+        /**
+         * @brief Returns the number of bytes of data to be sent
+         */
+        size_t length();
+        /**
+         * @brief Returns the size of the buffer
+         */
+        size_t capacity();
+        /**
+         * @brief Sets the number of bytes of data to be sent
+         * @param len new data length
+         * @return false if len exceeds the buffer's capacity
+         */
+        bool set_payload(size_t len);
+    private:
+        buffer(uint8_t *data, uintptr_t phys_addr, size_t max_len, size_t class_index)
+            : data_(data), phys_addr_(phys_addr), length_(0), capacity_(max_len), class_index_(class_index) {}
+        uint8_t *data_;
+        uintptr_t phys_addr_;
+        size_t length_;
+        size_t capacity_;
+        size_t class_index_;
+    };
+
+    /**
+     * @brief Creates a DMA channel.
+     * @param udmabuf_name of the udmabuf buffer to use, see uaxidma::uaxidma()
+     * @param udmabuf_size in bytes of the udmabuf buffer to use, see uaxidma::uaxidma()
+     * @param axidma_uio_name of the UIO device associated to the AXI-DMA, see uaxidma::uaxidma()
+     * @param classes buffer pools to be carved out of the udmabuf buffer. Execution is aborted if they don't fit.
+     * @param coalescing interrupt coalescing settings, see uaxidma::irq_coalescing
+     * @param alignment of every buffer, see uaxidma::buffer_alignment
+     */
+    uaxidma_sized_tx(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& axidma_uio_name,
+                     std::vector<size_class> classes, const irq_coalescing& coalescing = {1u, 0u, false},
+                     buffer_alignment alignment = buffer_alignment::cache_line);
+
+    bool initialize();
+
+    /**
+     * @brief Acquires a free buffer of the smallest size class holding at least <em>size_hint</em> bytes
+     * If every buffer of that class is in use, a buffer from the next larger class with free buffers is
+     * returned instead. If all of them are in flight, the call waits for the oldest transfer to complete.
+     * @note If no class is large enough, the API returns an error and sets errno to EMSGSIZE. If every
+     *       large enough buffer is held by the application, it returns an error and sets errno to EAGAIN.
+     * @param size_hint number of bytes the buffer shall hold
+     * @param timeout with the same semantics as for uaxidma::get_buffer()
+     * @return Pair of acquisition_result object representing the success of the operation and pointer to the buffer,
+     *         nullptr on error
+     */
+    std::pair<acquisition_result, buffer*> get_buffer(size_t size_hint, int timeout);
+
+    /**
+     * @brief Submits a buffer for transmission to the device end-point
+     * Buffers are sent in submission order, regardless of the order in which they were acquired.
+     */
+    void submit_buffer(buffer& buf);
+
+    /**
+     * @brief Returns the size classes, sorted by buffer size
+     */
+    const std::vector<size_class>& get_classes() const;
+
+    /**
+     * @brief Returns the number of free buffers of a size class, as of the last completed transfer seen
+     * @param class_index position of the class in get_classes()
+     */
+    size_t available(size_t class_index) const;
+
+private:
+    void reclaim();
+    acquisition_result wait_for_completion(int timeout);
+
+    axi_dma axidma;
+    std::vector<size_class> classes;            //!< Size classes, sorted by buffer size
+    buffer_alignment alignment;                 //!< Alignment of every buffer
+    std::vector<buffer> buffers;                //!< Every buffer of every class
+    std::vector<std::vector<buffer*>> free_buffers; //!< Free buffers of each class
+    std::vector<buffer*> in_flight;             //!< Buffer attached to each descriptor, indexed by descriptor position
+    size_t oldest;                              //!< Position of the oldest descriptor handed to the hardware
+    size_t next;                                //!< Position of the next descriptor to be submitted
+    size_t pending;                             //!< Descriptors handed to the hardware and not reclaimed yet
+};
+
+#endif // #ifndef _UAXIDMA_SIZED_H
@@ -0,0 +1,126 @@
+#ifndef _UAXIDMA_STATS_H
+#define _UAXIDMA_STATS_H
+
+#include "uaxidma.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Layout of the shared-memory stats page written by uaxidma_stats_exporter
+ *
+ * The page is updated under a sequence lock: <em>sequence</em> is odd while an update is in progress.
+ * Monitoring processes map it read-only once, and then read it without any system call through read().
+ */
+struct uaxidma_stats_page
+{
+    static constexpr uint32_t magic_value = 0x55415844u; //!< "UAXD"
+    static constexpr uint32_t current_version = 4u;
+    static constexpr size_t max_channels = 16;
+    static constexpr size_t name_size = 32;
+
+    /**
+     * @brief Counters of one channel
+     */
+    struct entry
+    {
+        char name[name_size];             //!< Nul-terminated channel name
+        uaxidma::channel_stats stats;     //!< Counters as of the last update
+    };
+
+    /**
+     * @brief Consistent copy of the page contents
+     */
+    struct snapshot
+    {
+        uint64_t sequence;                //!< Number of updates so far, times 2
+        uint64_t updated_ns;              //!< CLOCK_MONOTONIC time of the last update
+        uint32_t channel_count;           //!< Number of valid entries in channels
+        entry channels[max_channels];
+    };
+
+    /**
+     * @brief Copies the page contents, unless an update is in progress or happens meanwhile
+     * @return false if the copy is torn, and shall be retried
+     */
+    bool read(snapshot& out) const;
+
+    uint32_t magic;                       //!< magic_value once the page is initialized
+    uint32_t version;                     //!< Layout version, current_version
+    uint32_t period_ms;                   //!< Update period
+    uint32_t channel_count;               //!< Number of valid entries in channels
+    std::atomic<uint64_t> sequence;       //!< Odd while an update is in progress
+    uint64_t updated_ns;                  //!< CLOCK_MONOTONIC time of the last update
+    entry channels[max_channels];
+};
+
+/**
+ * @brief Periodically copies the counters of a set of channels to a POSIX shared memory page
+ *
+ * An external monitoring process can shm_open() and mmap() the page once, and then poll the counters
+ * without system calls nor any cooperation from the channels.
+ */
+class uaxidma_stats_exporter
+{
+public:
+    /**
+     * @brief Creates the shared memory page
+     * @param shm_name POSIX shared memory object name, e.g. "/uaxidma_stats". It's removed by the destructor.
+     * @param period between updates of the page
+     * @note Execution is aborted if the page can't be created
+     */
+    explicit uaxidma_stats_exporter(const std::string& shm_name,
+                                    std::chrono::milliseconds period = std::chrono::milliseconds(100));
+
+    /**
+     * @brief Stops the updates and removes the shared memory page
+     */
+    ~uaxidma_stats_exporter();
+
+    uaxidma_stats_exporter(const uaxidma_stats_exporter&) = delete;
+    uaxidma_stats_exporter& operator=(const uaxidma_stats_exporter&) = delete;
+
+    /**
+     * @brief Adds a channel to the page
+     * @note Shall be called before start(). The channel shall outlive the exporter.
+     * @return false if the page is full
+     */
+    bool add(const std::string& name, const uaxidma& channel);
+
+    /**
+     * @brief Starts updating the page periodically from a background thread
+     */
+    void start();
+
+    /**
+     * @brief Stops the periodic updates, after a last one
+     */
+    void stop();
+
+    /**
+     * @brief Updates the page right away
+     * @note Can be called from any thread, concurrently with the periodic updates
+     */
+    void publish();
+
+private:
+    void run();
+
+    std::string shm_name_;
+    std::chrono::milliseconds period_;
+    uaxidma_stats_page *page_;
+    std::vector<const uaxidma*> channels_;
+    std::mutex lock_;
+    std::mutex publish_lock_; //!< Serializes the page updates, readers only expect a single writer
+    std::condition_variable wakeup_;
+    bool running_;
+    std::thread updater_;
+};
+
+#endif // #ifndef _UAXIDMA_STATS_H
@@ -0,0 +1,76 @@
+#ifndef _UAXIDMA_TX_H
+#define _UAXIDMA_TX_H
+
+#include "lockfree_queue.h"
+#include "uaxidma.h"
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief Multi-producer front end over a mem_to_dev channel
+ *
+ * Any number of threads may claim TX buffers, fill them concurrently and commit them. Claimed buffers
+ * come from a lock-free free list, and committed ones are queued on a lock-free commit list.
+ * The uaxidma channel is only driven by a single committer at a time: whichever thread finds the committer
+ * role free takes it, submits every queued buffer in commit order, refills the free list, and hands the
+ * role back. Threads finding the role taken never wait for it, since their work is picked up by the
+ * current committer.
+ * Buffers are bound to descriptors when they're submitted rather than when they're claimed, so that a buffer
+ * claimed early and committed late holds back no other buffer.
+ */
+class uaxidma_tx_queue
+{
+public:
+    using acquisition_result = uaxidma::acquisition_result;
+    using buffer = uaxidma::buffer;
+
+    /**
+     * @brief Creates the front end
+     * @param dma initialized channel, with direction set to mem_to_dev. It shall only be driven through
+     * this object from now on.
+     */
+    explicit uaxidma_tx_queue(uaxidma& dma);
+
+    /**
+     * @brief Submits every committed buffer before going away
+     */
+    ~uaxidma_tx_queue();
+
+    uaxidma_tx_queue(const uaxidma_tx_queue&) = delete;
+    uaxidma_tx_queue& operator=(const uaxidma_tx_queue&) = delete;
+
+    /**
+     * @brief Claims a free TX buffer
+     * @note Can be called from any thread
+     * @param timeout with the same semantics as for uaxidma::get_buffer()
+     * @return Pair of acquisition_result object representing the success of the operation and pointer to the buffer,
+     *         nullptr on error
+     */
+    std::pair<acquisition_result, buffer*> claim(int timeout);
+
+    /**
+     * @brief Commits a filled buffer for transmission. Buffers are handed to the AXI DMA in commit order,
+     * whatever the order they were claimed in.
+     * @note Can be called from any thread. The payload length shall be set beforehand with buffer::set_payload().
+     */
+    void commit(buffer& buf);
+
+    /**
+     * @brief Makes sure that every buffer committed so far has been handed to the AXI DMA
+     */
+    void flush();
+
+private:
+    bool try_lock();
+    void unlock();
+    void submit_committed();
+    std::size_t refill(int timeout);
+    void combine();
+
+    uaxidma& dma_;
+    lockfree_queue<buffer*> free_;      //!< Buffers ready to be claimed
+    lockfree_queue<buffer*> committed_; //!< Buffers committed and not submitted yet, in commit order
+    alignas(64) std::atomic<bool> committing_; //!< Held by the thread currently driving the channel
+};
+
+#endif // #ifndef _UAXIDMA_TX_H
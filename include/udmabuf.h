@@ -8,16 +8,72 @@
 class u_dma_buf
 {
     public:
+        /**
+         * @brief Direction of the data transfer a cache maintenance operation is performed for
+         */
+        enum class sync_direction
+        {
+            bidirectional = 0,
+            to_device = 1,
+            from_device = 2
+        };
+
+        /**
+         * @brief Memory standing in for a u-dma-buf buffer, e.g. for an emulated device
+         */
+        struct emulated_area
+        {
+            uintptr_t phys_addr; //!< Address the emulated device uses to reach the memory
+            uint8_t *virt_addr;  //!< Mapping of the memory in this process
+            size_t size;         //!< Size in bytes
+        };
+
         explicit u_dma_buf(const std::string& name, size_t size);
         u_dma_buf() = delete;
+        u_dma_buf(const u_dma_buf&) = delete;
+        u_dma_buf& operator=(const u_dma_buf&) = delete;
+        ~u_dma_buf();
+
+        /**
+         * @brief Hands a byte range over to the CPU after the device wrote or read it
+         * @note No-op if the buffer is coherent or not mapped cacheable
+         * @return false on errors
+         */
+        bool sync_for_cpu(size_t offset, size_t len, sync_direction dir);
+
+        /**
+         * @brief Hands a byte range over to the device after the CPU wrote or read it
+         * @note No-op if the buffer is coherent or not mapped cacheable
+         * @return false on errors
+         */
+        bool sync_for_device(size_t offset, size_t len, sync_direction dir);
+
+        /**
+         * @brief Makes u_dma_buf objects created from now on with the given name use the given memory instead
+         * of the u-dma-buf device. The memory is treated as cache-coherent.
+         * @note The memory shall outlive them, and stay registered until they are destroyed
+         */
+        static void register_emulated(const std::string& name, const emulated_area& area);
+
+        /**
+         * @brief Removes memory registered with register_emulated()
+         */
+        static void unregister_emulated(const std::string& name);
 
         uintptr_t phys_addr;
-        uint8_t *virt_addr;
+        uint8_t *virt_addr;   //!< Mapping for data shared with the device at any time, e.g. descriptors. Uncached if the buffer isn't coherent.
+        uint8_t *cached_addr; //!< Cacheable mapping for data whose ownership is explicitly transferred with sync_for_cpu() and sync_for_device()
         size_t size;
-        
+        bool coherent;        //!< True if the device is cache-coherent, and no cache maintenance is needed
+
     private:
         uint64_t read_property(const std::string& file_path, const std::string& format);
-        void map(const std::string& file);
+        uint8_t *map(const std::string& file, int flags);
+        bool sync(int fd, size_t offset, size_t len, sync_direction dir);
+
+        int sync_for_cpu_fd;    //!< sysfs sync_for_cpu attribute, -1 if cache maintenance isn't needed
+        int sync_for_device_fd; //!< sysfs sync_for_device attribute, -1 if cache maintenance isn't needed
+        bool emulated;          //!< True if the memory was registered with register_emulated(), and isn't ours to unmap
 };
 
-#endif //#ifndef _UDMABUF_H
\ No newline at end of file
+#endif //#ifndef _UDMABUF_H
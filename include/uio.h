@@ -4,6 +4,39 @@
 #include <cstdint>
 #include <string>
 
+/**
+ * @brief Software stand-in for a UIO device, e.g. an emulated peripheral
+ * Once registered with uio_device::register_backend(), uio_device objects created with its name use it
+ * instead of looking for the device in /sys/class/uio.
+ */
+class uio_backend
+{
+public:
+    virtual ~uio_backend() = default;
+
+    /**
+     * @brief Returns the memory standing for the device's register space
+     */
+    virtual uint8_t *registers() = 0;
+
+    /**
+     * @brief Returns a file descriptor that becomes readable when an interrupt is pending
+     */
+    virtual int interrupt_fd() = 0;
+
+    /**
+     * @brief Unmasks or masks the interrupt, like writing 1 or 0 to a UIO device
+     * @return false on errors
+     */
+    virtual bool set_interrupt(bool enabled) = 0;
+
+    /**
+     * @brief Consumes the pending interrupt events
+     * @return false on errors
+     */
+    virtual bool acknowledge_interrupt() = 0;
+};
+
 class uio_device
 {
 public:
@@ -31,6 +64,30 @@ public:
      */
     bool unmap();
 
+    /**
+     * @brief Unmasks or masks the device interrupt
+     * @param enabled true to unmask it
+     * @return false on errors
+     */
+    bool set_interrupt(bool enabled);
+
+    /**
+     * @brief Consumes the pending interrupt events, once fd has been reported readable
+     * @return false on errors
+     */
+    bool acknowledge_interrupt();
+
+    /**
+     * @brief Makes uio_device objects created from now on with the given name use a software backend
+     * @note The backend shall outlive them, and stay registered until they are destroyed
+     */
+    static void register_backend(const std::string &name, uio_backend *backend);
+
+    /**
+     * @brief Removes a backend registered with register_backend()
+     */
+    static void unregister_backend(const std::string &name);
+
     int fd; //!< File descriptor number associated to the device
 
 private:
@@ -43,6 +100,7 @@ private:
 
     int number_; //!< UIO device number as found in /dev/uio<N> and /sys/class/uio/uio<N>
     uint8_t *virt_addr_; //!< Virtual mapping address
+    uio_backend *backend_; //!< Software backend standing in for the device, nullptr for real devices
 };
 
 #endif /* _UIO_H */
@@ -1,4 +1,6 @@
 #include "axi_dma.h"
+#include <algorithm>
+#include <chrono>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -11,20 +13,50 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
 
 static inline constexpr uint32_t lower_32_bits(uintmax_t x) { return x; }
 static inline constexpr uint32_t upper_32_bits(uintmax_t x) { return (x >> 32); }
 static inline constexpr uintmax_t real_address(uintmax_t upper, uintmax_t lower) { return ((upper << 32) | lower); }
 
+/**
+ * @brief Waits for a register condition to become true
+ * A few spins are enough for the hardware, while an emulated core may need its thread to be scheduled first
+ * @return false if it didn't within 100 ms
+ */
+template <typename F>
+static bool wait_for_register(F condition)
+{
+    for (unsigned int spin_count = 128U; spin_count != 0; spin_count--)
+    {
+        if (condition())
+        {
+            return true;
+        }
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (condition())
+        {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+
+    return condition();
+}
+
 /**
  * @brief Mask AXI DMA interrupt file descriptor
  * @return false on errors
  */
 bool axi_dma::mask_interrupt()
 {
-    static constexpr int32_t mask = 0;
-    return (write(device.fd, &mask, sizeof(mask)) != sizeof(mask));
+    return dma_core->device.set_interrupt(false);
 }
 
 /**
@@ -33,23 +65,37 @@ bool axi_dma::mask_interrupt()
  */
 bool axi_dma::unmask_interrupt()
 {
-    static constexpr int32_t unmask = 1;
-    return (write(device.fd, &unmask, sizeof(unmask)) != sizeof(unmask));
+    return dma_core->device.set_interrupt(true);
 }
 
 /**
  * @brief Create a chain of Scatter/Gather descriptors and intialize their structures
+ * @note Data buffers are taken from buffer_areas in order, so a buffer address may jump from one
+ * u-dma-buf buffer to the next
  */
-void axi_dma::create_desc_ring(std::size_t buffer_count)
+void axi_dma::create_desc_ring()
 {
-    sg_desc_chain = {reinterpret_cast<sg_descriptor *>(udmabuf.virt_addr), buffer_count};
+    sg_desc_chain = {reinterpret_cast<sg_descriptor *>(region_virt_addr), layout.buffer_count};
     
-    const uintptr_t &desc_base_phys_addr = udmabuf.phys_addr; // just an alias for clarity
-    uintptr_t next_desc = desc_base_phys_addr + sizeof(sg_descriptor);
-    uintptr_t buf_addr = desc_base_phys_addr + sg_desc_chain.size();
+    const uintptr_t &desc_base_phys_addr = region_phys_addr; // just an alias for clarity
+    uintptr_t desc_addr = desc_base_phys_addr;
+    auto area = buffer_areas.begin();
+    size_t area_index = 0;
+    uintptr_t buf_addr = area->phys_addr;
+    uint8_t *buf_virt_addr = area->virt_addr;
 
     for (auto& d : sg_desc_chain)
     {
+        if (area_index == area->count)
+        {
+            ++area;
+            area_index = 0;
+            buf_addr = area->phys_addr;
+            buf_virt_addr = area->virt_addr;
+        }
+
+        const uintptr_t next_desc = desc_addr + sizeof(sg_descriptor);
+
 #if (__WORDSIZE == 64)
         d.next_desc_msb = upper_32_bits(next_desc);
         d.buf_addr_msb = upper_32_bits(buf_addr);
@@ -61,7 +107,7 @@ void axi_dma::create_desc_ring(std::size_t buffer_count)
         controlf_wrapper control{d.control};
         statusf_wrapper status{d.status};
         
-        control.set_buf_len(buffer_size);
+        control.set_buf_len(layout.buffer_size);
         status.clear_flags(statusf::all);
 
         if (direction == transfer_direction::mm2s)
@@ -70,12 +116,17 @@ void axi_dma::create_desc_ring(std::size_t buffer_count)
             status.set_flags(statusf::complete); // Stall until the PS is ready to transmit
         }
 
-        next_desc += sizeof(sg_descriptor);
-        buf_addr += buffer_size;
+        // Cache the addresses so that hot paths never need to walk the chain
+        sg_desc_chain.set_info(sg_desc_chain.index(d), desc_addr, buf_virt_addr, buf_addr);
+
+        desc_addr = next_desc;
+        buf_addr += layout.buffer_stride;
+        buf_virt_addr += layout.buffer_stride;
+        area_index++;
     }
 
     // Create a ring by pointing the last descriptor back to the first
-    auto& last_desc_ptr = --(sg_desc_chain.end());
+    auto last_desc_ptr = --(sg_desc_chain.end());
 #if (__WORDSIZE == 64)
     last_desc_ptr->next_desc_msb = upper_32_bits(desc_base_phys_addr);
 #endif // #if (__WORDSIZE == 64)
@@ -85,21 +136,171 @@ void axi_dma::create_desc_ring(std::size_t buffer_count)
 /**
  * @brief C'tor
  */
+axi_dma::core::core(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& uio_device_name)
+    : udmabuf{udmabuf_name, udmabuf_size},
+      device{uio_device_name},
+      registers_base(nullptr)
+{
+}
+
+/**
+ * @brief Get the name of the u-dma-buf buffer holding the descriptors, out of a list of names
+ */
+static const std::string& descriptor_udmabuf_name(const std::vector<std::string>& udmabuf_names)
+{
+    if (udmabuf_names.empty())
+    {
+        // Application logic error: a channel needs at least one u-dma-buf buffer
+        abort();
+    }
+
+    return udmabuf_names.front();
+}
+
+/**
+ * @brief C'tor. The first u-dma-buf buffer holds the descriptors, and every buffer, including the first one,
+ * holds data buffers. All of them are used in full.
+ */
+axi_dma::core::core(const std::vector<std::string>& udmabuf_names, const std::string& uio_device_name)
+    : udmabuf{descriptor_udmabuf_name(udmabuf_names), 0},
+      device{uio_device_name},
+      registers_base(nullptr)
+{
+    for (size_t i = 1; i < udmabuf_names.size(); i++)
+    {
+        data_udmabufs.push_back(std::make_unique<u_dma_buf>(udmabuf_names[i], 0));
+    }
+}
+
+/**
+ * @brief Resets the AXI DMA core and releases its register mapping
+ */
+axi_dma::core::~core()
+{
+    if (registers_base)
+    {
+        reset();
+        device.unmap();
+    }
+}
+
+/**
+ * @brief Map the AXI DMA registers table into user space memory, unless already mapped
+ * @return false on errors
+ */
+bool axi_dma::core::map()
+{
+    if (!registers_base)
+    {
+        registers_base = reinterpret_cast<volatile memory_map *>(device.map());
+    }
+
+    return (registers_base != nullptr);
+}
+
+/**
+ * @brief Triggers an AXI DMA core soft reset and blocks until it's completed
+ * @note Both MM2S and S2MM channels are reset
+ * @return false on errors
+ */
+bool axi_dma::core::reset()
+{
+    // Soft-reset the DMA engine
+    // It doesn't really matter whether S2MM or MM2S control register is used,
+    // as the whole AXI DMA will be reset.
+    vdmacontrolf_wrapper control{registers_base->mm2s.control};
+    control.reset();
+
+    if (!wait_for_register([&control]() { return !control.in_reset_state(); }))
+    {
+        return false;
+    }
+
+    // Memory barrier to ensure control register is updated before following operations depending on
+    // AXI DMA being reset are executed
+#ifdef __ARM_ARCH
+    asm volatile("dmb sy");
+#endif
+
+    return true;
+}
+
+/**
+ * @brief C'tor. The channel gets exclusive use of the AXI DMA core and of the whole u-dma-buf buffer.
+ */
 axi_dma::axi_dma(const std::string& udmabuf_name, size_t udmabuf_size,
                  const std::string& uio_device_name, dma_mode mode, transfer_direction direction,
-                 size_t buffer_size)
+                 size_t buffer_size, const irq_coalescing& coalescing, buffer_alignment alignment)
 
-    : udmabuf{udmabuf_name, udmabuf_size},
-      device{uio_device_name},
+    : axi_dma(std::make_shared<core>(udmabuf_name, udmabuf_size, uio_device_name), false, 0, 0,
+              mode, direction, buffer_size, coalescing, alignment)
+{
+}
+
+/**
+ * @brief C'tor. The channel gets exclusive use of the AXI DMA core and of several u-dma-buf buffers: the
+ * descriptors go in the first one, and data buffers fill the rest of it and then the following ones.
+ * @note Lets the ring grow beyond the largest contiguous buffer that can be reserved
+ */
+axi_dma::axi_dma(const std::vector<std::string>& udmabuf_names, const std::string& uio_device_name,
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : axi_dma(std::make_shared<core>(udmabuf_names, uio_device_name), false, 0, 0,
+              mode, direction, buffer_size, coalescing, alignment)
+{
+}
+
+/**
+ * @brief C'tor. The channel shares the AXI DMA core with a channel driving the opposite direction, and
+ * uses <em>region_size</em> bytes of its u-dma-buf buffer starting at <em>region_offset</em>.
+ * @note Resetting the core is left to the owner of the shared core
+ */
+axi_dma::axi_dma(std::shared_ptr<core> shared_core, size_t region_offset, size_t region_size,
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : axi_dma(std::move(shared_core), true, region_offset, region_size, mode, direction, buffer_size, coalescing,
+              alignment)
+{
+}
+
+axi_dma::axi_dma(std::shared_ptr<core> dma_core, bool shared, size_t region_offset, size_t region_size,
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : dma_core(std::move(dma_core)),
+      shared(shared),
       mode(mode),
       direction(direction),
 #ifdef USE_DATA_REALIGNMENT_ENGINE
-      buffer_size(buffer_size)
+      buffer_size(buffer_size),
 #else
     // Ensure buffer address is bus width aligned (AXI-4 bus = 64 bit (8 byte))
-      buffer_size((buffer_size % 8UL) ? (buffer_size + 8UL - buffer_size % 8UL) : buffer_size)
+      buffer_size((buffer_size % 8UL) ? (buffer_size + 8UL - buffer_size % 8UL) : buffer_size),
 #endif
+      registers_base(nullptr),
+      coalescing(coalescing),
+      alignment(alignment),
+      layout{}
 {
+    const u_dma_buf& udmabuf = this->dma_core->udmabuf;
+
+    if (region_size == 0)
+    {
+        region_size = udmabuf.size - region_offset;
+    }
+
+    // Descriptors shall be 16-word aligned, and must fit in the u-dma-buf buffer
+    if ((region_offset % alignof(sg_descriptor)) || (region_offset + region_size > udmabuf.size))
+    {
+        abort();
+    }
+
+    region_phys_addr = udmabuf.phys_addr + region_offset;
+    region_virt_addr = udmabuf.virt_addr + region_offset;
+    region_cached_addr = udmabuf.cached_addr + region_offset;
+    this->region_size = region_size;
 }
 
 /**
@@ -113,61 +314,223 @@ bool axi_dma::initialize()
         abort();
     }
 
+    if (!setup_core())
+    {
+        return false;
+    }
+
+    // Create the descriptor chain
+    // Buffer descriptors are located at the base of the channel's u-dma-buf region physical/virtual memory,
+    // while their associated data buffers are located after the last descriptor, as aligned as requested
+    if (dma_core->data_udmabufs.empty())
+    {
+        layout = plan_layout(region_phys_addr, region_size, buffer_size, alignment);
+
+        const size_t first_buf_offset = layout.descriptors_size + layout.descriptor_padding;
+        buffer_areas = {{region_phys_addr + first_buf_offset, region_cached_addr + first_buf_offset,
+                         layout.buffer_count}};
+    }
+    else
+    {
+        plan_regions();
+    }
+
+    if (layout.buffer_count == 0)
+    {
+        // Application logic error: can't fit a single BD/buffer pair in the udmabuf
+        abort();
+    }
+
+    create_desc_ring();
+
+    buffers = buffer_areas.front().virt_addr;
+
+    return true;
+}
+
+/**
+ * @brief Initialize the AXI DMA instance with a ring of descriptors that don't own any data buffer
+ * Data buffers are carved by the caller out of get_buffer_area(), and attached to descriptors with
+ * prepare_buffer() right before each transfer.
+ * @param descriptor_count number of descriptors in the ring
+ * @return false on errors
+ */
+bool axi_dma::initialize_descriptors(size_t descriptor_count)
+{
+    if (!setup_core())
+    {
+        return false;
+    }
+
+    const size_t align = static_cast<size_t>(alignment);
+    const uintptr_t desc_end = region_phys_addr + descriptor_count * sizeof(sg_descriptor);
+    const size_t area_offset = ((desc_end + align - 1) & ~static_cast<uintptr_t>(align - 1)) - region_phys_addr;
+    if ((descriptor_count == 0) || (area_offset > region_size))
+    {
+        // Application logic error: the descriptors don't fit in the udmabuf
+        abort();
+    }
+
+    layout = {};
+    layout.buffer_count = descriptor_count;
+    layout.descriptors_size = descriptor_count * sizeof(sg_descriptor);
+    layout.descriptor_padding = area_offset - layout.descriptors_size;
+    layout.tail_waste = region_size - area_offset;
+    layout.region_size = region_size;
+
+    // Stride 0: every descriptor starts out pointing at the start of the area
+    buffer_areas = {{region_phys_addr + area_offset, region_cached_addr + area_offset, descriptor_count}};
+    create_desc_ring();
+
+    buffers = region_cached_addr + area_offset;
+
+    return true;
+}
+
+/**
+ * @brief Computes the layout of a ring whose data buffers are spread over several u-dma-buf buffers
+ * Data-only buffers are filled first, and the first u-dma-buf buffer takes as many data buffers as fit
+ * after the descriptors of the whole ring.
+ */
+void axi_dma::plan_regions()
+{
+    const size_t align = static_cast<size_t>(alignment);
+    const auto align_up = [align](uintptr_t v) { return (v + align - 1) & ~static_cast<uintptr_t>(align - 1); };
+
+    layout = {};
+    layout.buffer_size = buffer_size;
+    layout.buffer_stride = align_up(buffer_size);
+
+    std::vector<buffer_area> data_areas;
+    size_t data_count = 0;
+    for (const auto& udmabuf : dma_core->data_udmabufs)
+    {
+        const size_t first_buf_offset = align_up(udmabuf->phys_addr) - udmabuf->phys_addr;
+        const size_t count = (udmabuf->size > first_buf_offset)
+                             ? (udmabuf->size - first_buf_offset) / layout.buffer_stride : 0;
+        if (count != 0)
+        {
+            data_areas.push_back({udmabuf->phys_addr + first_buf_offset, udmabuf->cached_addr + first_buf_offset, count});
+        }
+
+        data_count += count;
+        layout.tail_waste += udmabuf->size - std::min(udmabuf->size, first_buf_offset + count * layout.buffer_stride);
+        layout.region_size += udmabuf->size;
+    }
+
+    // Offset of the first buffer when n descriptors precede it
+    const auto first_buf_offset = [&](size_t n) { return align_up(region_phys_addr + n * sizeof(sg_descriptor)) - region_phys_addr; };
+
+    // Data buffers following the descriptors: upper bound ignoring the descriptor padding, then shrink
+    // until the padding fits as well
+    const size_t data_descriptors_size = data_count * sizeof(sg_descriptor);
+    size_t count = (region_size > data_descriptors_size)
+                   ? (region_size - data_descriptors_size) / (sizeof(sg_descriptor) + layout.buffer_stride) : 0;
+    while ((count != 0) && (first_buf_offset(data_count + count) + count * layout.buffer_stride > region_size))
+    {
+        count--;
+    }
+
+    const size_t total = data_count + count;
+    if ((total == 0) || (first_buf_offset(total) > region_size))
+    {
+        // Not even the descriptors fit: reported as an empty ring
+        layout.buffer_count = 0;
+        return;
+    }
+
+    layout.buffer_count = total;
+    layout.descriptors_size = total * sizeof(sg_descriptor);
+    layout.descriptor_padding = first_buf_offset(total) - layout.descriptors_size;
+    layout.buffer_padding = total * (layout.buffer_stride - buffer_size);
+    layout.tail_waste += region_size - first_buf_offset(total) - count * layout.buffer_stride;
+    layout.region_size += region_size;
+
+    buffer_areas.clear();
+    if (count != 0)
+    {
+        buffer_areas.push_back({region_phys_addr + first_buf_offset(total),
+                                region_cached_addr + first_buf_offset(total), count});
+    }
+    buffer_areas.insert(buffer_areas.end(), data_areas.begin(), data_areas.end());
+}
+
+/**
+ * @brief Get the u-dma-buf buffer a data buffer belongs to
+ */
+u_dma_buf& axi_dma::udmabuf_of(uintptr_t buf_phys_addr)
+{
+    for (const auto& udmabuf : dma_core->data_udmabufs)
+    {
+        if ((buf_phys_addr >= udmabuf->phys_addr) && (buf_phys_addr < udmabuf->phys_addr + udmabuf->size))
+        {
+            return *udmabuf;
+        }
+    }
+
+    return dma_core->udmabuf;
+}
+
+/**
+ * @brief Validates the settings, maps the AXI DMA registers and checks the core configuration
+ * @return false on errors
+ */
+bool axi_dma::setup_core()
+{
+    if ((coalescing.threshold == 0) || (coalescing.threshold > max_irq_threshold)
+        || (coalescing.delay > max_irq_delay) || (coalescing.adaptive && (coalescing.delay == 0)))
+    {
+        abort();
+    }
+
     // Initialize poll structure to monitor interrupts
-    fds.fd = device.fd;
+    fds.fd = dma_core->device.fd;
     fds.events = POLLIN;
 
     // Map AXI DMA peripheral to virtual address space
-    registers_base = reinterpret_cast<volatile memory_map *>(device.map());
-    if (!registers_base)
+    if (!dma_core->map())
     {
         return false;
     }
+    registers_base = dma_core->registers_base;
 
     volatile sg_registers& registers = (direction == transfer_direction::mm2s)
                                         ? registers_base->mm2s : registers_base->s2mm;
 
     // Ensure that the Scatter Gather Engine is included and the AXI DMA is configured for Scatter Gather mode
     vdmastatusf_wrapper status{registers.status};
-    if (status.check_flags(dmastatusf::sg_incld))
+    if (!status.check_flags(dmastatusf::sg_incld))
     {
         return false;
     }
 
-    // Create the descriptor chain
-    // Buffer descriptors are located at the base of the u-dma-buf device's physical/virtual memory,
-    // while their associated data buffers are located immediately after the last descriptor
-    std::size_t buffer_count = (udmabuf.size / (buffer_size + sizeof(sg_descriptor)));
-    if (buffer_count == 0)
-    {
-        // Application logic error: can't fit a single BD/buffer pair in the udmabuf
-        abort();
-    }
-
-    create_desc_ring(buffer_count);
-
-    buffers = udmabuf.virt_addr + sg_desc_chain.size();
-
     return true;
 }
 
 /**
  * @brief Deinitialize an AXI DMA instance
+ * @note Exclusive channels reset the whole core when it's released. Channels sharing the core only
+ * stop their own direction, so that the opposite one is left untouched.
  */
 axi_dma::~axi_dma()
 {
-    reset();
-    device.unmap();
+    if (shared && registers_base)
+    {
+        stop();
+    }
 }
 
 /**
  * @brief Prepares the AXI DMA to start in Scatter/Gather mode with IOC interrupt enabled
+ * @param first position in the ring of the first descriptor to be processed
+ * @param count number of descriptors handed to the hardware right away, starting at <em>first</em>
  * @return false on errors
  */
-bool axi_dma::start_normal()
+bool axi_dma::start_normal(size_t first, size_t count)
 {
-    // Just in case, let's start from a known state
-    if (!reset())
+    // Just in case, let's start from a known state. Shared cores are reset once by their owner
+    // before starting any of its channels.
+    if (!shared && !reset())
     {
         return false;
     }
@@ -175,50 +538,60 @@ bool axi_dma::start_normal()
     volatile sg_registers& registers = (direction == transfer_direction::mm2s)
                                         ? registers_base->mm2s : registers_base->s2mm;
 
-    // Prepare control word for starting the DMA channel and generating one interrupt for each BD
-    // completed Note that non-cyclic operation will be configured: the DMA will stall when all
-    // buffer descriptors are complete
+    // Prepare control word for starting the DMA channel and generating one interrupt every
+    // <threshold> BDs completed. Note that non-cyclic operation will be configured: the DMA will
+    // stall when all buffer descriptors are complete
     vdmacontrolf_wrapper control{registers.control};
-    control.enable_irqs(dma_irqs::on_complete | dma_irqs::error);
-    control.set_irq_threshold(1u);
+    control.enable_irqs(enabled_irqs());
+    control.set_irq_threshold(coalescing.threshold);
+    control.set_irq_delay(coalescing.delay);
 
     // Set current descriptor pointer to the first descriptor
-    const uintptr_t &first_desc = udmabuf.phys_addr;
+    const uintptr_t first_desc = sg_desc_chain.info(first).desc_phys_addr;
 
 #if (__WORDSIZE == 64)
-    registers.current_desc_high, upper_32_bits(first_desc);
+    registers.current_desc_high = upper_32_bits(first_desc);
 #endif // #if (__WORDSIZE == 64)
 
-    registers.current_desc_low, lower_32_bits(first_desc);
+    registers.current_desc_low = lower_32_bits(first_desc);
 
     // Start AXI DMA but don't set the tail descriptor yet
     control.run();
 
+    if (count != 0)
+    {
+        ring_doorbell(sg_desc_chain[(first + count - 1) % sg_desc_chain.size()]);
+    }
+
     return true;
 }
 
 /**
  * @brief Starts the AXI DMA in cyclic mode with IOC interrupt enabled
+ * @param first position in the ring of the first descriptor to be processed
  * @return false on errors
  */
-bool axi_dma::start_cyclic()
+bool axi_dma::start_cyclic(size_t first)
 {
-    // Just in case, let's start from a known state
-    if (!reset())
+    // Just in case, let's start from a known state. Shared cores are reset once by their owner
+    // before starting any of its channels.
+    if (!shared && !reset())
     {
         return false;
     }
 
     volatile sg_registers& registers = registers_base->s2mm;
 
-    // Prepare control word for starting the cyclic DMA channel and generating one interrupt for each BD completed
+    // Prepare control word for starting the cyclic DMA channel and generating one interrupt every
+    // <threshold> BDs completed
     vdmacontrolf_wrapper control{registers.control};
     control.enable_cyclic_mode();
-    control.enable_irqs(dma_irqs::on_complete | dma_irqs::error);
-    control.set_irq_threshold(1u);
+    control.enable_irqs(enabled_irqs());
+    control.set_irq_threshold(coalescing.threshold);
+    control.set_irq_delay(coalescing.delay);
 
     // Set current descriptor pointer to the first descriptor
-    const uintptr_t &first_desc = udmabuf.phys_addr;
+    const uintptr_t first_desc = sg_desc_chain.info(first).desc_phys_addr;
 
 #if (__WORDSIZE == 64)
     registers.current_desc_high = upper_32_bits(first_desc);
@@ -262,14 +635,25 @@ bool axi_dma::start()
     switch (mode)
     {
         case dma_mode::cyclic:
-            return start_cyclic();
+            return start_cyclic(0);
         case dma_mode::normal:
-            return start_normal();
+            // Receive buffers are all available from the start: TX ones are only handed to the hardware when submitted
+            return start_normal(0, (direction == transfer_direction::s2mm) ? sg_desc_chain.size() : 0);
         default:
             abort();
     }
 }
 
+/**
+ * @brief Get the set of interrupts to be enabled according to the coalescing settings
+ */
+axi_dma::dma_irqs axi_dma::enabled_irqs() const
+{
+    // The delay timer only makes sense if it has been given a timeout
+    return (coalescing.delay != 0) ? (dma_irqs::on_complete | dma_irqs::delay | dma_irqs::error)
+                                   : (dma_irqs::on_complete | dma_irqs::error);
+}
+
 /**
  * @brief Stops the ongoing AXI DMA operation
  * @return false on errors
@@ -283,14 +667,10 @@ bool axi_dma::stop()
     vdmacontrolf_wrapper control{registers.control};
     control.stop();
 
-    unsigned int spin_count = 128U;
     vdmastatusf_wrapper status{registers.status};
-    while (!status.check_flags(dmastatusf::halted))
+    if (!wait_for_register([&status]() { return status.check_flags(dmastatusf::halted); }))
     {
-        if (--spin_count == 0)
-        {
-            return false;
-        }
+        return false;
     }
 
     // Memory barrier to ensure control register is updated before following operations depending on
@@ -308,32 +688,151 @@ bool axi_dma::stop()
  */
 bool axi_dma::reset()
 {
-    // Soft-reset the DMA engine
-    // It doesn't really matter whether S2MM or MM2S control register is used,
-    // as the whole AXI DMA will be reset.
-    vdmacontrolf_wrapper control{registers_base->mm2s.control};
-    control.reset();
+    return dma_core->reset();
+}
 
-    unsigned int spin_count = 128U;
-    while (control.in_reset_state())
+/**
+ * @brief Get the DMA status register of the channel
+ */
+uint32_t axi_dma::get_dma_status() const
+{
+    volatile sg_registers& registers = (direction == transfer_direction::mm2s)
+                                        ? registers_base->mm2s : registers_base->s2mm;
+
+    return static_cast<uint32_t>(registers.status);
+}
+
+/**
+ * @brief Get the error flags of the DMA status register of the channel, see dma_error
+ * @return 0 if the channel didn't halt on an error
+ */
+uint32_t axi_dma::get_dma_errors() const
+{
+    return get_dma_status() & static_cast<uint32_t>(dmastatusf::all_errors);
+}
+
+/**
+ * @brief Get the position in the ring of the descriptor the channel is working on, from the current
+ * descriptor register
+ */
+size_t axi_dma::get_current_desc_index() const
+{
+    volatile sg_registers& registers = (direction == transfer_direction::mm2s)
+                                        ? registers_base->mm2s : registers_base->s2mm;
+
+    uintptr_t current_desc = registers.current_desc_low;
+#if (__WORDSIZE == 64)
+    current_desc |= static_cast<uintptr_t>(registers.current_desc_high) << 32;
+#endif // #if (__WORDSIZE == 64)
+
+    // Descriptors are laid out back to back
+    return ((current_desc - sg_desc_chain.info(0).desc_phys_addr) / sizeof(sg_descriptor)) % sg_desc_chain.size();
+}
+
+/**
+ * @brief Restarts a channel halted on a DMA error without tearing the ring down
+ * The core is reset, the descriptors that were handed to the hardware and not completed are rebuilt, and the
+ * channel is restarted from the first of them. Every other descriptor, and the buffers the application holds,
+ * are left untouched.
+ * @param first position in the ring of the first descriptor not completed
+ * @param count number of descriptors handed to the hardware and not completed, starting at <em>first</em>
+ * @note Only channels with exclusive use of the core can recover, as the reset halts both directions
+ * @return false on errors
+ */
+bool axi_dma::recover(size_t first, size_t count)
+{
+    if (shared)
     {
-        if (--spin_count == 0)
+        return false;
+    }
+
+    // The threshold may have been adapted at runtime
+    const uint32_t thresh = get_irq_threshold();
+
+    const size_t ring_size = sg_desc_chain.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t idx = (first + i) % ring_size;
+        sg_descriptor& d = sg_desc_chain[idx];
+        const sg_descriptor_info& info = sg_desc_chain.info(idx);
+        const uintptr_t next_desc = sg_desc_chain.info((idx + 1) % ring_size).desc_phys_addr;
+
+#if (__WORDSIZE == 64)
+        d.next_desc_msb = upper_32_bits(next_desc);
+#endif // #if (__WORDSIZE == 64)
+        d.next_desc = lower_32_bits(next_desc);
+
+        statusf_wrapper status{d.status};
+        status.clear_flags(statusf::all);
+
+        // TX descriptors keep the length, packet boundaries and buffer they were submitted with
+        if (direction == transfer_direction::s2mm)
         {
-            return false;
+#if (__WORDSIZE == 64)
+            d.buf_addr_msb = upper_32_bits(info.buf_phys_addr);
+#endif // #if (__WORDSIZE == 64)
+            d.buf_addr = lower_32_bits(info.buf_phys_addr);
+
+            controlf_wrapper control{d.control};
+            control.set_buf_len(layout.buffer_size);
         }
     }
 
-    // Memory barrier to ensure control register is updated before following operations depending on
-    // AXI DMA being reset are executed
-#ifdef __ARM_ARCH
-    asm volatile("dmb sy");
-#endif
+    const bool started = (mode == dma_mode::cyclic) ? start_cyclic(first) : start_normal(first, count);
+    if (started)
+    {
+        set_irq_threshold(thresh);
+    }
 
-    return true;
+    return started;
+}
+
+/**
+ * @brief Spells out the error flags of the DMA status register and of a descriptor
+ */
+std::string axi_dma::describe_errors(uint32_t dma_status, uint32_t desc_errors)
+{
+    static const std::pair<dma_error, const char *> dmasr_names[] = {
+        {dma_error::dma_internal, "DMAIntErr"}, {dma_error::dma_slave, "DMASlvErr"},
+        {dma_error::dma_decode, "DMADecErr"}, {dma_error::sg_internal, "SGIntErr"},
+        {dma_error::sg_slave, "SGSlvErr"}, {dma_error::sg_decode, "SGDecErr"}
+    };
+    static const std::pair<statusf, const char *> desc_names[] = {
+        {statusf::dma_int_err, "desc:DMAIntErr"}, {statusf::dma_slv_err, "desc:DMASlvErr"},
+        {statusf::dma_dec_err, "desc:DMADecErr"}
+    };
+
+    std::string text;
+    const auto append = [&text](const char *name) {
+        text += text.empty() ? "" : ", ";
+        text += name;
+    };
+
+    for (const auto& [flag, name] : dmasr_names)
+    {
+        if (dma_status & static_cast<uint32_t>(flag))
+        {
+            append(name);
+        }
+    }
+    for (const auto& [flag, name] : desc_names)
+    {
+        if (desc_errors & static_cast<uint32_t>(flag))
+        {
+            append(name);
+        }
+    }
+
+    return text;
 }
 
 /**
- * @brief Clears AXI DMA's interrupt flags from the DMASR register
+ * @brief Clears AXI DMA's completion interrupt flags from the DMASR register
+ * @note When the core is shared, both directions raise the same interrupt: the flags of both DMASR
+ * registers are cleared, otherwise the interrupt line would stay asserted. Completions are still
+ * tracked per direction through the descriptors.
+ * @note The error interrupt flag is left pending: it keeps waking up waiters until the channel is recovered,
+ * which resets it, so that an error can't go unnoticed.
  */
 void axi_dma::clean_interrupt()
 {
@@ -341,7 +840,16 @@ void axi_dma::clean_interrupt()
                                         ? registers_base->mm2s : registers_base->s2mm;
 
     vdmastatusf_wrapper status{registers.status};
-    status.clear_irqs(dma_irqs::on_complete | dma_irqs::error);
+    status.clear_irqs(dma_irqs::on_complete | dma_irqs::delay);
+
+    if (shared)
+    {
+        volatile sg_registers& opposite = (direction == transfer_direction::mm2s)
+                                           ? registers_base->s2mm : registers_base->mm2s;
+
+        vdmastatusf_wrapper opposite_status{opposite.status};
+        opposite_status.clear_irqs(dma_irqs::on_complete | dma_irqs::delay);
+    }
 
     // Memory barrier to ensure IRQs are cleared before following operations assuming a clean slate
 #ifdef __ARM_ARCH
@@ -366,6 +874,7 @@ axi_dma::acquisition_result axi_dma::poll_interrupt(int timeout)
             case EINTR:
             case EAGAIN:
                 // Try again, let's pretend no time has elapsed
+                channel_counters::add(counters.poll_retries, uint64_t{1});
                 return poll_interrupt(timeout);
             default:
                 return ret;
@@ -374,15 +883,11 @@ axi_dma::acquisition_result axi_dma::poll_interrupt(int timeout)
     
     if (ret == acquisition_result::success)
     {
-        // Blocking wait for a DMA interrupt - this should return immediately as we are only polling one fd
-        int32_t n_interrupts;
-        if (read(device.fd, &n_interrupts, sizeof(n_interrupts))
-            != sizeof(n_interrupts))
-        {
-            ret = acquisition_result::error;
-        }
+        return acknowledge_interrupt();
     }
 
+    channel_counters::add(counters.poll_timeouts, uint64_t{1});
+
     // Avoid speculatively doing any work before the interrupt returns
 #ifdef __ARM_ARCH
     asm volatile("dmb sy");
@@ -391,27 +896,127 @@ axi_dma::acquisition_result axi_dma::poll_interrupt(int timeout)
     return ret;
 }
 
+/**
+ * @brief Consumes a pending interrupt event from the UIO device
+ * @note Meant to be called once the interrupt file descriptor has been reported readable
+ * @return success if the interrupt was consumed, error otherwise
+ */
+axi_dma::acquisition_result axi_dma::acknowledge_interrupt()
+{
+    acquisition_result ret = acquisition_result::success;
+
+    // Blocking wait for a DMA interrupt - this should return immediately as the fd is readable
+    if (!dma_core->device.acknowledge_interrupt())
+    {
+        ret = acquisition_result::error;
+    }
+    else
+    {
+        channel_counters::add(counters.interrupts, uint64_t{1});
+    }
+
+    // Avoid speculatively doing any work before the interrupt returns
+#ifdef __ARM_ARCH
+    asm volatile("dmb sy");
+#endif
+
+    return ret;
+}
+
+/**
+ * @brief Get a consistent enough copy of the counters: each one is read atomically, not all of them at once
+ */
+axi_dma::channel_stats axi_dma::channel_counters::snapshot() const
+{
+    return {packets.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed),
+            interrupts.load(std::memory_order_relaxed), poll_timeouts.load(std::memory_order_relaxed),
+            poll_retries.load(std::memory_order_relaxed), blocked_ns.load(std::memory_order_relaxed),
+            ring_high_water.load(std::memory_order_relaxed), desc_errors.load(std::memory_order_relaxed),
+            recoveries.load(std::memory_order_relaxed), overruns.load(std::memory_order_relaxed),
+            lost_buffers.load(std::memory_order_relaxed), skipped_buffers.load(std::memory_order_relaxed),
+            sync_errors.load(std::memory_order_relaxed), desc_error_bits.load(std::memory_order_relaxed)};
+}
+
+/**
+ * @brief Get the file descriptor that becomes readable when the AXI DMA raises an interrupt
+ */
+int axi_dma::get_interrupt_fd() const
+{
+    return dma_core->device.fd;
+}
+
 /**
  * @brief Starts the AXI DMA transfer of the specified buffer descriptor
  * @param desc Buffer descriptor
  * @param len Transfer length
  */
 void axi_dma::transfer_buffer(sg_descriptor &desc, size_t len)
+{
+    prepare_buffer(desc, len);
+    ring_doorbell(desc);
+}
+
+/**
+ * @brief Attaches a data buffer to the specified buffer descriptor and prepares it for transmission
+ * without notifying the AXI DMA
+ * @param desc Buffer descriptor
+ * @param buf_phys_addr Physical address of the data buffer
+ * @param len Transfer length
+ * @param sof true if the buffer holds the start of an AXI stream packet
+ * @param eof true if the buffer holds the end of an AXI stream packet
+ * @note The descriptor won't be processed until ring_doorbell() is called with it or a later descriptor
+ */
+void axi_dma::prepare_buffer(sg_descriptor &desc, uintptr_t buf_phys_addr, size_t len, bool sof, bool eof)
+{
+#if (__WORDSIZE == 64)
+    desc.buf_addr_msb = upper_32_bits(buf_phys_addr);
+#endif // #if (__WORDSIZE == 64)
+    desc.buf_addr = lower_32_bits(buf_phys_addr);
+
+    prepare_buffer(desc, len, sof, eof);
+}
+
+/**
+ * @brief Prepares the specified buffer descriptor for transmission without notifying the AXI DMA
+ * @param desc Buffer descriptor
+ * @param len Transfer length
+ * @param sof true if the buffer holds the start of an AXI stream packet
+ * @param eof true if the buffer holds the end of an AXI stream packet
+ * @note The descriptor won't be processed until ring_doorbell() is called with it or a later descriptor
+ */
+void axi_dma::prepare_buffer(sg_descriptor &desc, size_t len, bool sof, bool eof)
 {
     controlf_wrapper control{desc.control};
-    control.set_flags(controlf::sof | controlf::eof);
+    control.clear_flags(controlf::sof | controlf::eof);
+    if (sof)
+    {
+        control.set_flags(controlf::sof);
+    }
+    if (eof)
+    {
+        control.set_flags(controlf::eof);
+    }
     control.set_buf_len(len);
 
     statusf_wrapper status{desc.status};
     status.clear_flags(statusf::complete | statusf::dma_errors);
+}
+
+/**
+ * @brief Lets the AXI DMA process every prepared descriptor up to the specified one
+ * @param tail Last buffer descriptor to be processed. In S2MM normal mode, the last descriptor handed back
+ * to the hardware.
+ */
+void axi_dma::ring_doorbell(sg_descriptor &tail)
+{
+    volatile sg_registers& registers = (direction == transfer_direction::mm2s)
+                                        ? registers_base->mm2s : registers_base->s2mm;
 
-    // Update tail descriptor to point to the current buffer descriptor
-    ptrdiff_t desc_offset = sg_desc_chain.offset(sg_descriptor_chain::iterator{&desc});
-    const uintptr_t &desc_base_phys_addr = udmabuf.phys_addr; // just an alias for clarity
-    const uintptr_t tail_desc = desc_base_phys_addr + sizeof(sg_descriptor) * desc_offset;
+    // Update tail descriptor to point to the last prepared buffer descriptor
+    const uintptr_t tail_desc = sg_desc_chain.info(tail).desc_phys_addr;
 
 #if (__WORDSIZE == 64)
-    registers_base->mm2s.tail_desc_high = upper_32_bits(tail_desc);
+    registers.tail_desc_high = upper_32_bits(tail_desc);
 #endif // #if (__WORDSIZE == 64)
 
     // Memory barrier to ensure tail descriptor is not set before buffers and sg_desc_chain have been written in memory
@@ -419,7 +1024,7 @@ void axi_dma::transfer_buffer(sg_descriptor &desc, size_t len)
     asm volatile("dmb st");
 #endif
 
-    registers_base->mm2s.tail_desc_low = lower_32_bits(tail_desc);
+    registers.tail_desc_low = lower_32_bits(tail_desc);
 }
 
 /**
@@ -438,5 +1043,182 @@ size_t axi_dma::get_buffer_size() const
  */
 uint8_t *axi_dma::get_virt_buffer_pointer(sg_descriptor &desc) const
 {
-    return buffers + sg_desc_chain.offset(sg_descriptor_chain::iterator{desc}) * buffer_size;
+    return sg_desc_chain.info(desc).buf_virt_addr;
+}
+
+/**
+ * @brief Exchanges the data buffers attached to two buffer descriptors
+ * @note Only for descriptors the AXI DMA doesn't own, i.e. not handed over by ring_doorbell() yet
+ */
+void axi_dma::swap_buffers(sg_descriptor &a, sg_descriptor &b)
+{
+    const size_t idx_a = sg_desc_chain.index(a);
+    const size_t idx_b = sg_desc_chain.index(b);
+    const sg_descriptor_info info_a = sg_desc_chain.info(idx_a);
+    const sg_descriptor_info info_b = sg_desc_chain.info(idx_b);
+    sg_desc_chain.set_info(idx_a, info_a.desc_phys_addr, info_b.buf_virt_addr, info_b.buf_phys_addr);
+    sg_desc_chain.set_info(idx_b, info_b.desc_phys_addr, info_a.buf_virt_addr, info_a.buf_phys_addr);
+
+    std::swap(a.buf_addr, b.buf_addr);
+#if (__WORDSIZE == 64)
+    std::swap(a.buf_addr_msb, b.buf_addr_msb);
+#endif // #if (__WORDSIZE == 64)
+}
+
+/**
+ * @brief Tells whether a descriptor's data buffer is mapped uncached, or write-combined, i.e. its u-dma-buf buffer
+ * isn't cache-coherent and offers no explicit cache maintenance
+ */
+bool axi_dma::is_buffer_uncached(sg_descriptor &desc)
+{
+    const u_dma_buf& udmabuf = udmabuf_of(sg_desc_chain.info(desc).buf_phys_addr);
+    return !udmabuf.coherent && (udmabuf.cached_addr == udmabuf.virt_addr);
+}
+
+/**
+ * @brief Hands the first len bytes of a descriptor's data buffer over to the CPU
+ * @note Only needed, and only performed, if the u-dma-buf buffer isn't cache-coherent
+ * @return false on errors, which are also counted in the channel stats
+ */
+bool axi_dma::sync_for_cpu(sg_descriptor &desc, size_t len)
+{
+    const uintptr_t buf_phys_addr = sg_desc_chain.info(desc).buf_phys_addr;
+    u_dma_buf& udmabuf = udmabuf_of(buf_phys_addr);
+    const auto dir = (direction == transfer_direction::mm2s) ? u_dma_buf::sync_direction::to_device
+                                                              : u_dma_buf::sync_direction::from_device;
+    if (!udmabuf.sync_for_cpu(buf_phys_addr - udmabuf.phys_addr, len, dir))
+    {
+        channel_counters::add(counters.sync_errors, uint64_t{1});
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Hands the first len bytes of a descriptor's data buffer over to the AXI DMA
+ * @note Only needed, and only performed, if the u-dma-buf buffer isn't cache-coherent
+ * @return false on errors, which are also counted in the channel stats
+ */
+bool axi_dma::sync_for_device(sg_descriptor &desc, size_t len)
+{
+    return sync_for_device(sg_desc_chain.info(desc).buf_phys_addr, len);
+}
+
+/**
+ * @brief Hands the first len bytes of the data buffer at the specified physical address over to the AXI DMA
+ * @note Only needed, and only performed, if the u-dma-buf buffer isn't cache-coherent
+ * @return false on errors, which are also counted in the channel stats
+ */
+bool axi_dma::sync_for_device(uintptr_t buf_phys_addr, size_t len)
+{
+    u_dma_buf& udmabuf = udmabuf_of(buf_phys_addr);
+    const auto dir = (direction == transfer_direction::mm2s) ? u_dma_buf::sync_direction::to_device
+                                                              : u_dma_buf::sync_direction::from_device;
+    if (!udmabuf.sync_for_device(buf_phys_addr - udmabuf.phys_addr, len, dir))
+    {
+        channel_counters::add(counters.sync_errors, uint64_t{1});
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Get the part of the channel's u-dma-buf region left for data buffers after the descriptors
+ */
+axi_dma::memory_area axi_dma::get_buffer_area() const
+{
+    const size_t offset = layout.descriptors_size + layout.descriptor_padding;
+    return {region_phys_addr + offset, region_cached_addr + offset, region_size - offset};
+}
+
+/**
+ * @brief Computes the placement of descriptors and data buffers in a region
+ * @note The region base is expected to be at least 64-byte aligned, like the descriptors
+ */
+axi_dma::layout_report axi_dma::plan_layout(uintptr_t region_phys_addr, size_t region_size, size_t buffer_size,
+                                            buffer_alignment alignment)
+{
+    const size_t align = static_cast<size_t>(alignment);
+    const auto align_up = [align](uintptr_t v) { return (v + align - 1) & ~static_cast<uintptr_t>(align - 1); };
+
+    layout_report report {};
+    report.buffer_size = buffer_size;
+    report.buffer_stride = align_up(buffer_size);
+    report.region_size = region_size;
+
+    if (buffer_size == 0)
+    {
+        return report;
+    }
+
+    // Offset of the first buffer when n descriptors precede it
+    const auto first_buf_offset = [&](size_t n) { return align_up(region_phys_addr + n * sizeof(sg_descriptor)) - region_phys_addr; };
+
+    // Upper bound ignoring the descriptor padding, then shrink until the padding fits as well
+    size_t count = region_size / (sizeof(sg_descriptor) + report.buffer_stride);
+    while ((count != 0) && (first_buf_offset(count) + count * report.buffer_stride > region_size))
+    {
+        count--;
+    }
+
+    if (count == 0)
+    {
+        return report;
+    }
+
+    report.buffer_count = count;
+    report.descriptors_size = count * sizeof(sg_descriptor);
+    report.descriptor_padding = first_buf_offset(count) - report.descriptors_size;
+    report.buffer_padding = count * (report.buffer_stride - buffer_size);
+    report.tail_waste = region_size - first_buf_offset(count) - count * report.buffer_stride;
+
+    return report;
+}
+
+/**
+ * @brief Get the placement of descriptors and data buffers, as computed by initialize()
+ */
+const axi_dma::layout_report& axi_dma::get_layout() const
+{
+    return layout;
+}
+
+/**
+ * @brief Get the interrupt coalescing settings the channel was created with
+ */
+const axi_dma::irq_coalescing& axi_dma::get_irq_coalescing() const
+{
+    return coalescing;
+}
+
+/**
+ * @brief Get the interrupt threshold currently programmed in the DMA control register
+ * @return number of completed descriptors per interrupt
+ */
+uint32_t axi_dma::get_irq_threshold() const
+{
+    volatile sg_registers& registers = (direction == transfer_direction::mm2s)
+                                        ? registers_base->mm2s : registers_base->s2mm;
+
+    vdmacontrolf_wrapper control{registers.control};
+    return control.get_irq_threshold();
+}
+
+/**
+ * @brief Reprogram the interrupt threshold while the channel is running
+ * @param thresh number of completed descriptors per interrupt, clamped to [1, max_irq_threshold]
+ */
+void axi_dma::set_irq_threshold(uint32_t thresh)
+{
+    volatile sg_registers& registers = (direction == transfer_direction::mm2s)
+                                        ? registers_base->mm2s : registers_base->s2mm;
+
+    thresh = (thresh == 0) ? 1u : ((thresh > max_irq_threshold) ? max_irq_threshold : thresh);
+
+    vdmacontrolf_wrapper control{registers.control};
+    control.set_irq_threshold(thresh);
+
+#ifdef __ARM_ARCH
+    asm volatile("dmb st");
+#endif
 }
@@ -0,0 +1,494 @@
+#include "axi_dma_sim.h"
+#include "sg_descriptor.h"
+#include "udmabuf.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static constexpr uintptr_t sim_phys_base = 0x10000000UL;
+static constexpr size_t sim_phys_align = 2UL << 20;
+static constexpr size_t register_space_size = 4096;
+
+// Register map, as described in the AXI DMA product guide
+static constexpr size_t mm2s_regs = 0x00;
+static constexpr size_t s2mm_regs = 0x30;
+static constexpr size_t control_reg = 0x00;
+static constexpr size_t status_reg = 0x04;
+static constexpr size_t current_desc_reg = 0x08;
+static constexpr size_t tail_desc_reg = 0x10;
+
+// Control register
+static constexpr uint32_t control_rs = 1u << 0;
+static constexpr uint32_t control_reset = 1u << 2;
+static constexpr uint32_t control_cyclic_bd_en = 1u << 4;
+static constexpr uint32_t control_irq_en = 0x7u << 12;
+
+// Status register
+static constexpr uint32_t status_halted = 1u << 0;
+static constexpr uint32_t status_idle = 1u << 1;
+static constexpr uint32_t status_sg_incld = 1u << 3;
+static constexpr uint32_t status_dma_slv_err = 1u << 5;
+static constexpr uint32_t status_dma_dec_err = 1u << 6;
+static constexpr uint32_t status_sg_dec_err = 1u << 10;
+static constexpr uint32_t status_ioc_irq = 1u << 12;
+static constexpr uint32_t status_dly_irq = 1u << 13;
+static constexpr uint32_t status_err_irq = 1u << 14;
+static constexpr uint32_t status_irqs = status_ioc_irq | status_dly_irq | status_err_irq;
+
+// Period of the interrupt delay timer
+static constexpr std::chrono::nanoseconds delay_tick {1000};
+
+static inline constexpr uintmax_t real_address(uintmax_t upper, uintmax_t lower) { return ((upper << 32) | lower); }
+
+static std::mutex sim_udmabufs_lock;
+static std::map<uintptr_t, sim_udmabuf *> sim_udmabufs; //!< Live buffers, by physical address
+static uintptr_t next_phys_addr = sim_phys_base;
+
+sim_udmabuf::sim_udmabuf(const std::string& name, size_t size)
+    : name(name), size(size)
+{
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if ((size == 0) || (addr == MAP_FAILED))
+    {
+        abort();
+    }
+    virt_addr = static_cast<uint8_t *>(addr);
+
+    {
+        std::lock_guard<std::mutex> guard(sim_udmabufs_lock);
+        phys_addr = next_phys_addr;
+        next_phys_addr += (size + sim_phys_align - 1) & ~(sim_phys_align - 1);
+        sim_udmabufs.emplace(phys_addr, this);
+    }
+
+    u_dma_buf::register_emulated(name, {phys_addr, virt_addr, size});
+}
+
+sim_udmabuf::~sim_udmabuf()
+{
+    u_dma_buf::unregister_emulated(name);
+
+    {
+        std::lock_guard<std::mutex> guard(sim_udmabufs_lock);
+        sim_udmabufs.erase(phys_addr);
+    }
+
+    munmap(virt_addr, size);
+}
+
+uint8_t *sim_udmabuf::translate(uintptr_t phys_addr, size_t len)
+{
+    std::lock_guard<std::mutex> guard(sim_udmabufs_lock);
+
+    auto it = sim_udmabufs.upper_bound(phys_addr);
+    if (it == sim_udmabufs.begin())
+    {
+        return nullptr;
+    }
+    --it;
+
+    const sim_udmabuf& buf = *it->second;
+    if ((phys_addr - buf.phys_addr > buf.size) || (len > buf.size - (phys_addr - buf.phys_addr)))
+    {
+        return nullptr;
+    }
+
+    return buf.virt_addr + (phys_addr - buf.phys_addr);
+}
+
+sim_axi_dma::sim_axi_dma(const std::string& name, const settings& config)
+    : name_(name),
+      config_(config),
+      channels_{},
+      inject_error_{},
+      irq_enabled_(false),
+      quit_(false),
+      mm2s_packets_(0),
+      mm2s_bytes_(0),
+      s2mm_packets_(0),
+      s2mm_bytes_(0),
+      interrupts_(0)
+{
+    void *addr = mmap(nullptr, register_space_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    event_fd_ = eventfd(0, EFD_CLOEXEC);
+    if ((addr == MAP_FAILED) || (event_fd_ < 0))
+    {
+        abort();
+    }
+    registers_ = static_cast<uint8_t *>(addr);
+
+    channels_[0].regs = mm2s_regs;
+    channels_[0].s2mm = false;
+    channels_[1].regs = s2mm_regs;
+    channels_[1].s2mm = true;
+    reset_core();
+
+    engine_ = std::thread(&sim_axi_dma::run, this);
+    uio_device::register_backend(name_, this);
+}
+
+sim_axi_dma::~sim_axi_dma()
+{
+    uio_device::unregister_backend(name_);
+
+    quit_ = true;
+    engine_.join();
+
+    close(event_fd_);
+    munmap(registers_, register_space_size);
+}
+
+sim_axi_dma::stats sim_axi_dma::get_stats() const
+{
+    return {mm2s_packets_.load(std::memory_order_relaxed), mm2s_bytes_.load(std::memory_order_relaxed),
+            s2mm_packets_.load(std::memory_order_relaxed), s2mm_bytes_.load(std::memory_order_relaxed),
+            interrupts_.load(std::memory_order_relaxed)};
+}
+
+void sim_axi_dma::inject_slave_error(bool s2mm)
+{
+    inject_error_[s2mm ? 1 : 0].store(true, std::memory_order_release);
+}
+
+uint8_t *sim_axi_dma::registers()
+{
+    return registers_;
+}
+
+int sim_axi_dma::interrupt_fd()
+{
+    return event_fd_;
+}
+
+bool sim_axi_dma::set_interrupt(bool enabled)
+{
+    irq_enabled_.store(enabled, std::memory_order_seq_cst);
+    return true;
+}
+
+bool sim_axi_dma::acknowledge_interrupt()
+{
+    uint64_t n_interrupts;
+    return (read(event_fd_, &n_interrupts, sizeof(n_interrupts)) == sizeof(n_interrupts));
+}
+
+/**
+ * @brief Engine thread: spins while there's work, and backs off progressively when idle
+ */
+void sim_axi_dma::run()
+{
+    unsigned int idle_loops = 0;
+
+    while (!quit_.load(std::memory_order_relaxed))
+    {
+        bool busy = false;
+
+        if (reg(mm2s_regs + control_reg).load(std::memory_order_acquire) & control_reset)
+        {
+            reset_core();
+            busy = true;
+        }
+
+        for (auto& ch : channels_)
+        {
+            busy |= step(ch);
+        }
+        raise_interrupt();
+
+        if (busy)
+        {
+            idle_loops = 0;
+        }
+        else if (++idle_loops > 4096)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+        else if (idle_loops > 256)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @brief Brings both channels back to their power-on state, then clears the reset bit
+ */
+void sim_axi_dma::reset_core()
+{
+    for (auto& ch : channels_)
+    {
+        const size_t regs = ch.regs;
+        const bool s2mm = ch.s2mm;
+        ch = {};
+        ch.regs = regs;
+        ch.s2mm = s2mm;
+        ch.status = status_halted | status_sg_incld;
+
+        for (size_t offset : {current_desc_reg, current_desc_reg + 4, tail_desc_reg, tail_desc_reg + 4})
+        {
+            reg(regs + offset).store(0, std::memory_order_relaxed);
+        }
+        reg(regs + status_reg).store(ch.status, std::memory_order_relaxed);
+        reg(regs + control_reg).store(0, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Follows up on register writes and processes at most one descriptor of a channel
+ * @return true if something was done
+ */
+bool sim_axi_dma::step(channel& ch)
+{
+    // Pick up interrupt acknowledgments
+    update_status(ch, 0, 0);
+
+    const uint32_t control = reg(ch.regs + control_reg).load(std::memory_order_acquire);
+    const auto now = std::chrono::steady_clock::now();
+
+    if (!(control & control_rs))
+    {
+        if (ch.running)
+        {
+            ch.running = false;
+            update_status(ch, status_halted, status_idle);
+            return true;
+        }
+        return false;
+    }
+
+    if (!ch.running)
+    {
+        ch.running = true;
+        ch.current = reg_address(ch.regs + current_desc_reg);
+        ch.tail = 0;
+        ch.doorbell = false;
+        ch.completions = 0;
+        ch.next_packet = now;
+        update_status(ch, 0, status_halted | status_idle);
+    }
+
+    // The halt on errors lasts until the next reset
+    if (ch.status & status_halted)
+    {
+        return false;
+    }
+
+    const bool cyclic = (control & control_cyclic_bd_en);
+    if (!cyclic)
+    {
+        const uintptr_t tail = take_tail(ch);
+        if (tail != 0)
+        {
+            ch.tail = tail;
+            ch.doorbell = true;
+        }
+    }
+
+    // Delay timer: signals completions that didn't reach the threshold
+    const uint32_t delay = (control >> 24) & 0xffu;
+    if ((delay != 0) && (ch.completions != 0) && (now - ch.last_completion >= delay * delay_tick))
+    {
+        ch.completions = 0;
+        update_status(ch, status_dly_irq, 0);
+    }
+
+    const bool ready = cyclic || ch.doorbell;
+    if (!ready || ((config_.packets_per_second != 0) && (now < ch.next_packet)))
+    {
+        return false;
+    }
+
+    process(ch, control, cyclic);
+
+    if (config_.packets_per_second != 0)
+    {
+        const auto period = std::chrono::nanoseconds(1000000000ULL / config_.packets_per_second);
+        // Don't try to catch up after long pauses, e.g. while the channel was stalled
+        ch.next_packet = std::max(ch.next_packet + period, now - std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Performs the transfer described by the current descriptor and moves on to the next one
+ */
+void sim_axi_dma::process(channel& ch, uint32_t control, bool cyclic)
+{
+    auto *desc = reinterpret_cast<sg_descriptor *>(sim_udmabuf::translate(ch.current, sizeof(sg_descriptor)));
+    if (!desc)
+    {
+        fail(ch, status_sg_dec_err);
+        return;
+    }
+
+    const uint32_t desc_control = static_cast<uint32_t>(desc->control);
+    const size_t len = desc_control & static_cast<uint32_t>(controlf::buf_len);
+    const uintptr_t buf_phys_addr = real_address(desc->buf_addr_msb, desc->buf_addr);
+    uint8_t *buf = sim_udmabuf::translate(buf_phys_addr, len);
+
+    std::atomic_ref<uint32_t> desc_status{desc->status};
+    if (!buf)
+    {
+        desc_status.store(static_cast<uint32_t>(statusf::dma_dec_err), std::memory_order_release);
+        fail(ch, status_dma_dec_err);
+        return;
+    }
+
+    if (inject_error_[ch.s2mm ? 1 : 0].exchange(false, std::memory_order_acq_rel))
+    {
+        desc_status.store(static_cast<uint32_t>(statusf::dma_slv_err), std::memory_order_release);
+        fail(ch, status_dma_slv_err);
+        return;
+    }
+
+    size_t transferred = len;
+    uint32_t status = static_cast<uint32_t>(statusf::complete);
+    if (ch.s2mm)
+    {
+        if (config_.packet_length != 0)
+        {
+            transferred = std::min(len, config_.packet_length);
+        }
+        memcpy(buf, &ch.sequence, std::min(sizeof(ch.sequence), transferred));
+        ch.sequence++;
+        status |= static_cast<uint32_t>(statusf::rxsof) | static_cast<uint32_t>(statusf::rxeof);
+
+        s2mm_packets_.fetch_add(1, std::memory_order_relaxed);
+        s2mm_bytes_.fetch_add(transferred, std::memory_order_relaxed);
+    }
+    else
+    {
+        mm2s_packets_.fetch_add(1, std::memory_order_relaxed);
+        mm2s_bytes_.fetch_add(transferred, std::memory_order_relaxed);
+    }
+
+    // The data is visible before the descriptor reports it
+    desc_status.store(status | static_cast<uint32_t>(transferred), std::memory_order_release);
+
+    const uint32_t threshold = std::max((control >> 16) & 0xffu, 1u);
+    ch.last_completion = std::chrono::steady_clock::now();
+    if (++ch.completions >= threshold)
+    {
+        ch.completions = 0;
+        update_status(ch, status_ioc_irq, 0);
+    }
+
+    const uintptr_t processed = ch.current;
+    ch.current = real_address(desc->next_desc_msb, desc->next_desc);
+
+    // The current descriptor register follows the channel through the ring, and stays on the tail once the
+    // channel goes idle there, as the hardware's does
+    const bool idle = !cyclic && (processed == ch.tail);
+    const uintptr_t shown = idle ? processed : ch.current;
+    reg(ch.regs + current_desc_reg + 4).store(static_cast<uint32_t>(static_cast<uintmax_t>(shown) >> 32),
+                                              std::memory_order_relaxed);
+    reg(ch.regs + current_desc_reg).store(static_cast<uint32_t>(shown), std::memory_order_relaxed);
+
+    if (idle)
+    {
+        ch.doorbell = false;
+        update_status(ch, status_idle, 0);
+    }
+    else
+    {
+        update_status(ch, 0, status_idle);
+    }
+}
+
+/**
+ * @brief Halts a channel on a transfer error, as the hardware does
+ */
+void sim_axi_dma::fail(channel& ch, uint32_t errors)
+{
+    update_status(ch, errors | status_err_irq | status_halted, status_idle);
+}
+
+/**
+ * @brief Publishes changes to the status register of a channel
+ * The driver clears interrupt flags by writing 1 to them. Such writes are told apart from our own
+ * by comparing the register with the value last published, and applied before publishing.
+ */
+void sim_axi_dma::update_status(channel& ch, uint32_t set, uint32_t clear)
+{
+    std::atomic_ref<uint32_t> status = reg(ch.regs + status_reg);
+    uint32_t seen = status.load(std::memory_order_acquire);
+
+    while (true)
+    {
+        if (seen != ch.status)
+        {
+            ch.status &= ~(seen & status_irqs);
+        }
+
+        const uint32_t next = (ch.status & ~clear) | set;
+        if (next == seen)
+        {
+            ch.status = next;
+            return;
+        }
+        if (status.compare_exchange_weak(seen, next, std::memory_order_acq_rel))
+        {
+            ch.status = next;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Raises the interrupt if it's unmasked and any enabled interrupt flag is set
+ */
+void sim_axi_dma::raise_interrupt()
+{
+    bool asserted = false;
+    for (const auto& ch : channels_)
+    {
+        const uint32_t control = reg(ch.regs + control_reg).load(std::memory_order_relaxed);
+        asserted |= ((ch.status & control & control_irq_en) != 0);
+    }
+
+    if (asserted && irq_enabled_.exchange(false, std::memory_order_seq_cst))
+    {
+        const uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) == sizeof(one))
+        {
+            interrupts_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::atomic_ref<uint32_t> sim_axi_dma::reg(size_t offset)
+{
+    return std::atomic_ref<uint32_t>{*reinterpret_cast<uint32_t *>(registers_ + offset)};
+}
+
+/**
+ * @brief Consumes the tail descriptor pointer written since the last call
+ * The lower register is cleared as it's read, so that writing the same tail twice, e.g. when the whole ring is
+ * handed back, still rings the doorbell. Physical address 0 is never handed out.
+ * @return 0 if the tail wasn't written
+ */
+uintptr_t sim_axi_dma::take_tail(channel& ch)
+{
+    const uint32_t lower = reg(ch.regs + tail_desc_reg).exchange(0, std::memory_order_acq_rel);
+    if (lower == 0)
+    {
+        return 0;
+    }
+    return real_address(reg(ch.regs + tail_desc_reg + 4).load(std::memory_order_acquire), lower);
+}
+
+/**
+ * @brief Reads a pair of address registers, lower 32 bits first
+ */
+uintptr_t sim_axi_dma::reg_address(size_t offset)
+{
+    const uint32_t lower = reg(offset).load(std::memory_order_acquire);
+    const uint32_t upper = reg(offset + 4).load(std::memory_order_acquire);
+    return real_address(upper, lower);
+}
@@ -0,0 +1,395 @@
+#include "dma_copy.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using copy_fn = void (*)(void *dst, const void *src, std::size_t len);
+
+/**
+ * @brief Returns how many bytes to copy before <em>p</em> gets aligned to <em>align</em>
+ */
+static inline std::size_t head_length(const void *p, std::size_t align, std::size_t len)
+{
+    return std::min(len, (align - reinterpret_cast<uintptr_t>(p) % align) % align);
+}
+
+static void copy_generic(void *dst, const void *src, std::size_t len)
+{
+    memcpy(dst, src, len);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+static void to_device_sse2(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(d, 16, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 32));
+        const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d), a);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d + 48), e);
+    }
+    for (; len >= 16; len -= 16, d += 16, s += 16)
+    {
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d), _mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+    }
+    memcpy(d, s, len);
+
+    // Non-temporal stores are weakly ordered: drain them before the device is told about the data
+    _mm_sfence();
+}
+
+__attribute__((target("sse2")))
+static void from_device_sse2(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(s, 16, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        const __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(s));
+        const __m128i b = _mm_load_si128(reinterpret_cast<const __m128i *>(s + 16));
+        const __m128i c = _mm_load_si128(reinterpret_cast<const __m128i *>(s + 32));
+        const __m128i e = _mm_load_si128(reinterpret_cast<const __m128i *>(s + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 16), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 32), c);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 48), e);
+    }
+    memcpy(d, s, len);
+}
+
+/**
+ * @brief Streaming loads only bypass the cache hierarchy on write-combining memory, and behave as regular loads
+ * elsewhere
+ */
+__attribute__((target("sse4.1")))
+static void from_device_sse41(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(s, 16, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(const_cast<uint8_t *>(s));
+        const __m128i a = _mm_stream_load_si128(p);
+        const __m128i b = _mm_stream_load_si128(p + 1);
+        const __m128i c = _mm_stream_load_si128(p + 2);
+        const __m128i e = _mm_stream_load_si128(p + 3);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 16), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 32), c);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 48), e);
+    }
+    memcpy(d, s, len);
+}
+
+__attribute__((target("avx2")))
+static void to_device_avx2(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(d, 32, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 128; len -= 128, d += 128, s += 128)
+    {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 32));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 64));
+        const __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d + 96), e);
+    }
+    for (; len >= 32; len -= 32, d += 32, s += 32)
+    {
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s)));
+    }
+    memcpy(d, s, len);
+
+    _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static void from_device_avx2(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(s, 32, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 128; len -= 128, d += 128, s += 128)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(const_cast<uint8_t *>(s));
+        const __m256i a = _mm256_stream_load_si256(p);
+        const __m256i b = _mm256_stream_load_si256(p + 1);
+        const __m256i c = _mm256_stream_load_si256(p + 2);
+        const __m256i e = _mm256_stream_load_si256(p + 3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 32), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 64), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 96), e);
+    }
+    memcpy(d, s, len);
+}
+
+#elif defined(__aarch64__)
+
+static void to_device_neon(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(d, 16, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        asm volatile("ldp q0, q1, [%[s]]\n"
+                     "ldp q2, q3, [%[s], #32]\n"
+                     "stnp q0, q1, [%[d]]\n"
+                     "stnp q2, q3, [%[d], #32]\n"
+                     :
+                     : [d] "r"(d), [s] "r"(s)
+                     : "v0", "v1", "v2", "v3", "memory");
+    }
+    memcpy(d, s, len);
+}
+
+static void from_device_neon(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+
+    const std::size_t head = head_length(s, 16, len);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        asm volatile("ldnp q0, q1, [%[s]]\n"
+                     "ldnp q2, q3, [%[s], #32]\n"
+                     "stp q0, q1, [%[d]]\n"
+                     "stp q2, q3, [%[d], #32]\n"
+                     :
+                     : [d] "r"(d), [s] "r"(s)
+                     : "v0", "v1", "v2", "v3", "memory");
+    }
+    memcpy(d, s, len);
+}
+
+#elif defined(__ARM_NEON)
+
+/**
+ * @brief 32-bit ARM has no non-temporal hint: full 16-byte accesses are what's left to make of the mapping
+ */
+static void copy_neon(uint8_t *d, const uint8_t *s, std::size_t len)
+{
+    for (; len >= 64; len -= 64, d += 64, s += 64)
+    {
+        const uint8x16_t a = vld1q_u8(s);
+        const uint8x16_t b = vld1q_u8(s + 16);
+        const uint8x16_t c = vld1q_u8(s + 32);
+        const uint8x16_t e = vld1q_u8(s + 48);
+        vst1q_u8(d, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+    }
+    memcpy(d, s, len);
+}
+
+static void to_device_neon(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+    const std::size_t head = head_length(d, 16, len);
+    memcpy(d, s, head);
+    copy_neon(d + head, s + head, len - head);
+}
+
+static void from_device_neon(void *dst, const void *src, std::size_t len)
+{
+    uint8_t *d = static_cast<uint8_t *>(dst);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+    const std::size_t head = head_length(s, 16, len);
+    memcpy(d, s, head);
+    copy_neon(d + head, s + head, len - head);
+}
+
+#endif
+
+/**
+ * @brief Kernel built for the target architecture
+ */
+struct kernel_entry
+{
+    dma_copy::kernel id;
+    copy_fn to_device;
+    copy_fn from_device;
+};
+
+static constexpr kernel_entry kernels[] = {
+    {dma_copy::kernel::generic, copy_generic, copy_generic},
+#if defined(__x86_64__) || defined(__i386__)
+    {dma_copy::kernel::sse2, to_device_sse2, from_device_sse2},
+    {dma_copy::kernel::sse41, to_device_sse2, from_device_sse41},
+    {dma_copy::kernel::avx2, to_device_avx2, from_device_avx2},
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    {dma_copy::kernel::neon, to_device_neon, from_device_neon},
+#endif
+};
+
+static const kernel_entry *entry_of(dma_copy::kernel k)
+{
+    for (const auto& entry : kernels)
+    {
+        if (entry.id == k)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Picks the last kernel of the table the CPU supports, i.e. the fastest one
+ */
+static const kernel_entry *detect()
+{
+    const kernel_entry *best = &kernels[0];
+    for (const auto& entry : kernels)
+    {
+        best = dma_copy::supported(entry.id) ? &entry : best;
+    }
+    return best;
+}
+
+/**
+ * @brief Kernel in use, detected on first use so that copies made by static constructors work too
+ */
+static std::atomic<const kernel_entry *>& active_entry()
+{
+    static std::atomic<const kernel_entry *> entry { detect() };
+    return entry;
+}
+
+void dma_copy::to_device(void *dst, const void *src, std::size_t len)
+{
+    active_entry().load(std::memory_order_relaxed)->to_device(dst, src, len);
+}
+
+void dma_copy::from_device(void *dst, const void *src, std::size_t len)
+{
+    active_entry().load(std::memory_order_relaxed)->from_device(dst, src, len);
+}
+
+dma_copy::kernel dma_copy::active()
+{
+    return active_entry().load(std::memory_order_relaxed)->id;
+}
+
+bool dma_copy::supported(kernel k)
+{
+    if (entry_of(k) == nullptr)
+    {
+        return false;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+#endif
+
+    switch (k)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+    case kernel::sse2:
+        return __builtin_cpu_supports("sse2");
+    case kernel::sse41:
+        return __builtin_cpu_supports("sse4.1");
+    case kernel::avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        // NEON is part of the target when it's built in
+        return true;
+    }
+}
+
+bool dma_copy::select(kernel k)
+{
+    if (!supported(k))
+    {
+        return false;
+    }
+
+    active_entry().store(entry_of(k), std::memory_order_relaxed);
+    return true;
+}
+
+const char *dma_copy::name(kernel k)
+{
+    switch (k)
+    {
+    case kernel::generic:
+        return "generic";
+    case kernel::sse2:
+        return "sse2";
+    case kernel::sse41:
+        return "sse4.1";
+    case kernel::avx2:
+        return "avx2";
+    case kernel::neon:
+        return "neon";
+    }
+    return "unknown";
+}
@@ -29,6 +29,16 @@ void sg_descriptor_handle::clear_complete_flag()
 #endif
 }
 
+/**
+ * @brief Clear the complete flag without ordering the store against later ones
+ * @note The caller is responsible for issuing a store barrier once a batch of descriptors has been updated
+ */
+void sg_descriptor_handle::clear_complete_flag_unordered()
+{
+    statusf_wrapper status{d.status};
+    status.clear_flags(statusf::complete);
+}
+
 /**
  * @brief Get the amount of data transferred by the buffer described by a descriptor
  * @return length in bytes
@@ -44,6 +54,36 @@ size_t sg_descriptor_handle::get_buffer_len() const
     return len;
 }
 
+/**
+ * @brief Check whether the descriptor holds the first stream beat of a packet
+ * @note Only meaningful for completed S2MM descriptors
+ */
+bool sg_descriptor_handle::start_of_frame() const
+{
+    cstatusf_wrapper status{d.status};
+    return status.check_flags(statusf::rxsof);
+}
+
+/**
+ * @brief Check whether the descriptor holds the last stream beat of a packet
+ * @note Only meaningful for completed S2MM descriptors
+ */
+bool sg_descriptor_handle::end_of_frame() const
+{
+    cstatusf_wrapper status{d.status};
+    return status.check_flags(statusf::rxeof);
+}
+
+/**
+ * @brief Get the DMA error flags reported by the descriptor
+ * @return statusf::dma_errors bits, 0 if the transfer succeeded
+ */
+uint32_t sg_descriptor_handle::errors() const
+{
+    cstatusf_wrapper status{d.status};
+    return status.get_errors();
+}
+
 sg_descriptor_chain::iterator::iterator(sg_descriptor *ptr)
     : p_(ptr)
 {
@@ -153,7 +193,7 @@ sg_descriptor_chain::iterator operator+ (int lhs, sg_descriptor_chain::iterator
 }
 
 sg_descriptor_chain::sg_descriptor_chain(sg_descriptor *ptr, std::size_t sz)
-    : head_(ptr), size_(sz * sizeof(sg_descriptor))
+    : head_(ptr), size_(sz), info_(sz)
 {
 }
 
@@ -167,11 +207,23 @@ const sg_descriptor& sg_descriptor_chain::operator[](std::size_t idx) const
     return head_[idx];
 }
 
+/**
+ * @brief Get the number of descriptors in the chain
+ */
 std::size_t sg_descriptor_chain::size() const
 {
     return size_;
 }
 
+/**
+ * @brief Get the amount of memory occupied by the descriptors in the chain
+ * @return length in bytes
+ */
+std::size_t sg_descriptor_chain::length() const
+{
+    return size_ * sizeof(sg_descriptor);
+}
+
 sg_descriptor_chain::iterator sg_descriptor_chain::begin()
 {
     return iterator(head_);
@@ -204,10 +256,38 @@ const sg_descriptor_chain::iterator sg_descriptor_chain::next(const iterator& it
 
 std::size_t sg_descriptor_chain::offset(const iterator& some) const
 {
-    std::size_t hops = 0;
-    for (auto it = begin(); it != some; it++)
-    {
-        hops++; 
-    }
-    return hops;
+    return static_cast<std::size_t>(some - begin());
+}
+
+/**
+ * @brief Get the position of a descriptor belonging to this chain in constant time
+ */
+std::size_t sg_descriptor_chain::index(const sg_descriptor& desc) const
+{
+    return static_cast<std::size_t>(&desc - head_);
+}
+
+/**
+ * @brief Record the addresses associated to the descriptor at position idx
+ */
+void sg_descriptor_chain::set_info(std::size_t idx, uintptr_t desc_phys_addr, uint8_t *buf_virt_addr,
+                                   uintptr_t buf_phys_addr)
+{
+    info_[idx] = {idx, desc_phys_addr, buf_virt_addr, buf_phys_addr};
+}
+
+/**
+ * @brief Look up the addresses associated to the descriptor at position idx
+ */
+const sg_descriptor_info& sg_descriptor_chain::info(std::size_t idx) const
+{
+    return info_[idx];
+}
+
+/**
+ * @brief Look up the addresses associated to a descriptor belonging to this chain in constant time
+ */
+const sg_descriptor_info& sg_descriptor_chain::info(const sg_descriptor& desc) const
+{
+    return info_[index(desc)];
 }
@@ -1,10 +1,59 @@
 #include "uaxidma.h"
+#include <algorithm>
+#include <bit>
 #include <errno.h>
 #include <inttypes.h>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Spins between two looks at the DMA status register while busy-polling
+static constexpr unsigned int error_check_spins = 4096U;
+
+// Buffers dropped past the one being written when the hardware laps the application in cyclic mode
+static constexpr size_t overrun_guard = 4U;
+
+/**
+ * @brief Hint the CPU that it's running a spin-wait loop
+ */
+static inline void cpu_relax()
+{
+#if defined(__ARM_ARCH)
+    asm volatile("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief Non-temporal stores and streaming loads only pay off on uncached mappings: on cached ones, they evict
+ * the data and cost a fence on every copy
+ */
+static inline void copy_to_device(bool uncached, void *dst, const void *src, size_t len)
+{
+    if (uncached)
+    {
+        dma_copy::to_device(dst, src, len);
+    }
+    else
+    {
+        memcpy(dst, src, len);
+    }
+}
+
+static inline void copy_from_device(bool uncached, void *dst, const void *src, size_t len)
+{
+    if (uncached)
+    {
+        dma_copy::from_device(dst, src, len);
+    }
+    else
+    {
+        memcpy(dst, src, len);
+    }
+}
+
 uint8_t *uaxidma::buffer::data()
 {
     return data_;
@@ -26,14 +75,180 @@ bool uaxidma::buffer::set_payload(size_t len)
     return true;
 }
 
+bool uaxidma::buffer::copy_in(const void *src, size_t len)
+{
+    if (len > capacity_)
+    {
+        return false;
+    }
+
+    copy_to_device(uncached_, data_, src, len);
+    length_ = len;
+    return true;
+}
+
+bool uaxidma::buffer::copy_in(std::span<const iovec> src)
+{
+    size_t len = 0;
+    for (const auto& piece : src)
+    {
+        len += piece.iov_len;
+    }
+    if (len > capacity_)
+    {
+        return false;
+    }
+
+    size_t pos = 0;
+    for (const auto& piece : src)
+    {
+        copy_to_device(uncached_, data_ + pos, piece.iov_base, piece.iov_len);
+        pos += piece.iov_len;
+    }
+    length_ = len;
+    return true;
+}
+
+size_t uaxidma::buffer::copy_out(void *dst, size_t len, size_t offset)
+{
+    if (offset >= length_)
+    {
+        return 0;
+    }
+
+    len = std::min(len, length_ - offset);
+    copy_from_device(uncached_, dst, data_ + offset, len);
+    return len;
+}
+
+size_t uaxidma::buffer::copy_out(std::span<const iovec> dst, size_t offset)
+{
+    size_t copied = 0;
+    for (const auto& piece : dst)
+    {
+        const size_t len = copy_out(piece.iov_base, piece.iov_len, offset + copied);
+        copied += len;
+        if (len < piece.iov_len)
+        {
+            break;
+        }
+    }
+    return copied;
+}
+
+std::chrono::steady_clock::time_point uaxidma::buffer::completion_time() const
+{
+    return completed_at_;
+}
+
+std::chrono::steady_clock::time_point uaxidma::buffer::handoff_time() const
+{
+    return handed_at_;
+}
+
+std::chrono::steady_clock::time_point uaxidma::buffer::submit_time() const
+{
+    return submitted_at_;
+}
+
+uint64_t uaxidma::buffer::sequence() const
+{
+    return sequence_;
+}
+
+std::span<uaxidma::buffer*> uaxidma::packet::fragments() const
+{
+    return fragments_;
+}
+
+size_t uaxidma::packet::length() const
+{
+    return length_;
+}
+
+size_t uaxidma::packet::to_iovec(std::span<iovec> iov) const
+{
+    const size_t count = std::min(iov.size(), fragments_.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        iov[i].iov_base = fragments_[i]->data();
+        iov[i].iov_len = fragments_[i]->length();
+    }
+    return count;
+}
+
 uaxidma::uaxidma(const std::string& udmabuf_name, size_t udmabuf_size, const std::string& axidma_uio_name, 
-                 dma_mode mode, transfer_direction direction, size_t buffer_size)
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
 
     : axidma{udmabuf_name, udmabuf_size, axidma_uio_name, static_cast<axi_dma::dma_mode>(mode),
-             static_cast<axi_dma::transfer_direction>(direction), buffer_size},
+             static_cast<axi_dma::transfer_direction>(direction), buffer_size, coalescing, alignment},
       mode(mode),
       direction(direction),
-      buffers{(mode == dma_mode::normal)} // in cyclic mode, the hardware won't wait for the user anyway
+      buffers{(mode == dma_mode::normal)}, // in cyclic mode, the hardware won't wait for the user anyway
+      wakeup_stats{},
+      wakeup_buffers(0),
+      max_adaptive_thresh(axi_dma::max_irq_threshold),
+      wait_mode(wait_policy::interrupt),
+      spin_time(std::chrono::nanoseconds::zero()),
+      latency{},
+      auto_recovery(true),
+      last_error{},
+      skip_to_newest(false),
+      read_sequence{},
+      next_sequence(0),
+      sequence_started(false),
+      pending_skips(0)
+{
+}
+
+uaxidma::uaxidma(const std::vector<std::string>& udmabuf_names, const std::string& axidma_uio_name,
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : axidma{udmabuf_names, axidma_uio_name, static_cast<axi_dma::dma_mode>(mode),
+             static_cast<axi_dma::transfer_direction>(direction), buffer_size, coalescing, alignment},
+      mode(mode),
+      direction(direction),
+      buffers{(mode == dma_mode::normal)}, // in cyclic mode, the hardware won't wait for the user anyway
+      wakeup_stats{},
+      wakeup_buffers(0),
+      max_adaptive_thresh(axi_dma::max_irq_threshold),
+      wait_mode(wait_policy::interrupt),
+      spin_time(std::chrono::nanoseconds::zero()),
+      latency{},
+      auto_recovery(true),
+      last_error{},
+      skip_to_newest(false),
+      read_sequence{},
+      next_sequence(0),
+      sequence_started(false),
+      pending_skips(0)
+{
+}
+
+uaxidma::uaxidma(std::shared_ptr<axi_dma::core> shared_core, size_t region_offset, size_t region_size,
+                 dma_mode mode, transfer_direction direction, size_t buffer_size,
+                 const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : axidma{std::move(shared_core), region_offset, region_size, static_cast<axi_dma::dma_mode>(mode),
+             static_cast<axi_dma::transfer_direction>(direction), buffer_size, coalescing, alignment},
+      mode(mode),
+      direction(direction),
+      buffers{(mode == dma_mode::normal)}, // in cyclic mode, the hardware won't wait for the user anyway
+      wakeup_stats{},
+      wakeup_buffers(0),
+      max_adaptive_thresh(axi_dma::max_irq_threshold),
+      wait_mode(wait_policy::interrupt),
+      spin_time(std::chrono::nanoseconds::zero()),
+      latency{},
+      auto_recovery(true),
+      last_error{},
+      skip_to_newest(false),
+      read_sequence{},
+      next_sequence(0),
+      sequence_started(false),
+      pending_skips(0)
 {
 }
 
@@ -43,9 +258,15 @@ bool uaxidma::initialize()
     {
         buffers.initialize(axidma.sg_desc_chain.size());
 
+        // A threshold larger than the ring would never be reached
+        max_adaptive_thresh = static_cast<uint32_t>(
+            std::min<std::size_t>(axi_dma::max_irq_threshold, axidma.sg_desc_chain.size()));
+        wakeup_stats.irq_threshold = axidma.get_irq_coalescing().threshold;
+
         for (auto& desc : axidma.sg_desc_chain)
         {
-            buffers.add({axidma.get_virt_buffer_pointer(desc), axidma.get_buffer_size(), desc});
+            buffers.add({axidma.get_virt_buffer_pointer(desc), axidma.get_buffer_size(), desc,
+                         axidma.is_buffer_uncached(desc)});
         }
 
         return true;
@@ -62,53 +283,998 @@ std::pair<uaxidma::acquisition_result, uaxidma::buffer*> uaxidma::get_buffer(int
         return {acquisition_result::error, nullptr};
     }
 
-    axidma.clean_interrupt();
+    const acquisition_result wait_ret = wait_for_completion(timeout);
+    if (wait_ret != acquisition_result::success)
+    {
+        return {wait_ret, nullptr};
+    }
 
-    if (!buffers.peek_next().desc_handle_.completed())
+    if (mode == dma_mode::cyclic)
     {
-        auto poll_ret = axidma.poll_interrupt(timeout);
-        if (poll_ret != axi_dma::acquisition_result::success)
-        {
-            return {static_cast<acquisition_result>(poll_ret), nullptr};
-        }
+        check_overrun();
     }
+    account_ring_occupancy();
 
     buffer& acquired = buffers.acquire();
+    wakeup_stats.buffers++;
+    wakeup_buffers++;
+    account_acquired(acquired);
 
     if (direction == transfer_direction::dev_to_mem)
     {
-        acquired.set_payload(acquired.desc_handle_.get_buffer_len());
+        if (!receive(acquired))
+        {
+            // The CPU might see stale data: drop the buffer
+            const int err = errno;
+            mark_reusable(acquired);
+            errno = err;
+            return {acquisition_result::error, nullptr};
+        }
+        account_transfer(1, acquired.length_);
     }
+    stamp_acquired(acquired, std::chrono::steady_clock::now());
 
     return {acquisition_result::success, &acquired};
 }
 
 void uaxidma::mark_reusable(buffer &buf)
 {
-    // Prepare buffer to check for completion again next time
-    buf.desc_handle_.clear_complete_flag();
-    buffers.release(buf);
+    axidma.sync_for_device(buf.desc_handle_.d, buf.length_);
+
+    // Prepare buffer to check for completion again next time. Cyclic buffers were prepared on acquisition
+    // already, and may have been completed again since.
+    if (mode == dma_mode::normal)
+    {
+        buf.desc_handle_.clear_complete_flag();
+    }
+
+    // Let the hardware fill every buffer handed back in order so far
+    if (buffer *returned = buffers.release(buf))
+    {
+        axidma.ring_doorbell(returned->desc_handle_.d);
+    }
+}
+
+std::pair<uaxidma::acquisition_result, uaxidma::packet> uaxidma::get_packet(std::span<buffer*> storage, int timeout)
+{
+    using std::chrono::steady_clock;
+
+    if (buffers.empty())
+    {
+        errno = EAGAIN;
+        return {acquisition_result::error, {}};
+    }
+
+    const bool forever = (timeout < 0);
+    const auto deadline = steady_clock::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+
+    if (mode == dma_mode::cyclic)
+    {
+        check_overrun();
+    }
+
+    // Look ahead for a complete packet without acquiring anything, so that a timeout leaves the ring untouched
+    size_t count = 0;
+    bool waited = false;
+    bool truncated = false;
+    while (true)
+    {
+        if (count == buffers.available())
+        {
+            // The application holds too many buffers, unless the packet doesn't fit in the ring
+            if (buffers.available() != axidma.sg_desc_chain.size())
+            {
+                errno = EAGAIN;
+                return {acquisition_result::error, {}};
+            }
+            truncated = true;
+            break;
+        }
+
+        const sg_descriptor_handle& desc = buffers.peek(count).desc_handle_;
+        if (!desc.completed())
+        {
+            int remaining = -1;
+            if (!forever)
+            {
+                const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - steady_clock::now());
+                remaining = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+            }
+
+            const acquisition_result wait_ret = wait_for_completion(desc, remaining);
+            if (wait_ret != acquisition_result::success)
+            {
+                return {wait_ret, {}};
+            }
+            waited = true;
+        }
+
+        if ((count == 0) && !desc.start_of_frame())
+        {
+            // Leftover of a packet whose start is gone
+            buffer& leftover = buffers.acquire();
+            receive(leftover);
+            mark_reusable(leftover);
+            continue;
+        }
+
+        count++;
+        if (desc.end_of_frame())
+        {
+            break;
+        }
+    }
+
+    if (truncated || (count > storage.size()))
+    {
+        // Drop the fragments so that the ring keeps moving. Those of a truncated packet still to come are
+        // dropped as leftovers by the next call.
+        for (size_t i = 0; i < count; i++)
+        {
+            buffer& dropped = buffers.acquire();
+            receive(dropped);
+            mark_reusable(dropped);
+        }
+        errno = EMSGSIZE;
+        return {acquisition_result::error, {}};
+    }
+
+    account_ring_occupancy();
+
+    size_t length = 0;
+    int sync_err = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        buffer& acquired = buffers.acquire();
+        account_acquired(acquired);
+        if (!receive(acquired))
+        {
+            sync_err = errno;
+        }
+        length += acquired.length_;
+        storage[i] = &acquired;
+    }
+
+    if (sync_err != 0)
+    {
+        // The CPU might see stale data: drop the packet
+        mark_reusable(storage.first(count));
+        errno = sync_err;
+        return {acquisition_result::error, {}};
+    }
+
+    wakeup_stats.buffers += count;
+    wakeup_buffers += count;
+    account_transfer(count, length);
+
+    // The packet is completed when its last fragment is
+    const auto handed = steady_clock::now();
+    if (!waited)
+    {
+        completion_seen = handed;
+    }
+    for (buffer *fragment : storage.first(count))
+    {
+        stamp_acquired(*fragment, handed);
+    }
+
+    return {acquisition_result::success, packet{storage.first(count), length}};
+}
+
+void uaxidma::mark_reusable(const packet &pkt)
+{
+    mark_reusable(pkt.fragments());
+}
+
+void uaxidma::submit_packet(std::span<buffer*> bufs)
+{
+    if (bufs.empty())
+    {
+        return;
+    }
+
+    buffer *returned = nullptr;
+    size_t bytes = 0;
+    const auto submitted = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < bufs.size(); i++)
+    {
+        bufs[i]->submitted_at_ = submitted;
+        axidma.sync_for_device(bufs[i]->desc_handle_.d, bufs[i]->length_);
+        axidma.prepare_buffer(bufs[i]->desc_handle_.d, bufs[i]->length_, (i == 0), (i == bufs.size() - 1));
+        bytes += bufs[i]->length_;
+        if (buffer *last = buffers.release(*bufs[i]))
+        {
+            returned = last;
+        }
+    }
+    account_transfer(bufs.size(), bytes);
+
+    if (returned)
+    {
+        axidma.ring_doorbell(returned->desc_handle_.d);
+    }
+}
+
+std::pair<uaxidma::acquisition_result, size_t> uaxidma::get_buffers(std::span<buffer*> bufs, int timeout)
+{
+    if (bufs.empty())
+    {
+        return {acquisition_result::success, 0};
+    }
+
+    if (buffers.empty())
+    {
+        errno = EAGAIN;
+        return {acquisition_result::error, 0};
+    }
+
+    const acquisition_result wait_ret = wait_for_completion(timeout);
+    if (wait_ret != acquisition_result::success)
+    {
+        return {wait_ret, 0};
+    }
+
+    if (mode == dma_mode::cyclic)
+    {
+        check_overrun();
+    }
+    account_ring_occupancy();
+
+    // In cyclic mode the ring never runs out of buffers: don't go past one full lap
+    const size_t max_count = std::min(bufs.size(), axidma.sg_desc_chain.size());
+
+    size_t count = 0;
+    size_t bytes = 0;
+    int sync_err = 0;
+    while ((count < max_count) && !buffers.empty() && buffers.peek_next().desc_handle_.completed())
+    {
+        buffer& acquired = buffers.acquire();
+        account_acquired(acquired);
+
+        if (direction == transfer_direction::dev_to_mem)
+        {
+            if (!receive(acquired))
+            {
+                // The CPU might see stale data: drop the buffer, and stop here to report the error
+                sync_err = errno;
+                mark_reusable(acquired);
+                break;
+            }
+            bytes += acquired.length_;
+        }
+
+        bufs[count++] = &acquired;
+    }
+
+    wakeup_stats.buffers += count;
+    wakeup_buffers += count;
+    if (direction == transfer_direction::dev_to_mem)
+    {
+        account_transfer(count, bytes);
+    }
+
+    const auto handed = std::chrono::steady_clock::now();
+    for (buffer *acquired : bufs.first(count))
+    {
+        stamp_acquired(*acquired, handed);
+    }
+
+    if ((sync_err != 0) && (count == 0))
+    {
+        errno = sync_err;
+        return {acquisition_result::error, 0};
+    }
+
+    return {acquisition_result::success, count};
+}
+
+void uaxidma::mark_reusable(std::span<buffer*> bufs)
+{
+    buffer *returned = nullptr;
+    for (buffer *buf : bufs)
+    {
+        axidma.sync_for_device(buf->desc_handle_.d, buf->length_);
+        if (mode == dma_mode::normal)
+        {
+            buf->desc_handle_.clear_complete_flag_unordered();
+        }
+        if (buffer *last = buffers.release(*buf))
+        {
+            returned = last;
+        }
+    }
+
+    // A single barrier orders the whole batch of status updates
+#ifdef __ARM_ARCH
+    asm volatile("dmb st");
+#endif
+
+    if (returned)
+    {
+        axidma.ring_doorbell(returned->desc_handle_.d);
+    }
 }
 
 void uaxidma::submit_buffer(buffer &buf)
 {
-    axidma.transfer_buffer(buf.desc_handle_.d, buf.length_);
-    buffers.release(buf);
+    buf.submitted_at_ = std::chrono::steady_clock::now();
+    axidma.sync_for_device(buf.desc_handle_.d, buf.length_);
+    axidma.prepare_buffer(buf.desc_handle_.d, buf.length_);
+    account_transfer(1, buf.length_);
+
+    // The tail can't move past buffers obtained earlier and not submitted yet
+    if (buffer *returned = buffers.release(buf))
+    {
+        axidma.ring_doorbell(returned->desc_handle_.d);
+    }
+}
+
+void uaxidma::submit_buffers(std::span<buffer*> bufs)
+{
+    if (bufs.empty())
+    {
+        return;
+    }
+
+    buffer *returned = nullptr;
+    size_t bytes = 0;
+    const auto submitted = std::chrono::steady_clock::now();
+    for (buffer *buf : bufs)
+    {
+        buf->submitted_at_ = submitted;
+        axidma.sync_for_device(buf->desc_handle_.d, buf->length_);
+        axidma.prepare_buffer(buf->desc_handle_.d, buf->length_);
+        bytes += buf->length_;
+        if (buffer *last = buffers.release(*buf))
+        {
+            returned = last;
+        }
+    }
+    account_transfer(bufs.size(), bytes);
+
+    if (returned)
+    {
+        axidma.ring_doorbell(returned->desc_handle_.d);
+    }
+}
+
+/**
+ * @brief Exchanges the descriptors two buffers held by the application are bound to, along with their ring positions
+ */
+void uaxidma::rebind(buffer& a, buffer& b)
+{
+    sg_descriptor& desc_a = a.desc_handle_.d;
+    sg_descriptor& desc_b = b.desc_handle_.d;
+    axidma.swap_buffers(desc_a, desc_b);
+
+    // Handles refer to their descriptor for good: replace them
+    std::destroy_at(&a.desc_handle_);
+    std::construct_at(&a.desc_handle_, desc_b);
+    std::destroy_at(&b.desc_handle_);
+    std::construct_at(&b.desc_handle_, desc_a);
+
+    buffers.swap(a, b);
+}
+
+/**
+ * @brief Submits buffers for transmission in the given order, whatever the order they were obtained in
+ * Each buffer is bound to the oldest descriptor still held by the application before being submitted, trading
+ * descriptors with the buffer bound to it, so that the tail always moves past it right away.
+ * @note To be used only when direction has been set to mem_to_dev, in normal mode
+ */
+void uaxidma::submit_in_order(std::span<buffer*> bufs)
+{
+    for (buffer *buf : bufs)
+    {
+        buffer& oldest = buffers.oldest_held();
+        if (&oldest != buf)
+        {
+            rebind(*buf, oldest);
+        }
+    }
+
+    submit_buffers(bufs);
+}
+
+int uaxidma::fd() const
+{
+    return axidma.get_interrupt_fd();
+}
+
+uaxidma::arm_result uaxidma::arm()
+{
+    // Nothing to wait for if the next buffer is already there. The flags are cleaned before
+    // checking, so a completion racing with this call still raises the interrupt once unmasked.
+    axidma.clean_interrupt();
+    if (next_completed())
+    {
+        return arm_result::ready;
+    }
+
+    return axidma.unmask_interrupt() ? arm_result::armed : arm_result::error;
+}
+
+/**
+ * @brief Returns true if the next buffer in the ring can be acquired without waiting
+ */
+bool uaxidma::next_completed() const
+{
+    return !buffers.empty() && buffers.peek_next().desc_handle_.completed();
+}
+
+uaxidma::acquisition_result uaxidma::on_readable()
+{
+    const auto ret = static_cast<acquisition_result>(axidma.acknowledge_interrupt());
+    if (ret == acquisition_result::success)
+    {
+        account_wakeup();
+        if (direction == transfer_direction::mem_to_dev)
+        {
+            observe_completions(std::chrono::steady_clock::now());
+        }
+        return check_channel();
+    }
+    return ret;
+}
+
+void uaxidma::set_wait_policy(wait_policy policy, std::chrono::nanoseconds spin)
+{
+    wait_mode = policy;
+    spin_time = spin;
+
+    // Spinning modes don't want the interrupt to fire while spinning. In hybrid mode it's only
+    // unmasked right before sleeping on it.
+    if (policy != wait_policy::interrupt)
+    {
+        axidma.mask_interrupt();
+    }
+}
+
+/**
+ * @brief Waits until the next buffer in the ring is completed, according to the current wait policy
+ * @param timeout in milliseconds, with the same semantics as for poll()
+ * @return success once the next buffer is completed, timeout or error otherwise
+ */
+uaxidma::acquisition_result uaxidma::wait_for_completion(int timeout)
+{
+    return wait_for_completion(buffers.peek_next().desc_handle_, timeout);
+}
+
+/**
+ * @brief Waits until the specified descriptor is completed, according to the current wait policy
+ * @param next descriptor to wait for
+ * @param timeout in milliseconds, with the same semantics as for poll()
+ * @return success once the descriptor is completed, timeout or error otherwise
+ */
+uaxidma::acquisition_result uaxidma::wait_for_completion(const sg_descriptor_handle& next, int timeout)
+{
+    using std::chrono::steady_clock;
+
+    // Interrupt flags are only relevant if we may end up sleeping on the interrupt
+    if (wait_mode != wait_policy::busy_poll)
+    {
+        axidma.clean_interrupt();
+    }
+
+    if (next.completed())
+    {
+        completion_seen = steady_clock::now();
+        if (direction == transfer_direction::mem_to_dev)
+        {
+            observe_completions(completion_seen);
+        }
+        return acquisition_result::success;
+    }
+
+    // Non-blocking calls don't need to go through the interrupt machinery
+    if (timeout == 0)
+    {
+        return acquisition_result::timeout;
+    }
+
+    const auto wait_start = steady_clock::now();
+    const acquisition_result ret = block_for_completion(next, timeout);
+    const auto wait_end = steady_clock::now();
+    const auto blocked = std::chrono::duration_cast<std::chrono::nanoseconds>(wait_end - wait_start);
+    axi_dma::channel_counters::add(axidma.counters.blocked_ns, static_cast<uint64_t>(blocked.count()));
+    completion_seen = wait_end;
+    if ((ret == acquisition_result::success) && (direction == transfer_direction::mem_to_dev))
+    {
+        observe_completions(completion_seen);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Blocks until the specified descriptor is completed, according to the current wait policy
+ * @param next descriptor to wait for, not completed at the time of the call
+ * @param timeout in milliseconds, with the same semantics as for poll(), but non-zero
+ * @return success once the descriptor is completed, timeout or error otherwise
+ */
+uaxidma::acquisition_result uaxidma::block_for_completion(const sg_descriptor_handle& next, int timeout)
+{
+    using std::chrono::steady_clock;
+
+    const bool forever = (timeout < 0);
+    const auto deadline = steady_clock::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+
+    if (wait_mode != wait_policy::interrupt)
+    {
+        const bool spin_forever = forever && (wait_mode == wait_policy::busy_poll);
+        const auto spin_deadline = (wait_mode == wait_policy::busy_poll)
+                                   ? deadline
+                                   : (forever ? steady_clock::now() + spin_time
+                                              : std::min(deadline, steady_clock::now() + spin_time));
+
+        unsigned int spins = 0;
+        while (!next.completed())
+        {
+            if (!spin_forever && (steady_clock::now() >= spin_deadline))
+            {
+                break;
+            }
+
+            // A halted channel would never complete anything: look at the status register once in a while
+            if ((++spins % error_check_spins) == 0)
+            {
+                if (check_channel() != acquisition_result::success)
+                {
+                    return acquisition_result::error;
+                }
+            }
+            cpu_relax();
+        }
+
+        if (next.completed())
+        {
+            return acquisition_result::success;
+        }
+
+        if (check_channel() != acquisition_result::success)
+        {
+            return acquisition_result::error;
+        }
+
+        if (wait_mode == wait_policy::busy_poll)
+        {
+            return acquisition_result::timeout;
+        }
+    }
+
+    while (true)
+    {
+        int remaining = -1;
+        if (!forever)
+        {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - steady_clock::now());
+            remaining = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+        }
+
+        const auto poll_ret = axidma.poll_interrupt(remaining);
+        if (poll_ret == axi_dma::acquisition_result::timeout)
+        {
+            return (check_channel() == acquisition_result::success) ? acquisition_result::timeout
+                                                                    : acquisition_result::error;
+        }
+        if (poll_ret != axi_dma::acquisition_result::success)
+        {
+            return static_cast<acquisition_result>(poll_ret);
+        }
+
+        account_wakeup();
+
+        if (next.completed())
+        {
+            return acquisition_result::success;
+        }
+
+        // Either an error, or a spurious wakeup, e.g. a stale interrupt from a completion that was already consumed
+        if (check_channel() != acquisition_result::success)
+        {
+            return acquisition_result::error;
+        }
+
+        axidma.clean_interrupt();
+        if (next.completed())
+        {
+            return acquisition_result::success;
+        }
+    }
+}
+
+/**
+ * @brief Looks for a DMA error halting the channel, and recovers from it if automatic recovery is enabled
+ * @return success if the channel is running, error otherwise
+ */
+uaxidma::acquisition_result uaxidma::check_channel()
+{
+    if (axidma.get_dma_errors() == 0)
+    {
+        return acquisition_result::success;
+    }
+
+    if (!auto_recovery || !recover())
+    {
+        errno = EIO;
+        return acquisition_result::error;
+    }
+
+    return acquisition_result::success;
+}
+
+void uaxidma::set_error_recovery(bool automatic)
+{
+    auto_recovery = automatic;
+}
+
+bool uaxidma::recover()
+{
+    using std::chrono::steady_clock;
+
+    const auto start = steady_clock::now();
+    const uint32_t dma_status = axidma.get_dma_status();
+    if ((dma_status & static_cast<uint32_t>(axi_dma::dma_error::all)) == 0)
+    {
+        return true;
+    }
+
+    // Buffers the application may acquire next are either completed, and kept, or still owned by the
+    // hardware. The channel stopped at the first of the latter.
+    const size_t window = buffers.available();
+    size_t first = 0;
+    while ((first < window) && buffers.peek(first).desc_handle_.completed()
+           && (buffers.peek(first).desc_handle_.errors() == 0))
+    {
+        first++;
+    }
+
+    const sg_descriptor_handle& stopped = buffers.peek(first).desc_handle_;
+    const size_t first_index = axidma.sg_desc_chain.index(stopped.d);
+    const uint32_t desc_errors = stopped.errors();
+
+    const bool recovered = axidma.recover(first_index, window - first);
+
+    last_error = {dma_status, desc_errors, first_index, window - first,
+                  static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      steady_clock::now() - start).count()),
+                  recovered};
+    if (recovered)
+    {
+        axi_dma::channel_counters::add(axidma.counters.recoveries, uint64_t{1});
+    }
+
+    return recovered;
+}
+
+const uaxidma::error_report& uaxidma::get_last_error() const
+{
+    return last_error;
+}
+
+void uaxidma::set_overrun_policy(bool skip, sequence_reader reader)
+{
+    skip_to_newest = skip;
+    read_sequence = std::move(reader);
+    sequence_started = false;
+    pending_skips = 0;
+}
+
+uaxidma::irq_stats uaxidma::get_irq_stats() const
+{
+    return wakeup_stats;
+}
+
+uaxidma::channel_stats uaxidma::get_stats() const
+{
+    return axidma.counters.snapshot();
+}
+
+const uaxidma::latency_histograms& uaxidma::get_latency_histograms() const
+{
+    return latency;
+}
+
+void uaxidma::reset_latency_histograms()
+{
+    latency.irq_to_user.reset();
+    latency.submit_to_complete.reset();
+}
+
+size_t uaxidma::buffer_count() const
+{
+    return axidma.sg_desc_chain.size();
+}
+
+const uaxidma::layout_report& uaxidma::get_layout() const
+{
+    return axidma.get_layout();
+}
+
+uaxidma::layout_report uaxidma::plan_layout(size_t udmabuf_size, size_t buffer_size, buffer_alignment alignment)
+{
+#ifndef USE_DATA_REALIGNMENT_ENGINE
+    // Same rounding as the one applied by the channel
+    buffer_size = (buffer_size % 8UL) ? (buffer_size + 8UL - buffer_size % 8UL) : buffer_size;
+#endif
+    return axi_dma::plan_layout(0, udmabuf_size, buffer_size, alignment);
+}
+
+/**
+ * @brief Accounts for buffers handed to the hardware (TX) or received from it (RX)
+ */
+void uaxidma::account_transfer(size_t count, size_t bytes)
+{
+    axi_dma::channel_counters::add(axidma.counters.packets, static_cast<uint64_t>(count));
+    axi_dma::channel_counters::add(axidma.counters.bytes, static_cast<uint64_t>(bytes));
+}
+
+/**
+ * @brief Records the error bits reported by the descriptor of a buffer just acquired
+ */
+void uaxidma::account_acquired(const buffer& buf)
+{
+    const uint32_t errors = buf.desc_handle_.errors();
+    if (errors != 0)
+    {
+        axi_dma::channel_counters::add(axidma.counters.desc_errors, uint64_t{1});
+        axidma.counters.desc_error_bits.store(axidma.counters.desc_error_bits.load(std::memory_order_relaxed) | errors,
+                                              std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Records when a buffer just acquired was seen completed and handed to the application, and the
+ * resulting latencies
+ */
+void uaxidma::stamp_acquired(buffer& buf, std::chrono::steady_clock::time_point handed)
+{
+    const auto elapsed_ns = [](std::chrono::steady_clock::duration d) {
+        return static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), 0));
+    };
+
+    buf.handed_at_ = handed;
+    latency.irq_to_user.record(elapsed_ns(handed - completion_seen));
+
+    if (direction == transfer_direction::dev_to_mem)
+    {
+        buf.completed_at_ = completion_seen;
+    }
+    else if (buf.submitted_at_ >= buf.completed_at_)
+    {
+        // Not seen by observe_completions() since its last submission
+        stamp_completed(buf, completion_seen);
+    }
+}
+
+/**
+ * @brief Records when a TX buffer was seen completed, and its submit-to-complete latency
+ */
+void uaxidma::stamp_completed(buffer& buf, std::chrono::steady_clock::time_point seen)
+{
+    buf.completed_at_ = seen;
+
+    // Buffers acquired for the first time haven't been transmitted yet
+    if (buf.submitted_at_.time_since_epoch().count() != 0)
+    {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(seen - buf.submitted_at_);
+        latency.submit_to_complete.record(static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0)));
+    }
+}
+
+/**
+ * @brief Stamps the TX buffers handed to the hardware that completed since the last call
+ * Buffers are only acquired again once the ring comes around, long after their completion: looking at every
+ * buffer in flight on each wait keeps submit-to-complete close to the hardware latency.
+ */
+void uaxidma::observe_completions(std::chrono::steady_clock::time_point seen)
+{
+    while (buffer *buf = buffers.peek_unseen())
+    {
+        if (!buf->desc_handle_.completed())
+        {
+            break;
+        }
+        if (buf->submitted_at_ >= buf->completed_at_)
+        {
+            stamp_completed(*buf, seen);
+        }
+        buffers.mark_seen();
+    }
+}
+
+/**
+ * @brief Hands the payload of a received buffer just acquired over to the CPU
+ * @return false if the payload couldn't be handed over, with errno set
+ */
+bool uaxidma::receive(buffer& buf)
+{
+    buf.set_payload(buf.desc_handle_.get_buffer_len());
+    const bool synced = axidma.sync_for_cpu(buf.desc_handle_.d, buf.length_);
+
+    if (mode == dma_mode::cyclic)
+    {
+        // The hardware doesn't wait for the buffer to be released: from now on, a completion reported by its
+        // descriptor is a newer one, i.e. the hardware went a full lap past the application
+        buf.desc_handle_.clear_complete_flag();
+        track_sequence(buf);
+    }
+
+    return synced;
+}
+
+/**
+ * @brief Looks for the hardware having lapped the application in cyclic mode, and resynchronizes the ring
+ * if it did
+ * Every buffer from the next one up to the one being written by the hardware was overwritten at least once
+ * since the application last acquired a buffer. The buffers that follow hold the oldest data left, and the one
+ * preceding it the newest. Buffers the application won't acquire right away are marked not completed, as they
+ * still report their completion of the previous lap.
+ */
+void uaxidma::check_overrun()
+{
+    const size_t count = axidma.sg_desc_chain.size();
+    if ((count < 3) || !buffers.peek(count - 1).desc_handle_.completed())
+    {
+        return;
+    }
+
+    const size_t next = axidma.sg_desc_chain.index(buffers.peek_next().desc_handle_.d);
+    const size_t current = axidma.get_current_desc_index();
+    const size_t ahead = (current + count - next) % count;
+    const size_t guard = std::min(overrun_guard, count - 2);
+
+    // Either everything but the newest buffer is dropped, or the buffer being written and a few older ones,
+    // so that the hardware doesn't catch up with the oldest one left while it's being read
+    const size_t dropped = skip_to_newest ? (count - 1) : (guard + 1);
+    for (size_t i = ahead; i < ahead + dropped; i++)
+    {
+        sg_descriptor_handle{buffers.peek(i).desc_handle_.d}.clear_complete_flag();
+    }
+    buffers.skip((ahead + dropped) % count);
+
+    const uint64_t lost = ahead + 1 + (skip_to_newest ? 0 : guard);
+    const uint64_t skipped = skip_to_newest ? (count - 2) : 0;
+    axi_dma::channel_counters::add(axidma.counters.overruns, uint64_t{1});
+    axi_dma::channel_counters::add(axidma.counters.skipped_buffers, skipped);
+
+    if (read_sequence)
+    {
+        // The next sequence gap tells how many buffers were actually lost
+        pending_skips += skipped;
+    }
+    else
+    {
+        axi_dma::channel_counters::add(axidma.counters.lost_buffers, lost);
+        next_sequence += lost + skipped;
+    }
+}
+
+/**
+ * @brief Numbers a received buffer in cyclic mode, and counts the buffers missing in between if the data source
+ * stamps them with sequence numbers
+ */
+void uaxidma::track_sequence(buffer& buf)
+{
+    if (!read_sequence)
+    {
+        buf.sequence_ = next_sequence++;
+        return;
+    }
+
+    const uint64_t sequence = read_sequence(buf.data_, buf.length_);
+    if (sequence_started && (sequence > next_sequence))
+    {
+        const uint64_t gap = sequence - next_sequence;
+        const uint64_t skipped = std::min(gap, pending_skips);
+        axi_dma::channel_counters::add(axidma.counters.lost_buffers, gap - skipped);
+    }
+
+    pending_skips = 0;
+    sequence_started = true;
+    next_sequence = sequence + 1;
+    buf.sequence_ = sequence;
+}
+
+/**
+ * @brief Updates the high-water mark of ring occupancy, from the positions of the next buffer to acquire and of
+ * the descriptor the hardware is on
+ * RX rings are occupied by the buffers received and not acquired yet, TX rings by the buffers submitted and not
+ * transmitted yet. The descriptor the hardware is on is being processed, unless it's completed, i.e. the
+ * hardware stopped on it or went a full lap.
+ */
+void uaxidma::account_ring_occupancy()
+{
+    const size_t count = axidma.sg_desc_chain.size();
+    const size_t current = axidma.get_current_desc_index();
+    const bool current_completed = sg_descriptor_handle{axidma.sg_desc_chain[current]}.completed();
+
+    size_t occupied = 0;
+    if (direction == transfer_direction::dev_to_mem)
+    {
+        // Completed descriptors run from the next buffer to the one the hardware is on
+        const size_t next = axidma.sg_desc_chain.index(buffers.peek_next().desc_handle_.d);
+        occupied = (current + count - next) % count;
+        if (current_completed)
+        {
+            occupied = (occupied == 0) ? buffers.available() : occupied + 1;
+        }
+    }
+    else if (!current_completed)
+    {
+        // Descriptors in flight run from the one the hardware is on to the oldest buffer held by the application
+        const size_t held = axidma.sg_desc_chain.index(buffers.oldest_held().desc_handle_.d);
+        occupied = (held + count - current) % count;
+        if (occupied == 0)
+        {
+            occupied = buffers.available();
+        }
+    }
+
+    axi_dma::channel_counters::raise(axidma.counters.ring_high_water, static_cast<uint64_t>(occupied));
+}
+
+/**
+ * @brief Closes the tally of buffers delivered by the previous wakeup, and adapts the interrupt
+ * threshold to the observed load if requested
+ */
+void uaxidma::account_wakeup()
+{
+    if (wakeup_stats.wakeups++ != 0)
+    {
+        wakeup_stats.last_wakeup_buffers = wakeup_buffers;
+        wakeup_stats.max_wakeup_buffers = std::max(wakeup_stats.max_wakeup_buffers, wakeup_buffers);
+
+        const std::size_t bucket = std::min<std::size_t>(std::bit_width(wakeup_buffers),
+                                                         wakeup_stats.histogram.size() - 1);
+        wakeup_stats.histogram[bucket]++;
+
+        if (axidma.get_irq_coalescing().adaptive)
+        {
+            const uint32_t thresh = wakeup_stats.irq_threshold;
+            uint32_t new_thresh = thresh;
+
+            if (wakeup_buffers < thresh)
+            {
+                // The delay timer fired before the threshold was reached: the load is lighter than expected
+                new_thresh = std::max(thresh / 2, 1u);
+            }
+            else if (wakeup_buffers > 2 * thresh)
+            {
+                // Completions are piling up between wakeups: fewer interrupts would do
+                new_thresh = std::min(thresh * 2, max_adaptive_thresh);
+            }
+
+            if (new_thresh != thresh)
+            {
+                axidma.set_irq_threshold(new_thresh);
+                wakeup_stats.irq_threshold = new_thresh;
+            }
+        }
+    }
+
+    wakeup_buffers = 0;
 }
 
 uaxidma::buffer_ring::buffer_ring(bool limit_refs)
-    : limit_refs_(limit_refs)
+    : oldest_(0), available_(0), seen_(0), limit_refs_(limit_refs)
 {
 }
 
 void uaxidma::buffer_ring::initialize(size_t count)
 {
     buffers_.reserve(count);
+    slots_.reserve(count);
+    positions_.reserve(count);
+    released_.assign(count, false);
+    oldest_ = 0;
 }
 
 void uaxidma::buffer_ring::add(const buffer& buf)
 {
     buffers_.push_back(buf);
+    positions_.push_back(slots_.size());
+    slots_.push_back(&buffers_.back());
     if (!available_++) next_ = buffers_.begin();
 }
 
@@ -119,19 +1285,84 @@ bool uaxidma::buffer_ring::empty() const
 
 const uaxidma::buffer &uaxidma::buffer_ring::peek_next() const
 {
-    return *next_;
+    return *slots_[static_cast<std::size_t>(next_ - buffers_.begin())];
+}
+
+const uaxidma::buffer &uaxidma::buffer_ring::peek(std::size_t n) const
+{
+    const std::size_t pos = (static_cast<std::size_t>(next_ - buffers_.begin()) + n) % buffers_.size();
+    return *slots_[pos];
+}
+
+std::size_t uaxidma::buffer_ring::available() const
+{
+    return available_;
 }
 
 uaxidma::buffer& uaxidma::buffer_ring::acquire()
 {
     if (limit_refs_) available_--;
-    buffer &buf = *next_;
+    if (seen_) seen_--;
+    buffer &buf = *slots_[static_cast<std::size_t>(next_ - buffers_.begin())];
     if (++next_ == buffers_.end()) next_ = buffers_.begin();
     return buf;
 }
 
-void uaxidma::buffer_ring::release(buffer& buf)
+uaxidma::buffer& uaxidma::buffer_ring::oldest_held()
+{
+    return *slots_[oldest_];
+}
+
+void uaxidma::buffer_ring::swap(buffer& a, buffer& b)
+{
+    std::size_t& pos_a = positions_[static_cast<std::size_t>(&a - buffers_.data())];
+    std::size_t& pos_b = positions_[static_cast<std::size_t>(&b - buffers_.data())];
+    std::swap(slots_[pos_a], slots_[pos_b]);
+    std::swap(pos_a, pos_b);
+}
+
+void uaxidma::buffer_ring::skip(std::size_t n)
+{
+    const std::size_t pos = (static_cast<std::size_t>(next_ - buffers_.begin()) + n) % buffers_.size();
+    next_ = buffers_.begin() + static_cast<std::ptrdiff_t>(pos);
+    seen_ = (n < seen_) ? seen_ - n : 0;
+}
+
+uaxidma::buffer *uaxidma::buffer_ring::peek_unseen()
 {
-    (void)buf;
-    if (limit_refs_) available_++;
+    if (seen_ == available_)
+    {
+        return nullptr;
+    }
+
+    const std::size_t pos = (static_cast<std::size_t>(next_ - buffers_.begin()) + seen_) % buffers_.size();
+    return slots_[pos];
+}
+
+void uaxidma::buffer_ring::mark_seen()
+{
+    seen_++;
+}
+
+uaxidma::buffer *uaxidma::buffer_ring::release(buffer& buf)
+{
+    // Without reference limits buffers are never withheld from the hardware
+    if (!limit_refs_)
+    {
+        return nullptr;
+    }
+
+    released_[positions_[static_cast<std::size_t>(&buf - buffers_.data())]] = true;
+
+    // Hand back the run of released buffers starting at the oldest one still held
+    buffer *last = nullptr;
+    while ((available_ < buffers_.size()) && released_[oldest_])
+    {
+        released_[oldest_] = false;
+        last = slots_[oldest_];
+        if (++oldest_ == buffers_.size()) oldest_ = 0;
+        available_++;
+    }
+
+    return last;
 }
@@ -0,0 +1,288 @@
+#include "uaxidma_coro.h"
+#include <array>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+static constexpr int max_events = 16;
+
+void coro_queue::push(coro_node *node)
+{
+    node->next = nullptr;
+    if (tail_)
+    {
+        tail_->next = node;
+    }
+    else
+    {
+        head_ = node;
+    }
+    tail_ = node;
+}
+
+coro_node *coro_queue::pop()
+{
+    coro_node *node = head_;
+    if (node)
+    {
+        head_ = node->next;
+        if (!head_)
+        {
+            tail_ = nullptr;
+        }
+    }
+    return node;
+}
+
+std::suspend_never coro_task::promise_type::final_suspend() noexcept
+{
+    if (executor)
+    {
+        executor->task_done();
+    }
+    return {};
+}
+
+coro_task::~coro_task()
+{
+    // Tasks never handed to an executor are destroyed along with their owner
+    if (handle_)
+    {
+        handle_.destroy();
+    }
+}
+
+void coro_executor::yield_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+    node_.handle = h;
+    ex_.schedule(&node_);
+}
+
+coro_executor::coro_executor()
+    : epfd_(epoll_create1(EPOLL_CLOEXEC)), pending_(nullptr), live_tasks_(0)
+{
+    if (epfd_ < 0)
+    {
+        abort();
+    }
+}
+
+coro_executor::~coro_executor()
+{
+    close(epfd_);
+}
+
+void coro_executor::spawn(coro_task task)
+{
+    auto h = std::exchange(task.handle_, {});
+    h.promise().executor = this;
+    h.promise().node.handle = h;
+    live_tasks_++;
+    schedule(&h.promise().node);
+}
+
+bool coro_executor::run()
+{
+    while (live_tasks_ != 0)
+    {
+        // Resume everything that's ready. Coroutines scheduled meanwhile wait for the next round,
+        // so that channels get a chance to be served in between.
+        coro_queue round = std::exchange(ready_, {});
+        while (coro_node *node = round.pop())
+        {
+            node->handle.resume();
+        }
+
+        // Serve channels whose buffers may be available without waiting for an interrupt
+        while (coro_channel *ch = pending_)
+        {
+            pending_ = ch->next_pending_;
+            ch->pending_ = false;
+            ch->dispatch();
+        }
+
+        if (!ready_.empty() || (pending_ != nullptr) || (live_tasks_ == 0))
+        {
+            continue;
+        }
+
+        // Nothing left to do until a channel raises an interrupt
+        std::array<epoll_event, max_events> events;
+        int n = epoll_wait(epfd_, events.data(), max_events, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            static_cast<coro_channel *>(events[i].data.ptr)->on_readable();
+        }
+    }
+
+    return true;
+}
+
+void coro_executor::schedule(coro_node *node)
+{
+    ready_.push(node);
+}
+
+void coro_executor::set_pending(coro_channel *ch)
+{
+    if (!ch->pending_)
+    {
+        ch->pending_ = true;
+        ch->next_pending_ = pending_;
+        pending_ = ch;
+    }
+}
+
+bool coro_executor::watch(coro_channel *ch)
+{
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = ch;
+    return (epoll_ctl(epfd_, EPOLL_CTL_ADD, ch->dma_.fd(), &ev) == 0);
+}
+
+void coro_executor::unwatch(coro_channel *ch)
+{
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, ch->dma_.fd(), nullptr);
+
+    // Don't leave a dangling pointer behind in the pending list
+    for (coro_channel **it = &pending_; *it; it = &(*it)->next_pending_)
+    {
+        if (*it == ch)
+        {
+            *it = ch->next_pending_;
+            break;
+        }
+    }
+}
+
+void coro_executor::task_done()
+{
+    live_tasks_--;
+}
+
+coro_channel::coro_channel(coro_executor& ex, uaxidma& dma)
+    : ex_(ex), dma_(dma), next_pending_(nullptr), pending_(false), armed_(false)
+{
+    if (!ex_.watch(this))
+    {
+        abort();
+    }
+}
+
+coro_channel::~coro_channel()
+{
+    ex_.unwatch(this);
+}
+
+bool coro_channel::acquire_awaiter::await_ready()
+{
+    // Fast path: the next buffer is already completed and nobody else is waiting for it
+    if (!ch_.waiters_.empty())
+    {
+        return false;
+    }
+
+    result_ = ch_.dma_.get_buffer(0);
+    return (result_.first == acquisition_result::success)
+           || ((result_.first == acquisition_result::error) && (errno != EAGAIN));
+}
+
+void coro_channel::acquire_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+    node_.handle = h;
+    node_.owner = this;
+    ch_.waiters_.push(&node_);
+    ch_.ex_.set_pending(&ch_);
+}
+
+void coro_channel::submit_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+    ch_.dma_.submit_buffer(buf_);
+
+    // The buffer is back in the ring, which may unblock coroutines waiting for a TX slot
+    ch_.ex_.set_pending(&ch_);
+
+    node_.handle = h;
+    ch_.ex_.schedule(&node_);
+}
+
+void coro_channel::release(buffer& buf)
+{
+    dma_.mark_reusable(buf);
+    ex_.set_pending(this);
+}
+
+/**
+ * @brief Hands completed buffers over to waiting coroutines, and arms the interrupt if some of them
+ * still need to wait
+ */
+void coro_channel::dispatch()
+{
+    while (!waiters_.empty())
+    {
+        auto result = dma_.get_buffer(0);
+
+        if (result.first == acquisition_result::error)
+        {
+            if (errno == EAGAIN)
+            {
+                // Every buffer is owned by the application: wait until one is released
+                return;
+            }
+        }
+        else if (result.first == acquisition_result::timeout)
+        {
+            if (armed_)
+            {
+                return;
+            }
+
+            const auto armed = dma_.arm();
+            if (armed == uaxidma::arm_result::armed)
+            {
+                armed_ = true;
+                return;
+            }
+            if (armed == uaxidma::arm_result::ready)
+            {
+                // A buffer completed in the meantime
+                continue;
+            }
+
+            // No completion would ever wake the waiters up: fail them all
+            result = {acquisition_result::error, nullptr};
+            while (!waiters_.empty())
+            {
+                coro_node *node = waiters_.pop();
+                static_cast<acquire_awaiter *>(node->owner)->result_ = result;
+                ex_.schedule(node);
+            }
+            return;
+        }
+
+        coro_node *node = waiters_.pop();
+        static_cast<acquire_awaiter *>(node->owner)->result_ = result;
+        ex_.schedule(node);
+    }
+}
+
+/**
+ * @brief Consumes the interrupt and serves waiting coroutines
+ */
+void coro_channel::on_readable()
+{
+    armed_ = false;
+    dma_.on_readable();
+    dispatch();
+}
@@ -0,0 +1,257 @@
+#include "uaxidma_dispatch.h"
+#include <array>
+#include <errno.h>
+#include <stdlib.h>
+
+static constexpr std::size_t dispatch_batch = 64;
+static constexpr int dispatch_timeout_ms = 1;
+static constexpr unsigned worker_spin_limit = 1024;
+
+static inline void cpu_relax()
+{
+#if defined(__ARM_ARCH)
+    asm volatile("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+    asm volatile("pause" ::: "memory");
+#endif
+}
+
+uaxidma_dispatcher::uaxidma_dispatcher(uaxidma& dma, std::size_t workers, handler process, flow_function flow,
+                                       std::size_t queue_depth)
+    : dma_(dma), process_(std::move(process)), flow_(std::move(flow)),
+      returns_((flow_ ? workers : 1) * queue_depth + dispatch_batch), worker_count_(workers),
+      running_(false), live_workers_(0), dispatched_(0), released_(0), stalls_(0)
+{
+    if ((workers == 0) || (queue_depth == 0) || !process_)
+    {
+        abort();
+    }
+
+    const std::size_t queue_count = flow_ ? workers : 1;
+    for (std::size_t i = 0; i < queue_count; i++)
+    {
+        queues_.push_back(std::make_unique<work_queue>(queue_depth));
+    }
+}
+
+uaxidma_dispatcher::~uaxidma_dispatcher()
+{
+    stop();
+}
+
+bool uaxidma_dispatcher::start()
+{
+    if (running_.exchange(true))
+    {
+        return false;
+    }
+
+    live_workers_.store(worker_count_);
+    for (std::size_t i = 0; i < worker_count_; i++)
+    {
+        workers_.emplace_back(&uaxidma_dispatcher::worker_loop, this, i);
+    }
+    dispatcher_ = std::thread(&uaxidma_dispatcher::dispatch_loop, this);
+
+    return true;
+}
+
+void uaxidma_dispatcher::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+
+    for (auto& q : queues_)
+    {
+        wake(*q, true);
+    }
+
+    dispatcher_.join();
+
+    // Workers may still be releasing buffers while finishing their current one
+    while (live_workers_.load() != 0)
+    {
+        drain_returns();
+        std::this_thread::yield();
+    }
+    for (auto& w : workers_)
+    {
+        w.join();
+    }
+    workers_.clear();
+
+    // Nobody is left to process queued buffers: give them back to the ring along with released ones
+    for (auto& q : queues_)
+    {
+        buffer *buf;
+        while (q->items.try_pop(buf))
+        {
+            dma_.mark_reusable(*buf);
+        }
+    }
+    drain_returns();
+}
+
+void uaxidma_dispatcher::release(buffer& buf)
+{
+    while (!returns_.try_push(&buf))
+    {
+        std::this_thread::yield();
+    }
+}
+
+uaxidma_dispatcher::stats uaxidma_dispatcher::get_stats() const
+{
+    return { dispatched_.load(std::memory_order_relaxed),
+             released_.load(std::memory_order_relaxed),
+             stalls_.load(std::memory_order_relaxed) };
+}
+
+/**
+ * @brief Returns every buffer released by the workers to the ring, moving the tail descriptor once
+ */
+void uaxidma_dispatcher::drain_returns()
+{
+    std::array<buffer*, dispatch_batch> bufs;
+    std::size_t count;
+
+    do
+    {
+        count = 0;
+        while ((count < bufs.size()) && returns_.try_pop(bufs[count]))
+        {
+            count++;
+        }
+
+        if (count != 0)
+        {
+            dma_.mark_reusable(std::span{bufs.data(), count});
+            released_.fetch_add(count, std::memory_order_relaxed);
+        }
+    } while (count == bufs.size());
+}
+
+void uaxidma_dispatcher::dispatch_loop()
+{
+    std::array<buffer*, dispatch_batch> bufs;
+
+    while (running_.load(std::memory_order_relaxed))
+    {
+        drain_returns();
+
+        const auto [res, count] = dma_.get_buffers(bufs, dispatch_timeout_ms);
+        if (res == uaxidma::acquisition_result::error)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR))
+            {
+                // Every buffer is held by the workers: wait for some of them to be released
+                std::this_thread::yield();
+                continue;
+            }
+            return;
+        }
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            work_queue& q = flow_ ? *queues_[flow_(*bufs[i]) % queues_.size()] : *queues_[0];
+            if (!push(q, bufs[i]))
+            {
+                dma_.mark_reusable(*bufs[i]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Hands a buffer to the workers, waiting for room in the queue if needed
+ * @return false if the dispatcher was stopped before the buffer could be queued
+ */
+bool uaxidma_dispatcher::push(work_queue& q, buffer *buf)
+{
+    if (!q.items.try_push(buf))
+    {
+        stalls_.fetch_add(1, std::memory_order_relaxed);
+        do
+        {
+            if (!running_.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+            // Workers may be waiting for room in the return queue
+            drain_returns();
+            std::this_thread::yield();
+        } while (!q.items.try_push(buf));
+    }
+
+    dispatched_.fetch_add(1, std::memory_order_relaxed);
+    wake(q, false);
+    return true;
+}
+
+/**
+ * @brief Takes the next buffer from a queue, sleeping if there's none
+ * @return nullptr if the dispatcher was stopped
+ */
+uaxidma_dispatcher::buffer *uaxidma_dispatcher::pop(work_queue& q)
+{
+    buffer *buf;
+
+    for (unsigned i = 0; i < worker_spin_limit; i++)
+    {
+        if (q.items.try_pop(buf))
+        {
+            return buf;
+        }
+        cpu_relax();
+    }
+
+    while (true)
+    {
+        // Register as a sleeper before the last check, so that a concurrent push either is seen by
+        // try_pop() or changes the signal value before we go to sleep on it
+        q.sleepers.fetch_add(1);
+        const uint32_t seen = q.signal.load();
+        const bool popped = q.items.try_pop(buf);
+        if (!popped && running_.load())
+        {
+            q.signal.wait(seen);
+        }
+        q.sleepers.fetch_sub(1);
+
+        if (popped || q.items.try_pop(buf))
+        {
+            return buf;
+        }
+        if (!running_.load())
+        {
+            return nullptr;
+        }
+    }
+}
+
+void uaxidma_dispatcher::wake(work_queue& q, bool all)
+{
+    q.signal.fetch_add(1);
+    if (all)
+    {
+        q.signal.notify_all();
+    }
+    else if (q.sleepers.load() != 0)
+    {
+        q.signal.notify_one();
+    }
+}
+
+void uaxidma_dispatcher::worker_loop(std::size_t id)
+{
+    work_queue& q = flow_ ? *queues_[id] : *queues_[0];
+
+    while (buffer *buf = pop(q))
+    {
+        process_(*buf, id);
+    }
+
+    live_workers_.fetch_sub(1);
+}
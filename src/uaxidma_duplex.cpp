@@ -0,0 +1,91 @@
+#include "uaxidma_duplex.h"
+#include <algorithm>
+#include <chrono>
+
+uaxidma_duplex::uaxidma_duplex(const std::string& udmabuf_name, size_t udmabuf_size,
+                               const std::string& axidma_uio_name, size_t tx_region_size,
+                               size_t tx_buffer_size, size_t rx_buffer_size, dma_mode rx_mode,
+                               const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : core_{std::make_shared<axi_dma::core>(udmabuf_name, udmabuf_size, axidma_uio_name)},
+      tx_{core_, 0, tx_region_size, dma_mode::normal, uaxidma::transfer_direction::mem_to_dev,
+          tx_buffer_size, coalescing, alignment},
+      rx_{core_, tx_region_size, 0, rx_mode, uaxidma::transfer_direction::dev_to_mem,
+          rx_buffer_size, coalescing, alignment}
+{
+}
+
+bool uaxidma_duplex::initialize()
+{
+    // A single reset for the whole core, so that starting one direction never disturbs the other one
+    if (!core_->map() || !core_->reset())
+    {
+        return false;
+    }
+
+    return tx_.initialize() && rx_.initialize();
+}
+
+uaxidma& uaxidma_duplex::tx()
+{
+    return tx_;
+}
+
+uaxidma& uaxidma_duplex::rx()
+{
+    return rx_;
+}
+
+std::pair<uaxidma_duplex::acquisition_result, uaxidma_duplex::readiness> uaxidma_duplex::wait(int timeout, readiness directions)
+{
+    using std::chrono::steady_clock;
+
+    const bool forever = (timeout < 0);
+    const auto deadline = steady_clock::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+
+    while (true)
+    {
+        // Clears the interrupt flags of both directions, as they share the interrupt line
+        tx_.axidma.clean_interrupt();
+
+        readiness ready = {directions.tx && tx_.next_completed(), directions.rx && rx_.next_completed()};
+        if (ready.tx || ready.rx)
+        {
+            return {acquisition_result::success, ready};
+        }
+
+        if (timeout == 0)
+        {
+            return {acquisition_result::timeout, ready};
+        }
+
+        int remaining = -1;
+        if (!forever)
+        {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - steady_clock::now());
+            remaining = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+        }
+
+        // Either direction can be used to wait, as both share the UIO device
+        const auto poll_ret = tx_.axidma.poll_interrupt(remaining);
+        if (poll_ret != axi_dma::acquisition_result::success)
+        {
+            return {static_cast<acquisition_result>(poll_ret), {false, false}};
+        }
+
+        // Demultiplex the interrupt: account the wakeup to the directions that made progress
+        ready = {directions.tx && tx_.next_completed(), directions.rx && rx_.next_completed()};
+        if (ready.tx)
+        {
+            tx_.account_wakeup();
+        }
+        if (ready.rx)
+        {
+            rx_.account_wakeup();
+        }
+        if (ready.tx || ready.rx)
+        {
+            return {acquisition_result::success, ready};
+        }
+    }
+}
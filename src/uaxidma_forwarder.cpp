@@ -0,0 +1,516 @@
+#include "uaxidma_forwarder.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+
+// Wakes the forwarder thread up now and then to notice it's been stopped
+static constexpr int forward_timeout_ms = 10;
+
+// How long stop() waits for the zero-copy completions of the buffers sent
+static constexpr auto drain_timeout = std::chrono::seconds(1);
+
+uaxidma_forwarder::uaxidma_forwarder(uaxidma& dma, int socket, const config& cfg)
+    : dma_(dma), socket_(socket), cfg_(cfg), stream_(false), zerocopy_(false), next_id_(0), completed_upto_(0),
+      armed_(false), blocked_on_(0), running_(false), buffers_(0), bytes_(0), send_calls_(0), copied_sends_(0),
+      send_errors_(0), would_block_(0), last_error_(0)
+{
+    if ((cfg_.batch_size == 0) || (cfg_.max_in_flight == 0))
+    {
+        abort();
+    }
+}
+
+uaxidma_forwarder::~uaxidma_forwarder()
+{
+    stop();
+    reclaim();
+}
+
+bool uaxidma_forwarder::start()
+{
+    if (running_.load())
+    {
+        errno = EALREADY;
+        return false;
+    }
+
+    int type = 0;
+    socklen_t type_len = sizeof(type);
+    if (getsockopt(socket_, SOL_SOCKET, SO_TYPE, &type, &type_len) < 0)
+    {
+        return false;
+    }
+    stream_ = (type == SOCK_STREAM);
+
+    // Sockets without zero-copy support, e.g. UNIX ones, reject the option: sends copy the buffers then
+    const int one = 1;
+    zerocopy_ = cfg_.zerocopy && (setsockopt(socket_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0);
+
+    // Buffers left in flight by an earlier run keep their notification ids, which go on from where they were
+    unsent_.clear();
+    done_.clear();
+    done_.reserve(cfg_.max_in_flight);
+    iovs_.assign(cfg_.batch_size, {});
+    msgs_.assign(cfg_.batch_size, {});
+    armed_ = false;
+    blocked_on_ = 0;
+
+    running_.store(true);
+    forwarder_ = std::thread(&uaxidma_forwarder::forward_loop, this);
+    return true;
+}
+
+void uaxidma_forwarder::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+
+    forwarder_.join();
+}
+
+bool uaxidma_forwarder::zerocopy() const
+{
+    return zerocopy_;
+}
+
+uaxidma_forwarder::stats uaxidma_forwarder::get_stats() const
+{
+    return { buffers_.load(std::memory_order_relaxed),
+             bytes_.load(std::memory_order_relaxed),
+             send_calls_.load(std::memory_order_relaxed),
+             copied_sends_.load(std::memory_order_relaxed),
+             send_errors_.load(std::memory_order_relaxed),
+             would_block_.load(std::memory_order_relaxed) };
+}
+
+std::size_t uaxidma_forwarder::reclaim()
+{
+    if (running_.load())
+    {
+        // Application logic error: the forwarder thread owns the buffers
+        abort();
+    }
+
+    if (zerocopy_)
+    {
+        read_notifications();
+        release_completed();
+    }
+    flush_done();
+    return in_flight_.size();
+}
+
+int uaxidma_forwarder::get_last_error() const
+{
+    return last_error_.load(std::memory_order_relaxed);
+}
+
+void uaxidma_forwarder::forward_loop()
+{
+    std::vector<buffer*> acquired(cfg_.max_in_flight);
+    bool acquiring = true;
+    auto drain_deadline = std::chrono::steady_clock::time_point::max();
+
+    while (true)
+    {
+        // Take care of every completion first, so that ring buffers are freed before acquiring
+        if (zerocopy_)
+        {
+            read_notifications();
+            release_completed();
+        }
+
+        if (acquiring && !running_.load(std::memory_order_relaxed))
+        {
+            acquiring = false;
+            drain_deadline = std::chrono::steady_clock::now() + drain_timeout;
+        }
+        if (!acquiring && (std::chrono::steady_clock::now() >= drain_deadline))
+        {
+            // The completions may never come, e.g. if the peer stopped reading: stop waiting for them, but keep
+            // the buffers the kernel may still read out of the ring, see reclaim()
+            drop_unsent(ETIMEDOUT);
+            break;
+        }
+
+        size_t count = 0;
+        if (acquiring && (unsent_.size() + in_flight_.size() < cfg_.max_in_flight))
+        {
+            const size_t room = cfg_.max_in_flight - unsent_.size() - in_flight_.size();
+            uaxidma::acquisition_result res;
+            std::tie(res, count) = dma_.get_buffers(std::span{acquired.data(), room}, 0);
+            if ((res == uaxidma::acquisition_result::error) && (errno != EAGAIN) && (errno != EINTR))
+            {
+                // The channel is unusable: finish sending what's held and quit
+                last_error_.store(errno, std::memory_order_relaxed);
+                acquiring = false;
+                drain_deadline = std::chrono::steady_clock::now() + drain_timeout;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                // Empty buffers have nothing to send, and zero-copy notifications don't account for them
+                if (acquired[i]->length() == 0)
+                {
+                    done_.push_back(acquired[i]);
+                    continue;
+                }
+                unsent_.push_back({acquired[i], 0, 0});
+            }
+        }
+
+        // Send as long as the socket takes data
+        blocked_on_ = 0;
+        while (!unsent_.empty() && (blocked_on_ == 0))
+        {
+            if (!(stream_ ? send_stream() : send_datagrams()))
+            {
+                // The connection is gone: nothing more can be sent
+                drop_unsent(last_error_.load(std::memory_order_relaxed));
+                acquiring = false;
+                drain_deadline = std::min(drain_deadline, std::chrono::steady_clock::now() + drain_timeout);
+            }
+        }
+
+        flush_done();
+
+        if (!acquiring && unsent_.empty() && in_flight_.empty())
+        {
+            break;
+        }
+
+        // Go on right away while buffers keep completing and the socket takes them
+        const bool full = (unsent_.size() + in_flight_.size() >= cfg_.max_in_flight);
+        if (acquiring && (count != 0) && !full && (blocked_on_ == 0))
+        {
+            continue;
+        }
+
+        // Sleep on the channel interrupt if there's room for more buffers, and on the socket. Zero-copy
+        // completions raise POLLERR, which is always reported.
+        pollfd fds[2] = {{socket_, blocked_on_, 0}, {dma_.fd(), POLLIN, 0}};
+        nfds_t nfds = 1;
+        if (acquiring && !full)
+        {
+            const auto armed = armed_ ? uaxidma::arm_result::armed : dma_.arm();
+            if (armed == uaxidma::arm_result::ready)
+            {
+                // A buffer completed in the meantime
+                continue;
+            }
+            if (armed == uaxidma::arm_result::error)
+            {
+                // No completion would ever be notified: finish sending what's held and quit
+                last_error_.store(errno, std::memory_order_relaxed);
+                acquiring = false;
+                drain_deadline = std::min(drain_deadline, std::chrono::steady_clock::now() + drain_timeout);
+                continue;
+            }
+            armed_ = true;
+            nfds = 2;
+        }
+
+        if (poll(fds, nfds, forward_timeout_ms) < 0)
+        {
+            if (errno != EINTR)
+            {
+                last_error_.store(errno, std::memory_order_relaxed);
+                acquiring = false;
+                drain_deadline = std::min(drain_deadline, std::chrono::steady_clock::now() + drain_timeout);
+            }
+            continue;
+        }
+
+        if ((nfds == 2) && (fds[1].revents & POLLIN))
+        {
+            armed_ = false;
+            if (dma_.on_readable() != uaxidma::acquisition_result::success)
+            {
+                last_error_.store(errno, std::memory_order_relaxed);
+                acquiring = false;
+                drain_deadline = std::min(drain_deadline, std::chrono::steady_clock::now() + drain_timeout);
+            }
+        }
+
+        if (fds[0].revents & POLLERR)
+        {
+            read_notifications();
+
+            // A pending socket error, e.g. an ICMP port unreachable on UDP, would keep POLLERR raised
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            if ((getsockopt(socket_, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0) && (err != 0))
+            {
+                last_error_.store(err, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    flush_done();
+}
+
+/**
+ * @brief Sends the oldest unsent buffers as one datagram each
+ * @return always true: a datagram that can't be sent is dropped, the next ones may go through
+ */
+bool uaxidma_forwarder::send_datagrams()
+{
+    const size_t n = std::min(cfg_.batch_size, unsent_.size());
+    for (size_t i = 0; i < n; i++)
+    {
+        buffer *buf = unsent_[i].buf;
+        iovs_[i] = {buf->data(), buf->length()};
+        msgs_[i] = {};
+        msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int flags = MSG_DONTWAIT | (zerocopy_ ? MSG_ZEROCOPY : 0);
+    const int ret = sendmmsg(socket_, msgs_.data(), static_cast<unsigned>(n), flags);
+    if (ret < 0)
+    {
+        if (send_failed(errno))
+        {
+            return true;
+        }
+
+        // The datagram is rejected, e.g. for being too large, or because of an earlier ICMP error
+        send_errors_.fetch_add(1, std::memory_order_relaxed);
+        done_.push_back(unsent_.front().buf);
+        unsent_.pop_front();
+        return true;
+    }
+
+    if (ret != 0)
+    {
+        send_calls_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Each datagram is a send of its own, with its own notification id
+    for (int i = 0; i < ret; i++)
+    {
+        held_buffer& held = unsent_.front();
+        held.sent = msgs_[i].msg_len;
+        bytes_.fetch_add(held.sent, std::memory_order_relaxed);
+        sent(held, zerocopy_ ? take_id() : 0);
+        unsent_.pop_front();
+    }
+    return true;
+}
+
+/**
+ * @brief Sends the oldest unsent buffers, or what's left of them, with a single call
+ * @return false if the connection failed, with the error stored
+ */
+bool uaxidma_forwarder::send_stream()
+{
+    // sendmmsg() would carry on with the next buffers after a partial send, breaking the stream: gather them
+    // in a single message instead
+    const size_t n = std::min(cfg_.batch_size, unsent_.size());
+    for (size_t i = 0; i < n; i++)
+    {
+        const held_buffer& held = unsent_[i];
+        iovs_[i] = {held.buf->data() + held.sent, held.buf->length() - held.sent};
+    }
+
+    msghdr msg {};
+    msg.msg_iov = iovs_.data();
+    msg.msg_iovlen = n;
+
+    const int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (zerocopy_ ? MSG_ZEROCOPY : 0);
+    const ssize_t ret = sendmsg(socket_, &msg, flags);
+    if (ret < 0)
+    {
+        return send_failed(errno);
+    }
+
+    send_calls_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(static_cast<uint64_t>(ret), std::memory_order_relaxed);
+
+    // Every byte of the call goes with one notification id
+    const uint32_t id = zerocopy_ ? take_id() : 0;
+    size_t left = static_cast<size_t>(ret);
+    while (left != 0)
+    {
+        held_buffer& held = unsent_.front();
+        const size_t taken = std::min(left, held.buf->length() - held.sent);
+        held.sent += taken;
+        held.last_id = id;
+        left -= taken;
+
+        if (held.sent < held.buf->length())
+        {
+            break;
+        }
+        sent(held, id);
+        unsent_.pop_front();
+    }
+    return true;
+}
+
+/**
+ * @brief Handles a failed send call
+ * @return true if the socket is only busy, and sending shall resume when it's ready again
+ */
+bool uaxidma_forwarder::send_failed(int err)
+{
+    if (err == EINTR)
+    {
+        return true;
+    }
+
+    if ((err == EAGAIN) || (err == EWOULDBLOCK) || (err == ENOBUFS))
+    {
+        // Zero-copy sends are also limited by the notifications not read yet: ENOBUFS then clears as
+        // completions are read from the error queue
+        blocked_on_ = (zerocopy_ && (err == ENOBUFS) && !in_flight_.empty()) ? POLLERR : POLLOUT;
+        would_block_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    last_error_.store(err, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Returns the notification id of the zero-copy send that just succeeded
+ * The kernel numbers the zero-copy sends of a socket from 0, and reports their completions in ranges of ids.
+ */
+uint32_t uaxidma_forwarder::take_id()
+{
+    completed_ids_.push_back(false);
+    return next_id_++;
+}
+
+/**
+ * @brief Hands a buffer whose last byte was just sent over to the zero-copy completion, or returns it to the
+ * ring if the kernel copied it already
+ */
+void uaxidma_forwarder::sent(held_buffer& held, uint32_t id)
+{
+    if (!zerocopy_)
+    {
+        buffers_.fetch_add(1, std::memory_order_relaxed);
+        done_.push_back(held.buf);
+        return;
+    }
+
+    held.last_id = id;
+    in_flight_.push_back(held);
+}
+
+/**
+ * @brief Drops every buffer not entirely sent yet
+ * @param err stored as the last error
+ */
+void uaxidma_forwarder::drop_unsent(int err)
+{
+    for (const auto& held : unsent_)
+    {
+        send_errors_.fetch_add(1, std::memory_order_relaxed);
+
+        // Part of it may still be referenced by a zero-copy send
+        if (zerocopy_ && (held.sent != 0))
+        {
+            in_flight_.push_back(held);
+            continue;
+        }
+        done_.push_back(held.buf);
+    }
+
+    if (!unsent_.empty())
+    {
+        last_error_.store(err, std::memory_order_relaxed);
+    }
+    unsent_.clear();
+}
+
+/**
+ * @brief Reads the zero-copy completions queued on the socket error queue
+ */
+void uaxidma_forwarder::read_notifications()
+{
+    while (true)
+    {
+        alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(sock_extended_err))];
+        msghdr msg {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(socket_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return;
+        }
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            const bool recverr = ((cm->cmsg_level == SOL_IP) && (cm->cmsg_type == IP_RECVERR))
+                                 || ((cm->cmsg_level == SOL_IPV6) && (cm->cmsg_type == IPV6_RECVERR));
+            if (!recverr)
+            {
+                continue;
+            }
+
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            // Notifications cover the ids from ee_info to ee_data, both included
+            const uint32_t count = err.ee_data - err.ee_info + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                copied_sends_.fetch_add(count, std::memory_order_relaxed);
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const uint32_t index = err.ee_info + i - completed_upto_;
+                if (index < completed_ids_.size())
+                {
+                    completed_ids_[index] = true;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Hands the buffers whose zero-copy sends all completed over to flush_done()
+ */
+void uaxidma_forwarder::release_completed()
+{
+    while (!completed_ids_.empty() && completed_ids_.front())
+    {
+        completed_ids_.pop_front();
+        completed_upto_++;
+    }
+
+    // Buffers are sent in order, so that ids grow along in_flight_
+    while (!in_flight_.empty() && (static_cast<int32_t>(in_flight_.front().last_id - completed_upto_) < 0))
+    {
+        buffers_.fetch_add(1, std::memory_order_relaxed);
+        done_.push_back(in_flight_.front().buf);
+        in_flight_.pop_front();
+    }
+}
+
+/**
+ * @brief Returns the buffers done with to the ring
+ */
+void uaxidma_forwarder::flush_done()
+{
+    if (!done_.empty())
+    {
+        dma_.mark_reusable(std::span{done_.data(), done_.size()});
+        done_.clear();
+    }
+}
@@ -0,0 +1,539 @@
+#include "uaxidma_recorder.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Wakes the recorder thread up now and then to notice it's been stopped
+static constexpr int record_timeout_ms = 10;
+
+// Tags the completion of the poll on the channel interrupt, write completions carry their slot
+static constexpr uint64_t interrupt_tag = ~0ULL;
+
+bool uaxidma_recorder::io_ring::setup(unsigned entries)
+{
+    io_uring_params params {};
+    const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // Timed waits need the extended io_uring_enter() arguments
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        close(fd);
+        errno = ENOSYS;
+        return false;
+    }
+
+    fd_ = fd;
+    sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_map_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+              ? sq_map_
+              : mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if ((sq_map_ == MAP_FAILED) || (cq_map_ == MAP_FAILED) || (sqes == MAP_FAILED))
+    {
+        const int err = errno;
+        sq_map_ = (sq_map_ == MAP_FAILED) ? nullptr : sq_map_;
+        cq_map_ = (cq_map_ == MAP_FAILED) ? nullptr : cq_map_;
+        sqes_ = (sqes == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe *>(sqes);
+        teardown();
+        errno = err;
+        return false;
+    }
+
+    uint8_t *sq = static_cast<uint8_t *>(sq_map_);
+    uint8_t *cq = static_cast<uint8_t *>(cq_map_);
+    sq_head_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_entries);
+    sq_array_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+    to_submit_ = 0;
+
+    return true;
+}
+
+void uaxidma_recorder::io_ring::teardown()
+{
+    if (sqes_)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_map_ && (cq_map_ != sq_map_))
+    {
+        munmap(cq_map_, cq_map_size_);
+    }
+    if (sq_map_)
+    {
+        munmap(sq_map_, sq_map_size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+
+    *this = io_ring{};
+}
+
+io_uring_sqe *uaxidma_recorder::io_ring::get_sqe()
+{
+    // The kernel consumes entries up to the head, the ones queued since the last submission sit after it
+    const uint32_t head = std::atomic_ref<uint32_t>{*sq_head_}.load(std::memory_order_acquire);
+    const uint32_t tail = *sq_tail_ + to_submit_;
+    if (tail - head >= sq_entries_)
+    {
+        return nullptr;
+    }
+
+    const uint32_t index = tail & sq_mask_;
+    sq_array_[index] = index;
+    to_submit_++;
+
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool uaxidma_recorder::io_ring::submit(unsigned wait_nr, int timeout_ms)
+{
+    // Entries are visible to the kernel before the tail covering them. Those a busy kernel didn't consume
+    // earlier still sit between the head and the tail, and go along.
+    const uint32_t tail = *sq_tail_ + to_submit_;
+    std::atomic_ref<uint32_t>{*sq_tail_}.store(tail, std::memory_order_release);
+    to_submit_ = 0;
+    const uint32_t submitted = tail - std::atomic_ref<uint32_t>{*sq_head_}.load(std::memory_order_acquire);
+
+    __kernel_timespec ts {};
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000LL;
+    io_uring_getevents_arg arg {};
+    arg.ts = reinterpret_cast<uintptr_t>(&ts);
+
+    const unsigned flags = (wait_nr != 0) ? (IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG) : IORING_ENTER_EXT_ARG;
+    const long ret = syscall(__NR_io_uring_enter, fd_, submitted, wait_nr, flags, &arg, sizeof(arg));
+    return (ret >= 0) || (errno == ETIME) || (errno == EINTR) || (errno == EBUSY) || (errno == EAGAIN);
+}
+
+io_uring_cqe *uaxidma_recorder::io_ring::peek_cqe()
+{
+    const uint32_t head = *cq_head_;
+    if (head == std::atomic_ref<uint32_t>{*cq_tail_}.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    return &cqes_[head & cq_mask_];
+}
+
+void uaxidma_recorder::io_ring::cqe_seen()
+{
+    std::atomic_ref<uint32_t>{*cq_head_}.store(*cq_head_ + 1, std::memory_order_release);
+}
+
+uaxidma_recorder::uaxidma_recorder(uaxidma& dma, const std::string& path, const config& cfg)
+    : dma_(dma), path_(path), cfg_(cfg), direct_fd_(-1), direct_failed_(false), direct_in_flight_(0),
+      buffered_fd_(-1), offset_(0), polling_(false),
+      running_(false), buffers_(0), bytes_(0), buffered_writes_(0), write_errors_(0), queue_full_(0), last_error_(0)
+{
+    if ((cfg_.queue_depth == 0) || (cfg_.block_size == 0))
+    {
+        abort();
+    }
+}
+
+uaxidma_recorder::~uaxidma_recorder()
+{
+    stop();
+}
+
+bool uaxidma_recorder::start()
+{
+    if (running_.load())
+    {
+        errno = EALREADY;
+        return false;
+    }
+
+    buffered_fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (buffered_fd_ < 0)
+    {
+        return false;
+    }
+
+    // Some file systems don't support O_DIRECT: everything goes through the page cache then
+    if (cfg_.direct)
+    {
+        direct_fd_ = open(path_.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+    }
+
+    // Room for every write and the poll on the interrupt
+    if (!ring_.setup(static_cast<unsigned>(cfg_.queue_depth + 1)))
+    {
+        const int err = errno;
+        close(buffered_fd_);
+        buffered_fd_ = -1;
+        if (direct_fd_ >= 0)
+        {
+            close(direct_fd_);
+            direct_fd_ = -1;
+        }
+        errno = err;
+        return false;
+    }
+
+    direct_failed_ = false;
+    direct_in_flight_ = 0;
+    offset_ = 0;
+    polling_ = false;
+    slots_.assign(cfg_.queue_depth, {});
+    free_slots_.clear();
+    for (std::size_t i = cfg_.queue_depth; i != 0; i--)
+    {
+        free_slots_.push_back(i - 1);
+    }
+    done_.clear();
+    done_.reserve(cfg_.queue_depth);
+    reaped_.clear();
+
+    running_.store(true);
+    recorder_ = std::thread(&uaxidma_recorder::record_loop, this);
+    return true;
+}
+
+void uaxidma_recorder::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+
+    recorder_.join();
+
+    // Closing the instance cancels the poll on the interrupt: every write completed already
+    ring_.teardown();
+    fdatasync(buffered_fd_);
+    if (direct_fd_ >= 0)
+    {
+        close(direct_fd_);
+        direct_fd_ = -1;
+    }
+    close(buffered_fd_);
+    buffered_fd_ = -1;
+}
+
+uaxidma_recorder::stats uaxidma_recorder::get_stats() const
+{
+    return { buffers_.load(std::memory_order_relaxed),
+             bytes_.load(std::memory_order_relaxed),
+             buffered_writes_.load(std::memory_order_relaxed),
+             write_errors_.load(std::memory_order_relaxed),
+             queue_full_.load(std::memory_order_relaxed) };
+}
+
+int uaxidma_recorder::get_last_error() const
+{
+    return last_error_.load(std::memory_order_relaxed);
+}
+
+void uaxidma_recorder::record_loop()
+{
+    std::vector<buffer*> acquired(cfg_.queue_depth);
+    bool acquiring = true;
+
+    while (true)
+    {
+        // Take care of every completion first, so that write slots and ring buffers are freed before acquiring
+        while (!reaped_.empty())
+        {
+            const auto [tag, res] = reaped_.front();
+            reaped_.pop_front();
+            handle_completion(tag, res);
+        }
+        while (io_uring_cqe *cqe = ring_.peek_cqe())
+        {
+            const uint64_t tag = cqe->user_data;
+            const int res = cqe->res;
+            ring_.cqe_seen();
+            handle_completion(tag, res);
+        }
+
+        if (!done_.empty())
+        {
+            dma_.mark_reusable(std::span{done_.data(), done_.size()});
+            done_.clear();
+        }
+
+        acquiring = acquiring && running_.load(std::memory_order_relaxed);
+        if (!acquiring && (free_slots_.size() == cfg_.queue_depth))
+        {
+            break;
+        }
+
+        if (acquiring)
+        {
+            while (!free_slots_.empty())
+            {
+                const auto [res, count] = dma_.get_buffers(std::span{acquired.data(), free_slots_.size()}, 0);
+                if (res == uaxidma::acquisition_result::error)
+                {
+                    if ((errno != EAGAIN) && (errno != EINTR))
+                    {
+                        // The channel is unusable: finish the writes in flight and quit
+                        last_error_.store(errno, std::memory_order_relaxed);
+                        acquiring = false;
+                    }
+                    break;
+                }
+
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    submit_write(*acquired[i]);
+                }
+
+                if (count == 0)
+                {
+                    // Nothing completed: sleep on the interrupt along with the writes, unless a buffer
+                    // completed in the meantime
+                    const auto armed = polling_ ? uaxidma::arm_result::armed : dma_.arm();
+                    if (armed == uaxidma::arm_result::error)
+                    {
+                        // No completion would ever be notified: finish the writes in flight and quit
+                        last_error_.store(errno, std::memory_order_relaxed);
+                        acquiring = false;
+                        break;
+                    }
+                    if (armed == uaxidma::arm_result::armed)
+                    {
+                        arm_interrupt();
+                        break;
+                    }
+                }
+            }
+
+            if (free_slots_.empty())
+            {
+                // Received buffers have to wait for the disk
+                queue_full_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (!ring_.submit(1, record_timeout_ms))
+        {
+            last_error_.store(errno, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Dispatches a completion to the operation it belongs to
+ */
+void uaxidma_recorder::handle_completion(uint64_t tag, int res)
+{
+    if (tag == interrupt_tag)
+    {
+        polling_ = false;
+        dma_.on_readable();
+    }
+    else
+    {
+        complete_write(static_cast<std::size_t>(tag), res);
+    }
+}
+
+/**
+ * @brief Returns a submission queue entry, making room for it if needed
+ * There's one entry per write slot plus one for the poll, but the kernel may leave submitted entries in the
+ * queue, e.g. when short of room for their completions.
+ * @return nullptr on errors, with the error stored
+ */
+io_uring_sqe *uaxidma_recorder::get_sqe()
+{
+    io_uring_sqe *sqe = ring_.get_sqe();
+    while (sqe == nullptr)
+    {
+        // Completions are only set aside, as handling them may queue more writes
+        while (io_uring_cqe *cqe = ring_.peek_cqe())
+        {
+            reaped_.emplace_back(cqe->user_data, cqe->res);
+            ring_.cqe_seen();
+        }
+
+        if (!ring_.submit(0, 0))
+        {
+            last_error_.store(errno, std::memory_order_relaxed);
+            return nullptr;
+        }
+        sqe = ring_.get_sqe();
+        if (sqe == nullptr)
+        {
+            // Still busy: wait for something to complete
+            ring_.submit(1, record_timeout_ms);
+            sqe = ring_.get_sqe();
+        }
+    }
+    return sqe;
+}
+
+/**
+ * @brief Queues the write of a buffer just acquired at the end of the file
+ */
+void uaxidma_recorder::submit_write(buffer& buf)
+{
+    const std::size_t len = buf.length();
+    if (len == 0)
+    {
+        done_.push_back(&buf);
+        return;
+    }
+
+    const std::size_t slot = free_slots_.back();
+    free_slots_.pop_back();
+
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(buf.data());
+    const bool aligned = ((addr | len | offset_) % cfg_.block_size) == 0;
+    slots_[slot] = {&buf, offset_, 0, (direct_fd_ >= 0) && !direct_failed_ && aligned};
+    offset_ += len;
+
+    queue_write(slot);
+}
+
+/**
+ * @brief Queues the write of whatever is left of the buffer of a slot
+ */
+void uaxidma_recorder::queue_write(std::size_t slot)
+{
+    write_slot& w = slots_[slot];
+
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+        done_.push_back(w.buf);
+        free_slots_.push_back(slot);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = w.direct ? direct_fd_ : buffered_fd_;
+    sqe->addr = reinterpret_cast<uintptr_t>(w.buf->data() + w.done);
+    sqe->len = static_cast<uint32_t>(w.buf->length() - w.done);
+    sqe->off = w.offset + w.done;
+    sqe->user_data = slot;
+
+    if (w.direct)
+    {
+        direct_in_flight_++;
+    }
+    else
+    {
+        buffered_writes_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Accounts for the completion of a write, and either frees its buffer or writes what's left of it
+ * @param res of the write, as returned by write()
+ */
+void uaxidma_recorder::complete_write(std::size_t slot, int res)
+{
+    write_slot& w = slots_[slot];
+
+    // Once direct I/O turned out unsupported, its file descriptor goes with the last write using it
+    if (w.direct && (--direct_in_flight_ == 0) && direct_failed_ && (direct_fd_ >= 0))
+    {
+        close(direct_fd_);
+        direct_fd_ = -1;
+    }
+
+    if (res < 0)
+    {
+        if (w.direct && ((res == -EINVAL) || (res == -EFAULT) || (res == -EOPNOTSUPP)))
+        {
+            // The file system or the buffer mapping can't do direct I/O after all: stop trying, and close the
+            // file descriptor once no write uses it anymore
+            direct_failed_ = true;
+            if ((direct_in_flight_ == 0) && (direct_fd_ >= 0))
+            {
+                close(direct_fd_);
+                direct_fd_ = -1;
+            }
+            w.direct = false;
+            queue_write(slot);
+            return;
+        }
+
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+        last_error_.store(-res, std::memory_order_relaxed);
+    }
+    else
+    {
+        w.done += static_cast<std::size_t>(res);
+        if ((res != 0) && (w.done < w.buf->length()))
+        {
+            // Short write: the rest of the buffer is no longer aligned
+            w.direct = false;
+            queue_write(slot);
+            return;
+        }
+
+        if (w.done < w.buf->length())
+        {
+            write_errors_.fetch_add(1, std::memory_order_relaxed);
+            last_error_.store(ENOSPC, std::memory_order_relaxed);
+        }
+        else
+        {
+            buffers_.fetch_add(1, std::memory_order_relaxed);
+            bytes_.fetch_add(w.done, std::memory_order_relaxed);
+        }
+    }
+
+    done_.push_back(w.buf);
+    free_slots_.push_back(slot);
+}
+
+/**
+ * @brief Queues a poll on the channel interrupt, unless one is in flight already
+ */
+void uaxidma_recorder::arm_interrupt()
+{
+    if (polling_)
+    {
+        return;
+    }
+
+    // Without an entry, the recorder wakes up on the submission timeout instead
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = dma_.fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = interrupt_tag;
+    polling_ = true;
+}
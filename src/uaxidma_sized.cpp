@@ -0,0 +1,217 @@
+#include "uaxidma_sized.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <stdlib.h>
+
+uint8_t *uaxidma_sized_tx::buffer::data()
+{
+    return data_;
+}
+
+size_t uaxidma_sized_tx::buffer::length()
+{
+    return length_;
+}
+
+size_t uaxidma_sized_tx::buffer::capacity()
+{
+    return capacity_;
+}
+
+bool uaxidma_sized_tx::buffer::set_payload(size_t len)
+{
+    if (len > capacity_)
+    {
+        return false;
+    }
+
+    length_ = len;
+    return true;
+}
+
+uaxidma_sized_tx::uaxidma_sized_tx(const std::string& udmabuf_name, size_t udmabuf_size,
+                                   const std::string& axidma_uio_name, std::vector<size_class> classes,
+                                   const irq_coalescing& coalescing, buffer_alignment alignment)
+
+    : axidma{udmabuf_name, udmabuf_size, axidma_uio_name, axi_dma::dma_mode::normal,
+             axi_dma::transfer_direction::mm2s, 0, coalescing, alignment},
+      classes(std::move(classes)),
+      alignment(alignment),
+      oldest(0),
+      next(0),
+      pending(0)
+{
+    std::sort(this->classes.begin(), this->classes.end(),
+              [](const size_class& a, const size_class& b) { return a.buffer_size < b.buffer_size; });
+
+    for (const auto& c : this->classes)
+    {
+        if ((c.buffer_size == 0) || (c.buffer_size > sg_max_buf_len) || (c.count == 0))
+        {
+            abort();
+        }
+    }
+}
+
+bool uaxidma_sized_tx::initialize()
+{
+    size_t total = 0;
+    for (const auto& c : classes)
+    {
+        total += c.count;
+    }
+
+    // One descriptor per buffer, so that submitting never has to wait for a free descriptor
+    if ((total == 0) || !axidma.initialize_descriptors(total))
+    {
+        return false;
+    }
+
+    // Carve the pools out of the area following the descriptors, which starts aligned already
+    const axi_dma::memory_area area = axidma.get_buffer_area();
+    const size_t align = static_cast<size_t>(alignment);
+    size_t offset = 0;
+
+    buffers.reserve(total);
+    free_buffers.assign(classes.size(), {});
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        const size_t stride = (classes[i].buffer_size + align - 1) & ~(align - 1);
+        if (offset + classes[i].count * stride > area.size)
+        {
+            // Application logic error: the pools don't fit in the udmabuf
+            abort();
+        }
+
+        for (size_t n = 0; n < classes[i].count; n++)
+        {
+            buffers.push_back({area.virt_addr + offset, area.phys_addr + offset, classes[i].buffer_size, i});
+            offset += stride;
+        }
+    }
+
+    // Pools are filled once every buffer has its final address, so that pointers stay valid
+    for (auto& buf : buffers)
+    {
+        free_buffers[buf.class_index_].push_back(&buf);
+    }
+    in_flight.assign(total, nullptr);
+
+    return axidma.start();
+}
+
+std::pair<uaxidma_sized_tx::acquisition_result, uaxidma_sized_tx::buffer*>
+uaxidma_sized_tx::get_buffer(size_t size_hint, int timeout)
+{
+    using std::chrono::steady_clock;
+
+    const auto first = std::find_if(classes.begin(), classes.end(),
+                                    [size_hint](const size_class& c) { return c.buffer_size >= size_hint; });
+    if (first == classes.end())
+    {
+        errno = EMSGSIZE;
+        return {acquisition_result::error, nullptr};
+    }
+
+    const bool forever = (timeout < 0);
+    const auto deadline = steady_clock::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+
+    while (true)
+    {
+        reclaim();
+
+        for (size_t i = first - classes.begin(); i < classes.size(); i++)
+        {
+            if (!free_buffers[i].empty())
+            {
+                buffer *buf = free_buffers[i].back();
+                free_buffers[i].pop_back();
+                buf->length_ = 0;
+                return {acquisition_result::success, buf};
+            }
+        }
+
+        // Nothing will ever come back if the application holds every large enough buffer
+        if (pending == 0)
+        {
+            errno = EAGAIN;
+            return {acquisition_result::error, nullptr};
+        }
+
+        int remaining = -1;
+        if (!forever)
+        {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - steady_clock::now());
+            remaining = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+        }
+
+        const acquisition_result wait_ret = wait_for_completion(remaining);
+        if (wait_ret != acquisition_result::success)
+        {
+            return {wait_ret, nullptr};
+        }
+    }
+}
+
+void uaxidma_sized_tx::submit_buffer(buffer& buf)
+{
+    sg_descriptor& desc = axidma.sg_desc_chain[next];
+
+    axidma.sync_for_device(buf.phys_addr_, buf.length_);
+    axidma.prepare_buffer(desc, buf.phys_addr_, buf.length_);
+    in_flight[next] = &buf;
+    next = (next + 1) % in_flight.size();
+    pending++;
+
+    axidma.ring_doorbell(desc);
+}
+
+const std::vector<uaxidma_sized_tx::size_class>& uaxidma_sized_tx::get_classes() const
+{
+    return classes;
+}
+
+size_t uaxidma_sized_tx::available(size_t class_index) const
+{
+    return free_buffers.at(class_index).size();
+}
+
+/**
+ * @brief Returns the buffers of every completed transfer to their pools, in submission order
+ */
+void uaxidma_sized_tx::reclaim()
+{
+    while ((pending != 0) && sg_descriptor_handle{axidma.sg_desc_chain[oldest]}.completed())
+    {
+        buffer *buf = in_flight[oldest];
+        free_buffers[buf->class_index_].push_back(buf);
+        in_flight[oldest] = nullptr;
+        oldest = (oldest + 1) % in_flight.size();
+        pending--;
+    }
+}
+
+/**
+ * @brief Waits until the oldest transfer in flight may be completed
+ * @param timeout in milliseconds, with the same semantics as for poll()
+ * @return success if the transfer is completed or an interrupt was received, timeout or error otherwise
+ */
+uaxidma_sized_tx::acquisition_result uaxidma_sized_tx::wait_for_completion(int timeout)
+{
+    const sg_descriptor_handle oldest_desc{axidma.sg_desc_chain[oldest]};
+
+    axidma.clean_interrupt();
+    if (oldest_desc.completed())
+    {
+        return acquisition_result::success;
+    }
+
+    if (timeout == 0)
+    {
+        return acquisition_result::timeout;
+    }
+
+    // Wakeups that don't complete the oldest transfer, e.g. stale interrupts, are sorted out by the caller
+    return static_cast<acquisition_result>(axidma.poll_interrupt(timeout));
+}
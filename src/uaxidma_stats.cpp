@@ -0,0 +1,157 @@
+#include "uaxidma_stats.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static constexpr size_t stats_page_size = 4096;
+
+static_assert(sizeof(uaxidma_stats_page) <= stats_page_size, "stats page layout doesn't fit in a page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence lock shall work across processes");
+
+bool uaxidma_stats_page::read(snapshot& out) const
+{
+    const uint64_t before = sequence.load(std::memory_order_acquire);
+    if (before & 1u)
+    {
+        return false;
+    }
+
+    out.sequence = before;
+    out.updated_ns = updated_ns;
+    out.channel_count = std::min<uint32_t>(channel_count, max_channels);
+    memcpy(out.channels, channels, out.channel_count * sizeof(entry));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (sequence.load(std::memory_order_relaxed) == before);
+}
+
+uaxidma_stats_exporter::uaxidma_stats_exporter(const std::string& shm_name, std::chrono::milliseconds period)
+    : shm_name_(shm_name), period_(period), page_(nullptr), running_(false)
+{
+    const int fd = shm_open(shm_name_.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        abort();
+    }
+
+    void *addr = MAP_FAILED;
+    if (ftruncate(fd, stats_page_size) == 0)
+    {
+        addr = mmap(nullptr, stats_page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(shm_name_.c_str());
+        abort();
+    }
+
+    memset(addr, 0, stats_page_size);
+    page_ = new (addr) uaxidma_stats_page;
+    page_->version = uaxidma_stats_page::current_version;
+    page_->period_ms = static_cast<uint32_t>(period_.count());
+    page_->sequence.store(0, std::memory_order_relaxed);
+
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    page_->magic = uaxidma_stats_page::magic_value;
+}
+
+uaxidma_stats_exporter::~uaxidma_stats_exporter()
+{
+    stop();
+    munmap(page_, stats_page_size);
+    shm_unlink(shm_name_.c_str());
+}
+
+bool uaxidma_stats_exporter::add(const std::string& name, const uaxidma& channel)
+{
+    if (channels_.size() == uaxidma_stats_page::max_channels)
+    {
+        return false;
+    }
+
+    uaxidma_stats_page::entry& e = page_->channels[channels_.size()];
+    const size_t len = std::min(name.size(), uaxidma_stats_page::name_size - 1);
+
+    page_->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(e.name, name.data(), len);
+    e.name[len] = '\0';
+    e.stats = channel.get_stats();
+    channels_.push_back(&channel);
+    page_->channel_count = static_cast<uint32_t>(channels_.size());
+    page_->sequence.fetch_add(1, std::memory_order_release);
+
+    return true;
+}
+
+void uaxidma_stats_exporter::start()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!running_)
+    {
+        running_ = true;
+        updater_ = std::thread(&uaxidma_stats_exporter::run, this);
+    }
+}
+
+void uaxidma_stats_exporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+
+    wakeup_.notify_all();
+    updater_.join();
+    publish();
+}
+
+void uaxidma_stats_exporter::publish()
+{
+    // Readers only cope with one update at a time, and a late update mustn't overwrite a newer snapshot
+    std::lock_guard<std::mutex> guard(publish_lock_);
+
+    // Snapshots are taken before entering the critical section, so that readers retry as seldom as possible
+    uaxidma_stats_page::entry entries[uaxidma_stats_page::max_channels];
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        entries[i].stats = channels_[i]->get_stats();
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    page_->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        page_->channels[i].stats = entries[i].stats;
+    }
+    page_->updated_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    page_->sequence.fetch_add(1, std::memory_order_release);
+}
+
+void uaxidma_stats_exporter::run()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    while (running_)
+    {
+        guard.unlock();
+        publish();
+        guard.lock();
+
+        wakeup_.wait_for(guard, period_, [this]() { return !running_; });
+    }
+}
@@ -0,0 +1,195 @@
+#include "uaxidma_tx.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <errno.h>
+#include <stdlib.h>
+#include <thread>
+
+static constexpr std::size_t tx_batch = 64;
+static constexpr int claim_slice_ms = 1;
+
+uaxidma_tx_queue::uaxidma_tx_queue(uaxidma& dma)
+    : dma_(dma), free_(dma.buffer_count()), committed_(dma.buffer_count()), committing_(false)
+{
+    if (dma.buffer_count() == 0)
+    {
+        abort();
+    }
+}
+
+uaxidma_tx_queue::~uaxidma_tx_queue()
+{
+    flush();
+}
+
+std::pair<uaxidma_tx_queue::acquisition_result, uaxidma_tx_queue::buffer*> uaxidma_tx_queue::claim(int timeout)
+{
+    using std::chrono::steady_clock;
+
+    const bool forever = (timeout < 0);
+    const auto deadline = steady_clock::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+    buffer *buf;
+
+    while (true)
+    {
+        if (free_.try_pop(buf))
+        {
+            return {acquisition_result::success, buf};
+        }
+
+        // Wait for completions in short slices, so that a committer waiting on the hardware
+        // doesn't hold back buffers committed meanwhile for too long
+        int slice = claim_slice_ms;
+        if (!forever)
+        {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - steady_clock::now());
+            slice = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(left.count(), 0, claim_slice_ms));
+        }
+
+        if (try_lock())
+        {
+            submit_committed();
+            const std::size_t refilled = refill(slice);
+            const int refill_errno = errno;
+            unlock();
+            combine();
+
+            if ((refilled == 0) && (refill_errno != 0))
+            {
+                if (refill_errno != EAGAIN)
+                {
+                    errno = refill_errno;
+                    return {acquisition_result::error, nullptr};
+                }
+                // Every buffer is claimed or committed: let their owners make progress
+                std::this_thread::yield();
+            }
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+
+        if (free_.try_pop(buf))
+        {
+            return {acquisition_result::success, buf};
+        }
+
+        if (!forever && (steady_clock::now() >= deadline))
+        {
+            return {acquisition_result::timeout, nullptr};
+        }
+    }
+}
+
+void uaxidma_tx_queue::commit(buffer& buf)
+{
+    // The queue holds as many slots as the ring has buffers, so there's always room
+    committed_.try_push(&buf);
+
+    // Either we get the committer role, or the current committer sees our buffer once it hands the role back
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    combine();
+}
+
+void uaxidma_tx_queue::flush()
+{
+    while (true)
+    {
+        if (try_lock())
+        {
+            submit_committed();
+            unlock();
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+bool uaxidma_tx_queue::try_lock()
+{
+    return !committing_.load(std::memory_order_relaxed) && !committing_.exchange(true, std::memory_order_acquire);
+}
+
+void uaxidma_tx_queue::unlock()
+{
+    committing_.store(false, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+/**
+ * @brief Submits every committed buffer, moving the tail descriptor once per batch
+ * @note To be called with the committer role held
+ */
+void uaxidma_tx_queue::submit_committed()
+{
+    std::array<buffer*, tx_batch> bufs;
+    std::size_t count;
+
+    do
+    {
+        count = 0;
+        while ((count < bufs.size()) && committed_.try_pop(bufs[count]))
+        {
+            count++;
+        }
+
+        if (count != 0)
+        {
+            dma_.submit_in_order(std::span{bufs.data(), count});
+        }
+    } while (count == bufs.size());
+}
+
+/**
+ * @brief Moves the buffers sent by the hardware to the free list
+ * @note To be called with the committer role held
+ * @param timeout how long to wait for the first completion, with the same semantics as for uaxidma::get_buffers()
+ * @return number of buffers made available. errno is set to 0 if the wait didn't fail.
+ */
+std::size_t uaxidma_tx_queue::refill(int timeout)
+{
+    std::array<buffer*, tx_batch> bufs;
+    std::size_t total = 0;
+
+    while (true)
+    {
+        const auto [res, count] = dma_.get_buffers(bufs, timeout);
+        if (res == acquisition_result::error)
+        {
+            return total;
+        }
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            free_.try_push(bufs[i]);
+        }
+        total += count;
+
+        if ((res != acquisition_result::success) || (count != bufs.size()))
+        {
+            errno = 0;
+            return total;
+        }
+        timeout = 0;
+    }
+}
+
+/**
+ * @brief Submits committed buffers for as long as the committer role can be taken and there's work left
+ */
+void uaxidma_tx_queue::combine()
+{
+    while (try_lock())
+    {
+        submit_committed();
+        refill(0);
+        unlock();
+
+        if (committed_.empty())
+        {
+            return;
+        }
+    }
+}
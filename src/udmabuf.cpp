@@ -6,22 +6,70 @@
 
 #include "udmabuf.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <fcntl.h>
 #include <fstream>
 #include <inttypes.h>
+#include <map>
+#include <mutex>
 #include <cstdio>
 #include <sstream>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+static constexpr size_t cache_line_size = 64;
+
+static std::mutex emulated_areas_lock;
+static std::map<std::string, u_dma_buf::emulated_area> emulated_areas;
+
+void u_dma_buf::register_emulated(const std::string& name, const emulated_area& area)
+{
+    std::lock_guard<std::mutex> guard(emulated_areas_lock);
+    if (!emulated_areas.emplace(name, area).second)
+    {
+        // Application logic error: two areas with the same name
+        abort();
+    }
+}
+
+void u_dma_buf::unregister_emulated(const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(emulated_areas_lock);
+    emulated_areas.erase(name);
+}
+
 /**
  * @brief Initialize the udmabuf instance and map the underlying buffer into user space memory
  * @param name Absolute path to the udmabuf device node in the /dev directory
+ * @note Buffers whose device isn't cache-coherent are mapped twice: uncached, for descriptors and other
+ * data the device may access at any time, and cacheable, for data buffers whose ownership is transferred
+ * explicitly. If u-dma-buf doesn't provide the sync interface, only the uncached mapping is used.
  */
 u_dma_buf::u_dma_buf(const std::string& name, size_t size)
+    : sync_for_cpu_fd(-1), sync_for_device_fd(-1), emulated(false)
 {
+    {
+        std::lock_guard<std::mutex> guard(emulated_areas_lock);
+        const auto it = emulated_areas.find(name);
+        if (it != emulated_areas.end())
+        {
+            if (size > it->second.size)
+            {
+                abort();
+            }
+
+            phys_addr = it->second.phys_addr;
+            virt_addr = it->second.virt_addr;
+            cached_addr = it->second.virt_addr;
+            this->size = (size != 0) ? size : it->second.size;
+            coherent = true;
+            emulated = true;
+            return;
+        }
+    }
+
     phys_addr = static_cast<uintptr_t>(read_property("/sys/class/u-dma-buf/" + name + "/phys_addr", "%" SCNxPTR));
     if (phys_addr == 0)
     {
@@ -34,9 +82,92 @@ u_dma_buf::u_dma_buf(const std::string& name, size_t size)
         abort();
     }
 
-    size = (size != 0) ? size : max_size;
+    this->size = (size != 0) ? size : max_size;
+
+    const std::string sysfs_dir = "/sys/class/u-dma-buf/" + name;
+    coherent = (read_property(sysfs_dir + "/dma_coherent", "%" SCNu64) == 1);
+    if (!coherent)
+    {
+        sync_for_cpu_fd = open((sysfs_dir + "/sync_for_cpu").c_str(), O_WRONLY | O_CLOEXEC);
+        sync_for_device_fd = open((sysfs_dir + "/sync_for_device").c_str(), O_WRONLY | O_CLOEXEC);
+        if ((sync_for_cpu_fd < 0) || (sync_for_device_fd < 0))
+        {
+            // Without explicit cache maintenance, data buffers have to stay uncached as well
+            if (sync_for_cpu_fd >= 0)
+            {
+                close(sync_for_cpu_fd);
+            }
+            if (sync_for_device_fd >= 0)
+            {
+                close(sync_for_device_fd);
+            }
+            sync_for_cpu_fd = -1;
+            sync_for_device_fd = -1;
+        }
+    }
+
+    // O_SYNC disables the CPU cache on the mapping, unless u-dma-buf was told otherwise by its sync_mode
+    virt_addr = map("/dev/" + name, coherent ? O_RDWR : (O_RDWR | O_SYNC));
+    cached_addr = (sync_for_cpu_fd >= 0) ? map("/dev/" + name, O_RDWR) : virt_addr;
+}
+
+/**
+ * @brief Unmaps the buffer and releases the sync interface
+ */
+u_dma_buf::~u_dma_buf()
+{
+    if (emulated)
+    {
+        return;
+    }
+
+    if (cached_addr != virt_addr)
+    {
+        munmap(cached_addr, size);
+    }
+    munmap(virt_addr, size);
+
+    if (sync_for_cpu_fd >= 0)
+    {
+        close(sync_for_cpu_fd);
+        close(sync_for_device_fd);
+    }
+}
+
+bool u_dma_buf::sync_for_cpu(size_t offset, size_t len, sync_direction dir)
+{
+    return (sync_for_cpu_fd < 0) || sync(sync_for_cpu_fd, offset, len, dir);
+}
+
+bool u_dma_buf::sync_for_device(size_t offset, size_t len, sync_direction dir)
+{
+    return (sync_for_device_fd < 0) || sync(sync_for_device_fd, offset, len, dir);
+}
+
+/**
+ * @brief Performs a cache maintenance operation on a byte range through a u-dma-buf sync attribute
+ * The range, the direction and the trigger bit are packed into a single write, as supported by u-dma-buf,
+ * so that the operation takes one system call and leaves the sync_offset/sync_size attributes untouched.
+ * @param fd of the sync_for_cpu or sync_for_device attribute
+ * @param offset from the start of the buffer. Widened to cache line boundaries along with len.
+ * @return false on errors
+ */
+bool u_dma_buf::sync(int fd, size_t offset, size_t len, sync_direction dir)
+{
+    if ((len == 0) || (offset >= size))
+    {
+        return true;
+    }
+
+    const size_t start = offset & ~(cache_line_size - 1);
+    const size_t end = std::min(size, (offset + len + cache_line_size - 1) & ~(cache_line_size - 1));
+    const uint32_t sync_size = static_cast<uint32_t>(end - start) & 0xfffffff0u;
+
+    char attr[32];
+    const int attr_len = snprintf(attr, sizeof(attr), "0x%08" PRIX32 "%08" PRIX32, static_cast<uint32_t>(start),
+                                  sync_size | (static_cast<uint32_t>(dir) << 2) | 1u);
 
-    map("/dev/" + name);
+    return (pwrite(fd, attr, attr_len, 0) == attr_len);
 }
 
 /**
@@ -63,22 +194,25 @@ uint64_t u_dma_buf::read_property(const std::string& file_path, const std::strin
 
 /**
  * @brief Maps a memory region assigned to a udmabuf node into user space memory
- * @param udmabuf Pointer to udmabuf instance
+ * @param file udmabuf device node
+ * @param flags used to open the device node, which determine the mapping cacheability
+ * @return virtual address of the mapping
  */
-void u_dma_buf::map(const std::string& file)
+uint8_t *u_dma_buf::map(const std::string& file, int flags)
 {
-    int fd = open(file.c_str(), O_RDWR);
+    int fd = open(file.c_str(), flags);
     if (fd < 0)
     {
         abort();
     }
 
-    virt_addr
-        = static_cast<uint8_t *>(mmap(nullptr, size, PROT_WRITE | PROT_READ, MAP_SHARED, fd, 0));
-    if (virt_addr == MAP_FAILED)
+    void *addr = mmap(nullptr, size, PROT_WRITE | PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
     {
         abort();
     }
 
     close(fd);
+
+    return static_cast<uint8_t *>(addr);
 }
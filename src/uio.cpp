@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <sys/mman.h>
@@ -20,6 +22,25 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+static std::mutex backends_lock;
+static std::map<std::string, uio_backend *> backends;
+
+void uio_device::register_backend(const std::string &name, uio_backend *backend)
+{
+    std::lock_guard<std::mutex> guard(backends_lock);
+    if (!backends.emplace(name, backend).second)
+    {
+        // Application logic error: two backends with the same name
+        abort();
+    }
+}
+
+void uio_device::unregister_backend(const std::string &name)
+{
+    std::lock_guard<std::mutex> guard(backends_lock);
+    backends.erase(name);
+}
+
 bool uio_device::find_by_name(const std::string &name)
 {
     DIR *dir = opendir("/sys/class/uio");
@@ -65,11 +86,25 @@ bool uio_device::find_by_name(const std::string &name)
 }
 
 uio_device::uio_device(const std::string &name) :
-    fd(-1), number_(-1), virt_addr_(nullptr)
+    fd(-1), number_(-1), virt_addr_(nullptr), backend_(nullptr)
 {
-    if (find_by_name(name))
     {
-        std::string uio_path {"/dev/uio" + number_};
+        std::lock_guard<std::mutex> guard(backends_lock);
+        const auto it = backends.find(name);
+        if (it != backends.end())
+        {
+            backend_ = it->second;
+        }
+    }
+
+    if (backend_)
+    {
+        // Our own descriptor, so that it's closed like any other
+        fd = dup(backend_->interrupt_fd());
+    }
+    else if (find_by_name(name))
+    {
+        const std::string uio_path {"/dev/uio" + std::to_string(number_)};
         fd = open(uio_path.c_str(), O_RDWR);
     }
 
@@ -88,6 +123,12 @@ uio_device::~uio_device()
 
 uint8_t *uio_device::map()
 {
+    if (backend_)
+    {
+        virt_addr_ = backend_->registers();
+        return virt_addr_;
+    }
+
     virt_addr_ = static_cast<uint8_t *>(mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
     if (virt_addr_ == MAP_FAILED)
     {
@@ -99,6 +140,12 @@ uint8_t *uio_device::map()
 
 bool uio_device::unmap()
 {
+    if (backend_)
+    {
+        virt_addr_ = nullptr;
+        return true;
+    }
+
     if (munmap(virt_addr_, sysconf(_SC_PAGESIZE)) < 0)
     {
         return false;
@@ -108,3 +155,25 @@ bool uio_device::unmap()
 
     return true;
 }
+
+bool uio_device::set_interrupt(bool enabled)
+{
+    if (backend_)
+    {
+        return backend_->set_interrupt(enabled);
+    }
+
+    const int32_t value = enabled ? 1 : 0;
+    return (write(fd, &value, sizeof(value)) == sizeof(value));
+}
+
+bool uio_device::acknowledge_interrupt()
+{
+    if (backend_)
+    {
+        return backend_->acknowledge_interrupt();
+    }
+
+    int32_t n_interrupts;
+    return (read(fd, &n_interrupts, sizeof(n_interrupts)) == sizeof(n_interrupts));
+}
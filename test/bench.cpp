@@ -0,0 +1,411 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using policy = uaxidma::wait_policy;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr std::chrono::microseconds hybrid_spin {20};
+static constexpr size_t sim_page_size = 4096;
+
+/**
+ * @brief Settings of a single measurement
+ */
+struct bench_point
+{
+    dir direction;
+    size_t buffer_size;
+    size_t ring_depth;
+    policy wait_policy;
+    size_t batch_size;
+};
+
+/**
+ * @brief Outcome of a single measurement
+ */
+struct bench_result
+{
+    bool ok;
+    size_t buffers;
+    size_t bytes;
+    double seconds;
+    double cpu_seconds;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uaxidma::latency_histograms channel_latency;
+};
+
+/**
+ * @brief u-dma-buf buffer and UIO device driving one direction on real hardware
+ */
+struct hw_channel
+{
+    std::string udmabuf;
+    std::string uio;
+};
+
+static const char *direction_name(dir d)
+{
+    return (d == dir::mem_to_dev) ? "tx" : "rx";
+}
+
+static const char *policy_name(policy p)
+{
+    switch (p)
+    {
+        case policy::busy_poll:
+            return "busy_poll";
+        case policy::hybrid:
+            return "hybrid";
+        default:
+            return "interrupt";
+    }
+}
+
+static bool parse_policy(const std::string& name, policy& p)
+{
+    for (policy candidate : {policy::interrupt, policy::busy_poll, policy::hybrid})
+    {
+        if (name == policy_name(candidate))
+        {
+            p = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss {list};
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static std::vector<size_t> parse_sizes(const std::string& list)
+{
+    std::vector<size_t> sizes;
+    for (const auto& item : split(list))
+    {
+        sizes.push_back(strtoull(item.c_str(), nullptr, 0));
+    }
+    return sizes;
+}
+
+/**
+ * @brief Size of the u-dma-buf region holding exactly <em>ring_depth</em> descriptor/buffer pairs
+ */
+static size_t region_size(size_t buffer_size, size_t ring_depth)
+{
+    const size_t stride = (buffer_size + 7UL) & ~7UL;
+    return ring_depth * (sizeof(sg_descriptor) + stride);
+}
+
+static double cpu_time()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static uint64_t percentile(std::vector<uint32_t>& samples, double p)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+
+    const size_t rank = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+/**
+ * @brief Moves <em>buffers</em> buffers through an initialized channel
+ * Latency is measured per buffer, from the call acquiring it until it's handed to the application,
+ * so it includes waiting for the hardware.
+ */
+static bench_result run_point(uaxidma& dma, const bench_point& point, size_t buffers)
+{
+    bench_result result {};
+    std::vector<uaxidma::buffer*> batch(std::min(point.batch_size, dma.buffer_count()));
+    std::vector<uint32_t> latencies;
+    latencies.reserve(buffers);
+
+    dma.set_wait_policy(point.wait_policy, hybrid_spin);
+    dma.reset_latency_histograms();
+
+    const double cpu_start = cpu_time();
+    const auto start = bench_clock::now();
+    while (result.buffers < buffers)
+    {
+        const auto call_start = bench_clock::now();
+        const auto [res, count] = dma.get_buffers(std::span{batch.data(), std::min(batch.size(), buffers - result.buffers)},
+                                                  timeout_1s);
+        const auto call_end = bench_clock::now();
+        if (res != acq_result::success)
+        {
+            return result;
+        }
+
+        const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(call_end - call_start).count();
+        latencies.insert(latencies.end(), count, static_cast<uint32_t>(std::min<int64_t>(latency, UINT32_MAX)));
+
+        const std::span<uaxidma::buffer*> acquired {batch.data(), count};
+        if (point.direction == dir::mem_to_dev)
+        {
+            for (auto *buf : acquired)
+            {
+                buf->data()[0] = static_cast<uint8_t>(result.buffers);
+                buf->set_payload(point.buffer_size);
+                result.bytes += point.buffer_size;
+            }
+            dma.submit_buffers(acquired);
+        }
+        else
+        {
+            for (auto *buf : acquired)
+            {
+                result.bytes += buf->length();
+            }
+            dma.mark_reusable(acquired);
+        }
+        result.buffers += count;
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    result.ok = true;
+    result.seconds = elapsed.count();
+    result.cpu_seconds = cpu_time() - cpu_start;
+    result.p50_ns = percentile(latencies, 0.5);
+    result.p99_ns = percentile(latencies, 0.99);
+    result.p999_ns = percentile(latencies, 0.999);
+    result.channel_latency = dma.get_latency_histograms();
+    return result;
+}
+
+/**
+ * @brief Measures a point against the simulated core, which runs as fast as it can
+ */
+static bench_result run_sim(const bench_point& point, size_t buffers)
+{
+    const size_t size = region_size(point.buffer_size, point.ring_depth);
+    sim_udmabuf mem { "bench_udmabuf", (size + sim_page_size - 1) & ~(sim_page_size - 1) };
+    sim_axi_dma core { "bench_axidma", {0, 0} };
+
+    uaxidma dma { "bench_udmabuf", size, "bench_axidma", mode::normal, point.direction, point.buffer_size };
+    if (!dma.initialize())
+    {
+        return {};
+    }
+
+    return run_point(dma, point, buffers);
+}
+
+/**
+ * @brief Measures a point against the real devices
+ */
+static bench_result run_hw(const bench_point& point, const hw_channel& channel, size_t buffers)
+{
+    uaxidma dma { channel.udmabuf, region_size(point.buffer_size, point.ring_depth), channel.uio, mode::normal,
+                  point.direction, point.buffer_size };
+    if (!dma.initialize())
+    {
+        return {};
+    }
+
+    return run_point(dma, point, buffers);
+}
+
+static void print_histogram(std::ostream& os, const char *name, const latency_histogram& h)
+{
+    os << ", \"" << name << "_ns\": {\"p50\": " << h.percentile(0.5) << ", \"p99\": " << h.percentile(0.99)
+       << ", \"p99.9\": " << h.percentile(0.999) << ", \"max\": " << h.max() << "}";
+}
+
+static void print_json(std::ostream& os, const std::string& target, const bench_point& point, const bench_result& r)
+{
+    const double seconds = (r.seconds > 0.0) ? r.seconds : 1.0;
+
+    os << "    {\"target\": \"" << target << "\", \"direction\": \"" << direction_name(point.direction) << "\""
+       << ", \"buffer_size\": " << point.buffer_size << ", \"ring_depth\": " << point.ring_depth
+       << ", \"wait_policy\": \"" << policy_name(point.wait_policy) << "\", \"batch_size\": " << point.batch_size
+       << ", \"ok\": " << (r.ok ? "true" : "false") << ", \"buffers\": " << r.buffers << ", \"bytes\": " << r.bytes
+       << ", \"seconds\": " << r.seconds << ", \"mb_per_s\": " << (r.bytes / seconds / 1e6)
+       << ", \"packets_per_s\": " << (r.buffers / seconds) << ", \"cpu_utilisation\": " << (r.cpu_seconds / seconds)
+       << ", \"latency_ns\": {\"p50\": " << r.p50_ns << ", \"p99\": " << r.p99_ns << ", \"p99.9\": " << r.p999_ns
+       << "}";
+    print_histogram(os, "irq_to_user", r.channel_latency.irq_to_user);
+    if (point.direction == dir::mem_to_dev)
+    {
+        print_histogram(os, "submit_to_complete", r.channel_latency.submit_to_complete);
+    }
+    os << "}";
+}
+
+static void usage(const char *argv0)
+{
+    std::cout << "usage: " << argv0 << " [--target sim|hw] [--directions tx,rx] [--buffer-sizes 256,4096,...]\n"
+              << "       [--ring-depths 64,512,...] [--wait-policies interrupt,busy_poll,hybrid] [--batch-sizes 1,32,...]\n"
+              << "       [--buffers <per point>] [--tx <udmabuf>:<uio>] [--rx <udmabuf>:<uio>] [--output <file.json>]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string target = "sim";
+    std::vector<dir> directions {dir::mem_to_dev, dir::dev_to_mem};
+    std::vector<size_t> buffer_sizes {256, 4096, 65536};
+    std::vector<size_t> ring_depths {64, 512};
+    std::vector<policy> policies {policy::interrupt, policy::busy_poll, policy::hybrid};
+    std::vector<size_t> batch_sizes {1, 32};
+    size_t buffers = 1UL << 16;
+    hw_channel tx_channel {"udmabuf1", "axidma_tx"};
+    hw_channel rx_channel {"udmabuf0", "axidma_rx"};
+    std::string output;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string opt = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const std::string value = argv[++i];
+
+        bool valid = true;
+        if (opt == "--target")
+        {
+            target = value;
+            valid = (target == "sim") || (target == "hw");
+        }
+        else if (opt == "--directions")
+        {
+            directions.clear();
+            for (const auto& d : split(value))
+            {
+                valid &= (d == "tx") || (d == "rx");
+                directions.push_back((d == "tx") ? dir::mem_to_dev : dir::dev_to_mem);
+            }
+        }
+        else if (opt == "--buffer-sizes")
+        {
+            buffer_sizes = parse_sizes(value);
+        }
+        else if (opt == "--ring-depths")
+        {
+            ring_depths = parse_sizes(value);
+        }
+        else if (opt == "--wait-policies")
+        {
+            policies.clear();
+            for (const auto& name : split(value))
+            {
+                policy p = policy::interrupt;
+                valid &= parse_policy(name, p);
+                policies.push_back(p);
+            }
+        }
+        else if (opt == "--batch-sizes")
+        {
+            batch_sizes = parse_sizes(value);
+        }
+        else if (opt == "--buffers")
+        {
+            buffers = strtoull(value.c_str(), nullptr, 0);
+        }
+        else if ((opt == "--tx") || (opt == "--rx"))
+        {
+            const size_t colon = value.find(':');
+            valid = (colon != std::string::npos);
+            (opt == "--tx" ? tx_channel : rx_channel) = {value.substr(0, colon), value.substr(colon + 1)};
+        }
+        else if (opt == "--output")
+        {
+            output = value;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const auto invalid_size = [](size_t v) { return (v == 0) || (v > sg_max_buf_len); };
+    if (std::any_of(buffer_sizes.begin(), buffer_sizes.end(), invalid_size)
+        || std::count(ring_depths.begin(), ring_depths.end(), 0) || std::count(batch_sizes.begin(), batch_sizes.end(), 0)
+        || (buffers == 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!output.empty())
+    {
+        file.open(output);
+        if (!file.is_open())
+        {
+            std::cerr << "can't open " << output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& os = output.empty() ? std::cout : file;
+
+    bool ok = true;
+    bool first = true;
+    os << "{\n  \"results\": [\n";
+    for (dir d : directions)
+    {
+        for (size_t buffer_size : buffer_sizes)
+        {
+            for (size_t ring_depth : ring_depths)
+            {
+                for (policy p : policies)
+                {
+                    for (size_t batch_size : batch_sizes)
+                    {
+                        const bench_point point {d, buffer_size, ring_depth, p, batch_size};
+                        const bench_result result = (target == "sim")
+                            ? run_sim(point, buffers)
+                            : run_hw(point, (d == dir::mem_to_dev) ? tx_channel : rx_channel, buffers);
+                        ok &= result.ok;
+
+                        os << (first ? "" : ",\n");
+                        print_json(os, target, point, result);
+                        os.flush();
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+    os << "\n  ]\n}" << std::endl;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+#include "dma_copy.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+using kernel = dma_copy::kernel;
+
+static constexpr size_t region_size = 4UL << 20;
+static constexpr size_t copy_sizes[] = {256, 4UL << 10, 64UL << 10, 1UL << 20};
+static constexpr auto measure_time = std::chrono::milliseconds(200);
+static constexpr kernel kernels[] = {kernel::generic, kernel::sse2, kernel::sse41, kernel::avx2, kernel::neon};
+
+/**
+ * @brief Device memory mapped the way u-dma-buf maps it for a given sync_mode
+ */
+struct mapping
+{
+    const char *name;
+    int sync_mode;       //!< u-dma-buf sync_mode selecting the memory type of O_SYNC mappings, 0 for anonymous memory
+    uint8_t *addr;
+    size_t size;
+};
+
+/**
+ * @brief Maps a u-dma-buf buffer with O_SYNC, after setting its sync_mode
+ * @return nullptr if the buffer doesn't exist or can't be mapped
+ */
+static uint8_t *map_udmabuf(const std::string& name, int sync_mode, size_t size)
+{
+    std::ofstream mode_file("/sys/class/u-dma-buf/" + name + "/sync_mode");
+    mode_file << sync_mode << std::endl;
+    if (!mode_file)
+    {
+        return nullptr;
+    }
+
+    const int fd = open(("/dev/" + name).c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (addr == MAP_FAILED) ? nullptr : static_cast<uint8_t *>(addr);
+}
+
+/**
+ * @brief Checks each kernel against memcpy() for every alignment of both sides and lengths around the vector
+ * widths
+ */
+static bool check_kernels(uint8_t *device)
+{
+    std::vector<uint8_t> host(4096);
+    std::vector<uint8_t> expected(4096);
+    std::mt19937 rng(1);
+    for (auto& b : host)
+    {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    bool ok = true;
+    for (kernel k : kernels)
+    {
+        if (!dma_copy::select(k))
+        {
+            continue;
+        }
+
+        for (size_t dst_off = 0; dst_off < 64; dst_off += 7)
+        {
+            for (size_t src_off = 0; src_off < 64; src_off += 5)
+            {
+                for (size_t len : {0UL, 1UL, 15UL, 16UL, 33UL, 127UL, 128UL, 129UL, 1000UL, 3000UL})
+                {
+                    memset(device, 0, 4096);
+                    dma_copy::to_device(device + dst_off, host.data() + src_off, len);
+                    ok &= (memcmp(device + dst_off, host.data() + src_off, len) == 0);
+                    ok &= (dst_off == 0) || (device[dst_off - 1] == 0);
+                    ok &= (device[dst_off + len] == 0);
+
+                    memset(expected.data(), 0, expected.size());
+                    dma_copy::from_device(expected.data() + src_off, device + dst_off, len);
+                    ok &= (memcmp(expected.data() + src_off, host.data() + src_off, len) == 0);
+                    ok &= (expected[src_off + len] == 0);
+                }
+            }
+        }
+
+        if (!ok)
+        {
+            std::cout << "# " << dma_copy::name(k) << ": copies differ from memcpy()!" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Measures the throughput of a copy direction, spreading copies over the whole mapping
+ * @return MB/s
+ */
+static double measure(const mapping& map, uint8_t *host, size_t size, bool to_device)
+{
+    const size_t slots = map.size / size;
+    size_t copied = 0;
+    size_t slot = 0;
+    const auto start = bench_clock::now();
+    auto now = start;
+    while (now - start < measure_time)
+    {
+        for (int i = 0; i < 16; i++, slot = (slot + 1) % slots)
+        {
+            uint8_t *device = map.addr + slot * size;
+            if (to_device)
+            {
+                dma_copy::to_device(device, host, size);
+            }
+            else
+            {
+                dma_copy::from_device(host, device, size);
+            }
+            copied += size;
+        }
+        now = bench_clock::now();
+    }
+
+    const std::chrono::duration<double> elapsed = now - start;
+    return static_cast<double>(copied) / 1e6 / elapsed.count();
+}
+
+/**
+ * @brief Compares the copy kernels the CPU supports with memcpy(), i.e. the generic kernel, on cached memory and,
+ * given a u-dma-buf buffer of at least 4 MiB, on its uncached and write-combined mappings, and prints their
+ * throughput as CSV
+ * @note u-dma-buf maps O_SYNC opens of the buffer uncached with sync_mode 1, and write-combined with sync_mode 2.
+ * The sync_mode of the buffer is left at 2.
+ * usage: copy_bench [u-dma-buf name]
+ */
+int main(int argc, char *argv[])
+{
+    std::vector<mapping> mappings;
+    void *cached = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                        -1, 0);
+    if (cached == MAP_FAILED)
+    {
+        std::cout << "mmap: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    mappings.push_back({"cached", 0, static_cast<uint8_t *>(cached), region_size});
+
+    for (const auto& [name, sync_mode] : {std::pair{"uncached", 1}, std::pair{"write_combined", 2}})
+    {
+        uint8_t *addr = (argc > 1) ? map_udmabuf(argv[1], sync_mode, region_size) : nullptr;
+        if (addr == nullptr)
+        {
+            std::cout << "# " << name << ": skipped, "
+                      << ((argc > 1) ? "can't map the u-dma-buf buffer" : "no u-dma-buf buffer given") << std::endl;
+            continue;
+        }
+        mappings.push_back({name, sync_mode, addr, region_size});
+    }
+
+    const kernel detected = dma_copy::active();
+    std::cout << "# detected kernel: " << dma_copy::name(detected) << std::endl;
+    if (!check_kernels(mappings.front().addr))
+    {
+        return 1;
+    }
+
+    std::vector<uint8_t> host(copy_sizes[std::size(copy_sizes) - 1], 0x5a);
+    std::cout << "mapping,kernel,size,direction,mb_per_s" << std::endl;
+    for (const auto& map : mappings)
+    {
+        for (kernel k : kernels)
+        {
+            if (!dma_copy::select(k))
+            {
+                continue;
+            }
+
+            for (size_t size : copy_sizes)
+            {
+                for (bool to_device : {true, false})
+                {
+                    std::cout << map.name << "," << dma_copy::name(k) << "," << size << ","
+                              << (to_device ? "to_device," : "from_device,")
+                              << measure(map, host.data(), size, to_device) << std::endl;
+                }
+            }
+        }
+    }
+    dma_copy::select(detected);
+
+    for (const auto& map : mappings)
+    {
+        munmap(map.addr, map.size);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "uaxidma_coro.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr size_t switches = 1UL << 22;
+static constexpr size_t task_count = 64;
+static constexpr size_t buffers = 1UL << 20;
+static constexpr size_t _256KiB = 256UL << 10;
+
+static coro_task yielder(coro_executor& ex, size_t rounds)
+{
+    for (size_t i = 0; i < rounds; i++)
+    {
+        co_await ex.yield();
+    }
+}
+
+/**
+ * @brief Measures the cost of suspending and resuming a coroutine through the executor
+ * @return nanoseconds per switch
+ */
+static double bench_switch()
+{
+    coro_executor ex;
+    for (size_t i = 0; i < task_count; i++)
+    {
+        ex.spawn(yielder(ex, switches / task_count));
+    }
+
+    const auto start = bench_clock::now();
+    ex.run();
+    const auto elapsed = bench_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / switches;
+}
+
+/**
+ * @brief Receives buffers with the blocking API
+ * @return nanoseconds per buffer, 0 on errors
+ */
+static double bench_blocking_rx(uaxidma& dma)
+{
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < buffers; i++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(-1);
+        if (res != acq_result::success)
+        {
+            return 0.0;
+        }
+        dma.mark_reusable(*buf_ptr);
+    }
+    const auto elapsed = bench_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / buffers;
+}
+
+static coro_task receiver(coro_channel& ch, size_t count, bool& ok)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto [res, buf_ptr] = co_await ch.acquire();
+        if (res != acq_result::success)
+        {
+            ok = false;
+            co_return;
+        }
+        ch.release(*buf_ptr);
+    }
+}
+
+/**
+ * @brief Receives buffers with the coroutine API, spread over several tasks
+ * @return nanoseconds per buffer, 0 on errors
+ */
+static double bench_coro_rx(uaxidma& dma)
+{
+    coro_executor ex;
+    coro_channel ch{ex, dma};
+    bool ok = true;
+
+    for (size_t i = 0; i < task_count; i++)
+    {
+        ex.spawn(receiver(ch, buffers / task_count, ok));
+    }
+
+    const auto start = bench_clock::now();
+    if (!ex.run() || !ok)
+    {
+        return 0.0;
+    }
+    const auto elapsed = bench_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / buffers;
+}
+
+int main(int argc, char *argv[])
+{
+    std::cout << "coroutine switch: " << bench_switch() << " ns" << std::endl;
+
+    // The comparison against the blocking API needs the actual AXI DMA
+    if ((argc > 1) && (std::strcmp(argv[1], "--device") == 0))
+    {
+        uaxidma dma { "udmabuf0", 0, "axidma_rx", mode::cyclic, dir::dev_to_mem, _256KiB };
+        if (!dma.initialize())
+        {
+            std::cout << "initialization error!" << std::endl;
+            return 1;
+        }
+
+        std::cout << "blocking get_buffer(): " << bench_blocking_rx(dma) << " ns/buffer" << std::endl;
+        std::cout << "co_await acquire() (" << task_count << " tasks): " << bench_coro_rx(dma) << " ns/buffer"
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "sg_descriptor.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr std::size_t min_descs = 16;
+static constexpr std::size_t max_descs = 64UL << 10;
+static constexpr std::size_t buffer_size = 4096;
+static constexpr std::size_t lookups = 1UL << 22;
+
+/**
+ * @brief Emulates the per-submission work done by axi_dma::transfer_buffer() and
+ * axi_dma::get_virt_buffer_pointer(): look up the descriptor and buffer addresses of the
+ * next descriptor in the ring
+ * @return average time per lookup in nanoseconds
+ */
+static double bench_lookups(sg_descriptor_chain& chain)
+{
+    uintptr_t checksum = 0;
+    std::size_t idx = 0;
+
+    const auto start = bench_clock::now();
+    for (std::size_t i = 0; i < lookups; i++)
+    {
+        const sg_descriptor_info& info = chain.info(chain[idx]);
+        checksum += info.desc_phys_addr + reinterpret_cast<uintptr_t>(info.buf_virt_addr);
+        if (++idx == chain.size()) idx = 0;
+    }
+    const auto elapsed = bench_clock::now() - start;
+
+    // Keep the compiler from optimizing the loop away
+    if (checksum == 0)
+    {
+        std::cerr << "unexpected checksum" << std::endl;
+    }
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / lookups;
+}
+
+int main()
+{
+    std::cout << "descriptors,ns_per_submit" << std::endl;
+
+    for (std::size_t count = min_descs; count <= max_descs; count <<= 2)
+    {
+        // Descriptors must be 16-word aligned
+        auto *descs = static_cast<sg_descriptor *>(std::aligned_alloc(alignof(sg_descriptor),
+                                                                      count * sizeof(sg_descriptor)));
+        if (!descs)
+        {
+            return EXIT_FAILURE;
+        }
+
+        // Fake a u-dma-buf layout: descriptors at the base, data buffers right after them
+        static constexpr uintptr_t fake_phys_base = 0x40000000U;
+        sg_descriptor_chain chain{descs, count};
+        for (std::size_t i = 0; i < count; i++)
+        {
+            chain.set_info(i, fake_phys_base + i * sizeof(sg_descriptor),
+                           reinterpret_cast<uint8_t *>(fake_phys_base + chain.length() + i * buffer_size),
+                           fake_phys_base + chain.length() + i * buffer_size);
+        }
+
+        std::cout << count << "," << bench_lookups(chain) << std::endl;
+
+        std::free(descs);
+    }
+
+    return EXIT_SUCCESS;
+}
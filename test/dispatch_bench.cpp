@@ -0,0 +1,158 @@
+#include "uaxidma_dispatch.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr size_t _4KiB = 4UL << 10;
+static constexpr size_t max_workers = 8;
+static constexpr auto run_time = std::chrono::seconds(2);
+static constexpr uint64_t queue_items = 1UL << 20;
+
+/**
+ * @brief Emulates per-buffer processing by spinning for the given time
+ */
+static void busy_work(std::chrono::nanoseconds work)
+{
+    const auto until = bench_clock::now() + work;
+    while (bench_clock::now() < until)
+    {
+    }
+}
+
+/**
+ * @brief Measures the throughput of the dispatcher with the given number of workers
+ * @return buffers processed per second
+ */
+static double bench_dispatcher(uaxidma& dma, size_t workers, bool per_flow, std::chrono::nanoseconds work)
+{
+    std::atomic<uint64_t> processed{0};
+    uaxidma_dispatcher *self = nullptr;
+
+    auto process = [&](uaxidma::buffer& buf, size_t) {
+        busy_work(work);
+        processed.fetch_add(1, std::memory_order_relaxed);
+        self->release(buf);
+    };
+
+    // Buffers are assigned to flows by position in the ring, as a stand-in for a header field
+    uaxidma_dispatcher::flow_function flow;
+    if (per_flow)
+    {
+        flow = [](uaxidma::buffer& buf) { return reinterpret_cast<uintptr_t>(buf.data()) / _4KiB; };
+    }
+
+    uaxidma_dispatcher dispatcher { dma, workers, process, flow };
+    self = &dispatcher;
+
+    dispatcher.start();
+    const auto start = bench_clock::now();
+    std::this_thread::sleep_for(run_time);
+    const uint64_t count = processed.load();
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    dispatcher.stop();
+
+    return count / elapsed.count();
+}
+
+/**
+ * @brief Measures the raw throughput of the lock-free queue with one producer and several consumers
+ * @return items per second
+ */
+static double bench_queue(size_t consumers)
+{
+    lockfree_queue<uint64_t> q { 256 };
+    std::atomic<uint64_t> consumed{0};
+    std::vector<std::thread> threads;
+
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < consumers; i++)
+    {
+        threads.emplace_back([&]() {
+            uint64_t item;
+            while (consumed.load(std::memory_order_relaxed) < queue_items)
+            {
+                if (q.try_pop(item))
+                {
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    for (uint64_t i = 0; i < queue_items; i++)
+    {
+        while (!q.try_push(i))
+        {
+        }
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    return queue_items / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::chrono::nanoseconds work { 2000 };
+    bool queue_only = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--queue-only") == 0)
+        {
+            queue_only = true;
+        }
+        else if ((strcmp(argv[i], "--work-ns") == 0) && (i + 1 < argc))
+        {
+            work = std::chrono::nanoseconds(strtoll(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::cout << "usage: " << argv[0] << " [--queue-only] [--work-ns <ns per buffer>]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (queue_only)
+    {
+        std::cout << "consumers,items_per_s" << std::endl;
+        for (size_t n = 1; n <= max_workers; n++)
+        {
+            std::cout << n << "," << bench_queue(n) << std::endl;
+        }
+        return 0;
+    }
+
+    uaxidma dma { "udmabuf0", 0, "axidma_rx", mode::normal, dir::dev_to_mem, _4KiB };
+
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    std::cout << "workers,ordering,buffers_per_s" << std::endl;
+    for (bool per_flow : {false, true})
+    {
+        for (size_t n = 1; n <= max_workers; n++)
+        {
+            const double bps = bench_dispatcher(dma, n, per_flow, work);
+            std::cout << n << "," << (per_flow ? "per_flow" : "none") << "," << bps << std::endl;
+        }
+    }
+
+    return 0;
+}
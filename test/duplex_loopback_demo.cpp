@@ -0,0 +1,71 @@
+#include "uaxidma_duplex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using acq_result = uaxidma::acquisition_result;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _64KiB = 64UL << 10;
+static constexpr size_t _4KiB = 4UL << 10;
+static constexpr size_t request_size = 64;
+static constexpr size_t iterations = 100000;
+
+int main()
+{
+    // The PL loops every MM2S packet back into the S2MM stream
+    uaxidma_duplex dma { "udmabuf0", 0, "axidma", _64KiB, _4KiB, _4KiB };
+
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    double min_us = 1e9;
+    double max_us = 0.0;
+    double sum_us = 0.0;
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        const auto start = bench_clock::now();
+
+        const auto [tx_res, tx_buf] = dma.tx().get_buffer(timeout_1s);
+        if (tx_res != acq_result::success)
+        {
+            std::cout << "TX acquisition failed!" << std::endl;
+            return 1;
+        }
+        std::memset(tx_buf->data(), static_cast<int>(i), request_size);
+        tx_buf->set_payload(request_size);
+        dma.tx().submit_buffer(*tx_buf);
+
+        // Wait for the response on the shared interrupt, free TX buffers wouldn't let it sleep
+        const auto [res, ready] = dma.wait(timeout_1s, {false, true});
+        if ((res != acq_result::success) || !ready.rx)
+        {
+            std::cout << "response timed-out!" << std::endl;
+            return 1;
+        }
+
+        const auto [rx_res, rx_buf] = dma.rx().get_buffer(0);
+        if (rx_res != acq_result::success)
+        {
+            std::cout << "RX acquisition failed!" << std::endl;
+            return 1;
+        }
+        dma.rx().mark_reusable(*rx_buf);
+
+        const double us = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+        min_us = std::min(min_us, us);
+        max_us = std::max(max_us, us);
+        sum_us += us;
+    }
+
+    std::cout << "round trip: min " << min_us << " us, avg " << sum_us / iterations << " us, max " << max_us
+              << " us" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "uaxidma.h"
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+
+static constexpr size_t channel_count = 4;
+static constexpr size_t _256KiB = 256UL << 10;
+static constexpr size_t batch_size = 64;
+static constexpr int max_events = 16;
+
+/**
+ * @brief Acquires and releases every completed buffer of a channel, then re-arms it
+ * @return number of buffers processed
+ */
+static size_t service_channel(uaxidma& dma)
+{
+    std::array<uaxidma::buffer*, batch_size> bufs;
+    size_t processed = 0;
+    uaxidma::arm_result armed;
+
+    do
+    {
+        while (true)
+        {
+            const auto [res, count] = dma.get_buffers(bufs, 0);
+            if ((res != acq_result::success) || (count == 0))
+            {
+                break;
+            }
+
+            // Real processing would happen here
+            dma.mark_reusable(std::span{bufs.data(), count});
+            processed += count;
+        }
+    }
+    while ((armed = dma.arm()) == uaxidma::arm_result::ready); // a buffer completed while draining: don't go to sleep yet
+
+    if (armed == uaxidma::arm_result::error)
+    {
+        std::cout << "arm: " << strerror(errno) << std::endl;
+    }
+
+    return processed;
+}
+
+int main()
+{
+    // One cyclic S2MM channel per AXI DMA instance: udmabuf<N> + axidma_rx<N>
+    std::vector<std::unique_ptr<uaxidma>> channels;
+    for (size_t i = 0; i < channel_count; i++)
+    {
+        channels.push_back(std::make_unique<uaxidma>("udmabuf" + std::to_string(i), 0,
+                                                     "axidma_rx" + std::to_string(i), mode::cyclic,
+                                                     dir::dev_to_mem, _256KiB));
+        if (!channels.back()->initialize())
+        {
+            std::cout << "channel " << i << " initialization error!" << std::endl;
+            return 1;
+        }
+    }
+
+    int epfd = epoll_create1(0);
+    if (epfd < 0)
+    {
+        std::cout << "epoll_create1: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, channels[i]->fd(), &ev);
+        service_channel(*channels[i]);
+    }
+
+    // Report statistics once per second from the same loop
+    int tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    const itimerspec period {{1, 0}, {1, 0}};
+    timerfd_settime(tfd, 0, &period, nullptr);
+    epoll_event tev {};
+    tev.events = EPOLLIN;
+    tev.data.u64 = channels.size();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &tev);
+
+    uint64_t wakeups = 0;
+    uint64_t buffers = 0;
+
+    while (true)
+    {
+        std::array<epoll_event, max_events> events;
+        int n = epoll_wait(epfd, events.data(), max_events, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cout << "epoll_wait: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        wakeups++;
+
+        for (int i = 0; i < n; i++)
+        {
+            const size_t idx = events[i].data.u64;
+            if (idx == channels.size())
+            {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                {
+                    std::cout << wakeups << " wakeups/s, " << buffers << " buffers/s" << std::endl;
+                    wakeups = 0;
+                    buffers = 0;
+                }
+                continue;
+            }
+
+            uaxidma& dma = *channels[idx];
+            if (dma.on_readable() != acq_result::success)
+            {
+                std::cout << "channel " << idx << " internal error!" << std::endl;
+                continue;
+            }
+            buffers += service_channel(dma);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using policy = uaxidma::wait_policy;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _1MiB = 1UL << 20;
+static constexpr size_t buffer_size = 2048;
+static constexpr size_t buffers_to_move = 1UL << 14;
+static constexpr size_t error_period = 1000;
+
+/**
+ * @brief Moves buffers through a channel driven by the emulated core while slave errors are injected,
+ * and checks that the channel recovers from each of them on its own
+ * @return false on errors
+ */
+static bool run(const char *name, dir d, policy p)
+{
+    sim_udmabuf mem { "udmabuf_sim", _1MiB };
+    sim_axi_dma core { "axidma_sim", {256, 0} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", mode::normal, d, buffer_size };
+    if (!dma.initialize())
+    {
+        std::cout << name << ": initialization error!" << std::endl;
+        return false;
+    }
+    dma.set_wait_policy(p, std::chrono::microseconds(20));
+
+    uint64_t max_downtime_ns = 0;
+    uaxidma::buffer *held = nullptr;
+    bool intact = true;
+    for (size_t i = 0; i < buffers_to_move; i++)
+    {
+        const bool inject = ((i % error_period) == error_period / 2);
+        if (inject)
+        {
+            core.inject_slave_error(d == dir::dev_to_mem);
+        }
+
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << name << ": " << ((res == acq_result::timeout) ? "acquisition timed-out!" : "channel failed!")
+                      << std::endl;
+            return false;
+        }
+
+        if (d == dir::mem_to_dev)
+        {
+            buf_ptr->set_payload(256);
+            dma.submit_buffer(*buf_ptr);
+        }
+        else if (inject)
+        {
+            // Held by the application across the recovery: it shall stay untouched
+            held = buf_ptr;
+            std::memset(held->data(), 0x5a, held->length());
+        }
+        else
+        {
+            dma.mark_reusable(*buf_ptr);
+        }
+
+        if (held && (dma.get_stats().recoveries == i / error_period + 1))
+        {
+            for (size_t j = 0; j < held->length(); j++)
+            {
+                intact &= (held->data()[j] == 0x5a);
+            }
+            dma.mark_reusable(*held);
+            held = nullptr;
+        }
+
+        max_downtime_ns = std::max(max_downtime_ns, dma.get_last_error().downtime_ns);
+    }
+
+    const auto& last = dma.get_last_error();
+    std::cout << name << ": " << buffers_to_move << " buffers, " << dma.get_stats().recoveries << " recoveries, last: "
+              << axi_dma::describe_errors(last.dma_status, last.desc_errors) << " at descriptor " << last.desc_index
+              << ", " << last.rebuilt << " descriptors rebuilt, max downtime " << max_downtime_ns / 1000.0
+              << " us" << ((d == dir::dev_to_mem) ? (intact ? ", held buffers intact" : ", held buffers corrupted!") : "")
+              << std::endl;
+
+    return intact && (dma.get_stats().recoveries == buffers_to_move / error_period);
+}
+
+int main()
+{
+    const bool ok = run("rx_interrupt", dir::dev_to_mem, policy::interrupt)
+                    && run("rx_busy_poll", dir::dev_to_mem, policy::busy_poll)
+                    && run("tx_interrupt", dir::mem_to_dev, policy::interrupt)
+                    && run("tx_hybrid", dir::mem_to_dev, policy::hybrid);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include "uaxidma_forwarder.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _16MiB = 16UL << 20;
+static constexpr size_t buffer_size = 16UL << 10;
+static constexpr size_t default_forward_mib = 256;
+static constexpr int udp_receive_buffer = 32 << 20;
+
+/**
+ * @brief Forwarding method under test
+ */
+enum class method
+{
+    send,             //!< get_buffer(), send() and mark_reusable(), one buffer at a time
+    sendmmsg,         //!< uaxidma_forwarder without zero-copy
+    sendmmsg_zerocopy //!< uaxidma_forwarder with MSG_ZEROCOPY
+};
+
+/**
+ * @brief Throughput and CPU cost of a forwarding run, and what the receiver got
+ */
+struct forward_result
+{
+    bool ok;
+    double mb_per_s;
+    double cpu_s_per_gb;     //!< CPU time of the whole process, emulated core and receiver included
+    double calls_per_buffer; //!< Send system calls per buffer
+    uint64_t copied_sends;
+    uint64_t received;       //!< Buffers received, UDP may drop some
+    bool intact;             //!< Received in order, and without gaps over TCP
+};
+
+static double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+           + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Creates a connected pair of loopback sockets
+ * @return false on errors
+ */
+static bool connect_loopback(bool tcp, int& tx, int& rx)
+{
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+
+    const int type = tcp ? SOCK_STREAM : SOCK_DGRAM;
+    const int server = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    tx = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    if ((server < 0) || (tx < 0)
+        || (bind(server, reinterpret_cast<sockaddr *>(&addr), addr_len) < 0)
+        || (getsockname(server, reinterpret_cast<sockaddr *>(&addr), &addr_len) < 0)
+        || (tcp && (listen(server, 1) < 0))
+        || (connect(tx, reinterpret_cast<sockaddr *>(&addr), addr_len) < 0))
+    {
+        return false;
+    }
+
+    if (!tcp)
+    {
+        // The receiver shares the CPU with the sender: give it room to catch up. Forcing the size beyond
+        // rmem_max needs CAP_NET_ADMIN.
+        if (setsockopt(server, SOL_SOCKET, SO_RCVBUFFORCE, &udp_receive_buffer, sizeof(udp_receive_buffer)) < 0)
+        {
+            setsockopt(server, SOL_SOCKET, SO_RCVBUF, &udp_receive_buffer, sizeof(udp_receive_buffer));
+        }
+        rx = server;
+        return true;
+    }
+
+    rx = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+    close(server);
+    return rx >= 0;
+}
+
+/**
+ * @brief Receives buffers until the sender is done, checking the sequence number each of them starts with
+ */
+static void receive(bool tcp, int rx, const std::atomic<bool>& sender_done, uint64_t& received, bool& intact)
+{
+    // Wake up now and then to notice the sender is done, since UDP has no end of stream
+    const timeval timeout {0, 100000};
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<uint8_t> data(buffer_size);
+    uint64_t first = 0;
+    uint64_t last = 0;
+    received = 0;
+    intact = true;
+    while (true)
+    {
+        const ssize_t len = recv(rx, data.data(), data.size(), tcp ? MSG_WAITALL : 0);
+        if (len < 0)
+        {
+            if (((errno == EAGAIN) || (errno == EINTR)) && !sender_done.load())
+            {
+                continue;
+            }
+            break;
+        }
+        if (len == 0)
+        {
+            break;
+        }
+
+        // A TCP read timing out halfway through a buffer returns what it got: read the rest
+        size_t got = static_cast<size_t>(len);
+        while (tcp && (got < data.size()))
+        {
+            const ssize_t more = recv(rx, data.data() + got, data.size() - got, MSG_WAITALL);
+            if ((more <= 0) && ((more == 0) || ((errno != EAGAIN) && (errno != EINTR))))
+            {
+                intact = false;
+                return;
+            }
+            got += static_cast<size_t>(std::max<ssize_t>(more, 0));
+        }
+
+        uint64_t sequence = 0;
+        memcpy(&sequence, data.data(), sizeof(sequence));
+        first = (received == 0) ? sequence : first;
+        intact &= (received == 0) || (tcp ? (sequence == last + 1) : (sequence > last));
+        last = sequence;
+        received++;
+    }
+    intact &= (received != 0) && (!tcp || (last - first + 1 == received));
+}
+
+/**
+ * @brief Forwards the output of the emulated core to a loopback socket
+ */
+static forward_result forward(method m, bool tcp, size_t buffers, size_t batch)
+{
+    sim_udmabuf mem { "udmabuf_sim", _16MiB };
+    sim_axi_dma core { "axidma_sim", {0, 0} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", mode::normal, dir::dev_to_mem, buffer_size, {1u, 0u, false},
+                  uaxidma::buffer_alignment::page };
+    int tx = -1;
+    int rx = -1;
+    if (!dma.initialize() || !connect_loopback(tcp, tx, rx))
+    {
+        std::cout << "forward: initialization error: " << strerror(errno) << std::endl;
+        return {};
+    }
+
+    std::atomic<bool> sender_done { false };
+    forward_result result {};
+    std::thread receiver { receive, tcp, rx, std::cref(sender_done), std::ref(result.received),
+                           std::ref(result.intact) };
+
+    const double cpu_start = cpu_seconds();
+    const auto start = bench_clock::now();
+    uint64_t sent = 0;
+    uint64_t calls = 0;
+    bool ok = true;
+    if (m == method::send)
+    {
+        for (; (sent < buffers) && ok; sent++)
+        {
+            const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+            ok = (res == acq_result::success);
+            if (ok)
+            {
+                ok = (send(tx, buf_ptr->data(), buf_ptr->length(), MSG_NOSIGNAL)
+                      == static_cast<ssize_t>(buf_ptr->length()));
+                dma.mark_reusable(*buf_ptr);
+            }
+        }
+        calls = sent;
+    }
+    else
+    {
+        uaxidma_forwarder forwarder { dma, tx, {batch, 64, m == method::sendmmsg_zerocopy} };
+        ok = forwarder.start();
+        while (ok && (forwarder.get_stats().buffers < buffers) && (forwarder.get_last_error() == 0))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        forwarder.stop();
+
+        const auto stats = forwarder.get_stats();
+        ok = ok && (forwarder.get_last_error() == 0) && (stats.send_errors == 0);
+        sent = stats.buffers;
+        calls = stats.send_calls;
+        result.copied_sends = stats.copied_sends;
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    // Lets the receiver see the end of the TCP stream
+    shutdown(tx, SHUT_WR);
+    sender_done.store(true);
+    receiver.join();
+    const double cpu = cpu_seconds() - cpu_start;
+    close(tx);
+    close(rx);
+
+    const double gb = static_cast<double>(sent * buffer_size) / 1e9;
+    result.ok = ok && (sent != 0);
+    result.mb_per_s = gb * 1e3 / elapsed.count();
+    result.cpu_s_per_gb = cpu / gb;
+    result.calls_per_buffer = static_cast<double>(calls) / static_cast<double>(sent);
+    return result;
+}
+
+/**
+ * @brief Forwards the output of the emulated core to loopback UDP and TCP sockets, first with one send() per
+ * buffer, then with uaxidma_forwarder with and without MSG_ZEROCOPY, and prints the throughput and CPU cost of
+ * each as CSV
+ * @note Over loopback, the kernel copies zero-copy sends on delivery, as reported by the copied_sends column:
+ * the gains to expect on a NIC are the system calls saved, plus the copy on the transmit path.
+ * usage: forwarder_bench [MiB]
+ */
+int main(int argc, char *argv[])
+{
+    const size_t mib = (argc > 1) ? std::stoul(argv[1]) : default_forward_mib;
+    const size_t buffers = (mib << 20) / buffer_size;
+
+    std::cout << "protocol,method,batch_size,mb_per_s,cpu_s_per_gb,calls_per_buffer,copied_sends,received,intact"
+              << std::endl;
+
+    bool ok = true;
+    for (bool tcp : {false, true})
+    {
+        const struct
+        {
+            method m;
+            const char *name;
+            size_t batch;
+        } runs[] = {
+            {method::send, "send", 1},
+            {method::sendmmsg, "forwarder", 32},
+            {method::sendmmsg_zerocopy, "forwarder_zerocopy", 8},
+            {method::sendmmsg_zerocopy, "forwarder_zerocopy", 32},
+        };
+
+        for (const auto& run : runs)
+        {
+            const forward_result r = forward(run.m, tcp, buffers, run.batch);
+            std::cout << (tcp ? "tcp," : "udp,") << run.name << "," << run.batch << "," << r.mb_per_s << ","
+                      << r.cpu_s_per_gb << "," << r.calls_per_buffer << "," << r.copied_sends << ","
+                      << r.received << "," << r.intact << std::endl;
+            ok = ok && r.ok && r.intact;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#include "uaxidma.h"
+#include <cstdlib>
+#include <iostream>
+
+using align = uaxidma::buffer_alignment;
+
+static constexpr size_t _256MiB = 256UL << 20;
+static constexpr size_t default_buffer_size = 1500;
+
+int main(int argc, char *argv[])
+{
+    if (argc > 3)
+    {
+        std::cout << "usage: " << argv[0] << " [udmabuf size in bytes] [buffer size in bytes]" << std::endl;
+        return 1;
+    }
+
+    const size_t udmabuf_size = (argc > 1) ? strtoull(argv[1], nullptr, 0) : _256MiB;
+    const size_t buffer_size = (argc > 2) ? strtoull(argv[2], nullptr, 0) : default_buffer_size;
+
+    static constexpr struct
+    {
+        align alignment;
+        const char *name;
+    } policies[] = {
+        {align::bus, "bus"}, {align::cache_line, "cache_line"}, {align::page, "page"}, {align::huge_page, "huge_page"}
+    };
+
+    std::cout << "alignment,buffers,stride,descriptor_padding,buffer_padding,tail_waste,wasted,wasted_pct" << std::endl;
+    for (const auto& p : policies)
+    {
+        const auto layout = uaxidma::plan_layout(udmabuf_size, buffer_size, p.alignment);
+        std::cout << p.name << "," << layout.buffer_count << "," << layout.buffer_stride << ","
+                  << layout.descriptor_padding << "," << layout.buffer_padding << "," << layout.tail_waste << ","
+                  << layout.wasted() << "," << (100.0 * layout.wasted() / udmabuf_size) << std::endl;
+    }
+
+    return 0;
+}
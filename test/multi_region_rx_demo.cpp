@@ -0,0 +1,57 @@
+#include "uaxidma.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using demo_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _64KiB = 64UL << 10;
+static constexpr size_t buffers_to_capture = 1UL << 16;
+
+int main(int argc, char *argv[])
+{
+    // The descriptors go in the first udmabuf, data buffers in all of them
+    std::vector<std::string> udmabuf_names { "udmabuf0", "udmabuf2", "udmabuf3" };
+    if (argc > 1)
+    {
+        udmabuf_names.assign(argv + 1, argv + argc);
+    }
+
+    uaxidma dma { udmabuf_names, "axidma_rx", mode::normal, dir::dev_to_mem, _64KiB, {16u, 8u, false},
+                  uaxidma::buffer_alignment::page };
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    const auto& layout = dma.get_layout();
+    std::cout << "udmabufs: " << udmabuf_names.size() << ", buffers: " << layout.buffer_count
+              << ", ring bytes: " << layout.buffer_count * layout.buffer_size
+              << ", wasted bytes: " << layout.wasted() << std::endl;
+
+    size_t bytes = 0;
+    const auto start = demo_clock::now();
+    for (size_t i = 0; i < buffers_to_capture; i++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << ((res == acq_result::timeout) ? "acquisition timed-out!" : "internal error!") << std::endl;
+            return 1;
+        }
+
+        bytes += buf_ptr->length();
+        dma.mark_reusable(*buf_ptr);
+    }
+    const std::chrono::duration<double> elapsed = demo_clock::now() - start;
+
+    std::cout << "captured " << bytes << " bytes at " << (bytes / elapsed.count() / 1e6) << " MB/s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "uaxidma.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _4KiB = 4UL << 10;
+static constexpr size_t buffers = 1UL << 20;
+
+/**
+ * @brief Share of buffers sent to the slow path, and how many acquisitions they are held for
+ */
+struct hold_mix
+{
+    double slow_ratio;
+    size_t slow_hold;
+};
+
+struct held_buffer
+{
+    uaxidma::buffer *buf;
+    size_t release_at;
+};
+
+/**
+ * @brief Receives buffers, releasing fast path buffers right away and slow path ones later on, out of order
+ * @return buffers per second, 0 on errors
+ */
+static double bench_mix(uaxidma& dma, const hold_mix& mix, size_t& max_held)
+{
+    std::mt19937 rng{42};
+    std::bernoulli_distribution slow_path{mix.slow_ratio};
+    std::vector<held_buffer> held;
+    max_held = 0;
+
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < buffers; i++)
+    {
+        // Release slow path buffers whose processing is over, regardless of their acquisition order
+        for (auto it = held.begin(); it != held.end();)
+        {
+            if (it->release_at <= i)
+            {
+                dma.mark_reusable(*it->buf);
+                it = held.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << "acquisition failed after " << i << " buffers: " << strerror(errno) << std::endl;
+            return 0.0;
+        }
+
+        if (slow_path(rng))
+        {
+            held.push_back({buf_ptr, i + mix.slow_hold});
+            max_held = std::max(max_held, held.size());
+        }
+        else
+        {
+            dma.mark_reusable(*buf_ptr);
+        }
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    for (auto& h : held)
+    {
+        dma.mark_reusable(*h.buf);
+    }
+
+    return buffers / elapsed.count();
+}
+
+int main()
+{
+    uaxidma dma { "udmabuf0", 0, "axidma_rx", mode::normal, dir::dev_to_mem, _4KiB };
+
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    static constexpr hold_mix mixes[] = {
+        {0.0, 0}, {0.001, 16}, {0.01, 16}, {0.01, 64}, {0.1, 8}, {0.1, 32}
+    };
+
+    std::cout << "slow_ratio,slow_hold,max_held,buffers_per_s" << std::endl;
+    for (const auto& mix : mixes)
+    {
+        size_t max_held;
+        const double bps = bench_mix(dma, mix, max_held);
+        std::cout << mix.slow_ratio << "," << mix.slow_hold << "," << max_held << "," << bps << std::endl;
+        if (bps == 0.0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
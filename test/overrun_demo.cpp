@@ -0,0 +1,104 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _256KiB = 1UL << 18;
+static constexpr size_t buffer_size = 2048;
+static constexpr uint64_t packets_per_second = 200000;
+static constexpr size_t buffers_to_read = 1UL << 15;
+static constexpr size_t stall_period = 4000;
+
+/**
+ * @brief Returns the sequence number the emulated core writes at the beginning of each received packet
+ */
+static uint64_t sim_sequence(const uint8_t *data, size_t length)
+{
+    uint64_t sequence = 0;
+    memcpy(&sequence, data, std::min(sizeof(sequence), length));
+    return sequence;
+}
+
+/**
+ * @brief Reads a cyclic channel driven by the emulated core with a consumer that stalls now and then for
+ * longer than the ring lasts, and checks that buffers are still handed over in stream order and that every
+ * lost buffer is accounted for, and that the ring occupancy reported reflects the backlog left by the stalls
+ * @param exact whether the channel is given the sequence numbers of the emulated core
+ * @return false on errors
+ */
+static bool run(const char *name, bool exact, bool skip_to_newest)
+{
+    sim_udmabuf mem { "udmabuf_sim", _256KiB };
+    sim_axi_dma core { "axidma_sim", {256, packets_per_second} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", mode::cyclic, dir::dev_to_mem, buffer_size };
+    if (!dma.initialize())
+    {
+        std::cout << name << ": initialization error!" << std::endl;
+        return false;
+    }
+    dma.set_overrun_policy(skip_to_newest, exact ? uaxidma::sequence_reader{sim_sequence} : uaxidma::sequence_reader{});
+
+    // Stalls from a third of a lap up to a few laps
+    const auto lap = std::chrono::microseconds(dma.buffer_count() * 1000000 / packets_per_second);
+    const std::chrono::microseconds stalls[] = {lap / 3, lap + lap / 2, lap * 4};
+
+    uint64_t first = 0;
+    uint64_t last = 0;
+    bool ordered = true;
+    for (size_t i = 0; i < buffers_to_read; i++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << name << ": " << ((res == acq_result::timeout) ? "acquisition timed-out!" : "channel failed!")
+                      << std::endl;
+            return false;
+        }
+
+        const uint64_t sequence = sim_sequence(buf_ptr->data(), buf_ptr->length());
+        ordered &= (i == 0) || (sequence > last);
+        ordered &= !exact || (buf_ptr->sequence() == sequence);
+        first = (i == 0) ? sequence : first;
+        last = sequence;
+        dma.mark_reusable(*buf_ptr);
+
+        if ((i % stall_period) == stall_period - 1)
+        {
+            std::this_thread::sleep_for(stalls[(i / stall_period) % std::size(stalls)]);
+        }
+    }
+
+    // Every buffer from the first one acquired up to the last one was either acquired, lost or skipped
+    const auto stats = dma.get_stats();
+    const uint64_t missing = (last - first + 1) - buffers_to_read;
+    const uint64_t accounted = stats.lost_buffers + stats.skipped_buffers;
+
+    std::cout << name << ": " << buffers_to_read << " buffers out of " << (last - first + 1) << ", "
+              << stats.overruns << " overruns, " << stats.lost_buffers << " lost, " << stats.skipped_buffers
+              << " skipped, " << missing << " actually missing, ring high-water " << stats.ring_high_water << "/"
+              << dma.buffer_count() << (ordered ? "" : ", out of order!") << std::endl;
+
+    // The shortest stall alone leaves a third of the ring received and not acquired
+    const bool occupancy_ok = (stats.ring_high_water >= dma.buffer_count() / 4)
+                              && (stats.ring_high_water <= dma.buffer_count());
+
+    return ordered && occupancy_ok && (stats.overruns != 0)
+           && (exact ? (accounted == missing) : (accounted <= missing));
+}
+
+int main()
+{
+    const bool ok = run("rx_exact", true, false)
+                    && run("rx_exact_newest", true, true)
+                    && run("rx_estimated", false, false)
+                    && run("rx_estimated_newest", false, true);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include "uaxidma_recorder.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _16MiB = 16UL << 20;
+static constexpr size_t buffer_size = 64UL << 10;
+static constexpr size_t default_record_mib = 256;
+
+/**
+ * @brief Throughput and CPU cost of a recording
+ */
+struct record_result
+{
+    double mb_per_s;
+    double cpu_s_per_gb; //!< CPU time of the whole process, emulated core included
+    bool intact;
+};
+
+static double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+           + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Checks that the file holds consecutive buffers of the emulated core, each starting with its sequence number
+ */
+static bool check_file(const std::string& path, size_t buffers)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool intact = true;
+    uint64_t first = 0;
+    for (size_t i = 0; (i < buffers) && intact; i++)
+    {
+        uint64_t sequence = 0;
+        intact = (pread(fd, &sequence, sizeof(sequence), static_cast<off_t>(i * buffer_size)) == sizeof(sequence));
+        first = (i == 0) ? sequence : first;
+        intact = intact && (sequence == first + i);
+    }
+    close(fd);
+    return intact;
+}
+
+/**
+ * @brief Records through get_buffer(), write() and mark_reusable(), i.e. copying every buffer to the page cache
+ */
+static record_result record_with_write(const std::string& path, size_t buffers)
+{
+    sim_udmabuf mem { "udmabuf_sim", _16MiB };
+    sim_axi_dma core { "axidma_sim", {0, 0} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", mode::normal, dir::dev_to_mem, buffer_size, {1u, 0u, false},
+                  uaxidma::buffer_alignment::page };
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (!dma.initialize() || (fd < 0))
+    {
+        std::cout << "write: initialization error!" << std::endl;
+        return {0, 0, false};
+    }
+
+    const double cpu_start = cpu_seconds();
+    const auto start = bench_clock::now();
+    bool ok = true;
+    for (size_t i = 0; (i < buffers) && ok; i++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        ok = (res == acq_result::success);
+        if (ok)
+        {
+            ok = (write(fd, buf_ptr->data(), buf_ptr->length()) == static_cast<ssize_t>(buf_ptr->length()));
+            dma.mark_reusable(*buf_ptr);
+        }
+    }
+    ok = ok && (fdatasync(fd) == 0);
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    const double cpu = cpu_seconds() - cpu_start;
+    close(fd);
+
+    const double gb = static_cast<double>(buffers * buffer_size) / 1e9;
+    return {gb * 1e3 / elapsed.count(), cpu / gb, ok && check_file(path, buffers)};
+}
+
+/**
+ * @brief Records through uaxidma_recorder, writing from the DMA buffers with io_uring
+ */
+static record_result record_with_recorder(const std::string& path, size_t buffers, bool direct, size_t depth,
+                                          uaxidma_recorder::stats& stats)
+{
+    sim_udmabuf mem { "udmabuf_sim", _16MiB };
+    sim_axi_dma core { "axidma_sim", {0, 0} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", mode::normal, dir::dev_to_mem, buffer_size, {1u, 0u, false},
+                  uaxidma::buffer_alignment::page };
+    if (!dma.initialize())
+    {
+        std::cout << "recorder: initialization error!" << std::endl;
+        return {0, 0, false};
+    }
+
+    uaxidma_recorder recorder { dma, path, {depth, direct, 4096} };
+
+    const double cpu_start = cpu_seconds();
+    const auto start = bench_clock::now();
+    if (!recorder.start())
+    {
+        std::cout << "recorder: can't start: " << strerror(errno) << std::endl;
+        return {0, 0, false};
+    }
+    while ((recorder.get_stats().buffers < buffers) && (recorder.get_last_error() == 0))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    recorder.stop();
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    const double cpu = cpu_seconds() - cpu_start;
+
+    stats = recorder.get_stats();
+    const double gb = static_cast<double>(stats.bytes) / 1e9;
+    return {gb * 1e3 / elapsed.count(), cpu / gb,
+            (recorder.get_last_error() == 0) && (stats.write_errors == 0) && check_file(path, stats.buffers)};
+}
+
+/**
+ * @brief Records the output of the emulated core to a file, first copying each buffer with write(), then with
+ * uaxidma_recorder, and prints the throughput and CPU cost of each as CSV
+ * usage: recorder_bench [file] [MiB]
+ */
+int main(int argc, char *argv[])
+{
+    const std::string path = (argc > 1) ? argv[1] : "recorder_bench.dat";
+    const size_t mib = (argc > 2) ? std::stoul(argv[2]) : default_record_mib;
+    const size_t buffers = (mib << 20) / buffer_size;
+
+    std::cout << "method,queue_depth,mb_per_s,cpu_s_per_gb,buffered_writes,queue_full,intact" << std::endl;
+
+    const record_result copy = record_with_write(path, buffers);
+    std::cout << "write,1," << copy.mb_per_s << "," << copy.cpu_s_per_gb << "," << buffers << ",0,"
+              << copy.intact << std::endl;
+    bool ok = copy.intact;
+
+    for (bool direct : {false, true})
+    {
+        for (size_t depth : {8, 32})
+        {
+            uaxidma_recorder::stats stats {};
+            const record_result rec = record_with_recorder(path, buffers, direct, depth, stats);
+            std::cout << (direct ? "io_uring_direct," : "io_uring_buffered,") << depth << "," << rec.mb_per_s << ","
+                      << rec.cpu_s_per_gb << "," << stats.buffered_writes << "," << stats.queue_full << ","
+                      << rec.intact << std::endl;
+            ok = ok && rec.intact;
+        }
+    }
+
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#include "axi_dma_sim.h"
+#include "uaxidma.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using policy = uaxidma::wait_policy;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _4MiB = 4UL << 20;
+static constexpr size_t buffer_size = 2048;
+static constexpr size_t packet_size = 64;
+static constexpr size_t packets = 1UL << 16;
+
+/**
+ * @brief Moves packets through a channel driven by the emulated core
+ * @return false on errors
+ */
+static bool bench(const char *name, mode m, dir d, policy p)
+{
+    sim_udmabuf mem { "udmabuf_sim", _4MiB };
+    sim_axi_dma core { "axidma_sim", {packet_size, 0} };
+
+    uaxidma dma { "udmabuf_sim", 0, "axidma_sim", m, d, buffer_size };
+    if (!dma.initialize())
+    {
+        std::cout << name << ": initialization error!" << std::endl;
+        return false;
+    }
+    dma.set_wait_policy(p);
+
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < packets; i++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << name << ": " << ((res == acq_result::timeout) ? "acquisition timed-out!" : "internal error!")
+                      << std::endl;
+            return false;
+        }
+
+        if (d == dir::mem_to_dev)
+        {
+            std::memset(buf_ptr->data(), static_cast<int>(i), packet_size);
+            buf_ptr->set_payload(packet_size);
+            dma.submit_buffer(*buf_ptr);
+        }
+        else
+        {
+            dma.mark_reusable(*buf_ptr);
+        }
+    }
+    const std::chrono::duration<double, std::nano> elapsed = bench_clock::now() - start;
+
+    std::cout << name << "," << packets << "," << (elapsed.count() / packets) << ","
+              << (packets * 1e9 / elapsed.count()) << "," << core.get_stats().interrupts << std::endl;
+    return true;
+}
+
+int main()
+{
+    std::cout << "scenario,packets,ns_per_buffer,packets_per_s,interrupts" << std::endl;
+
+    const bool ok = bench("tx_interrupt", mode::normal, dir::mem_to_dev, policy::interrupt)
+                    && bench("tx_busy_poll", mode::normal, dir::mem_to_dev, policy::busy_poll)
+                    && bench("rx_interrupt", mode::normal, dir::dev_to_mem, policy::interrupt)
+                    && bench("rx_busy_poll", mode::normal, dir::dev_to_mem, policy::busy_poll)
+                    && bench("rx_cyclic", mode::cyclic, dir::dev_to_mem, policy::interrupt);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include "uaxidma_sized.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using acq_result = uaxidma::acquisition_result;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _16MiB = 16UL << 20;
+static constexpr size_t _1MiB = 1UL << 20;
+static constexpr size_t control_size = 64;
+static constexpr size_t control_buffers = 8192;
+static constexpr size_t bulk_buffers = 14;
+static constexpr double bulk_ratio = 0.01;
+static constexpr size_t messages = 1UL << 18;
+
+int main(int argc, char *argv[])
+{
+    const bool plan_only = (argc > 1) && (strcmp(argv[1], "--plan-only") == 0);
+
+    // A single size class has to fit the largest message
+    const auto single = uaxidma::plan_layout(_16MiB, _1MiB, uaxidma::buffer_alignment::cache_line);
+    std::cout << "single class: " << single.buffer_count << " buffers in flight at most" << std::endl;
+    std::cout << "size classes: " << (control_buffers + bulk_buffers) << " buffers in flight at most ("
+              << control_buffers << " x " << control_size << " B, " << bulk_buffers << " x 1 MiB)" << std::endl;
+
+    if (plan_only)
+    {
+        return 0;
+    }
+
+    uaxidma_sized_tx dma { "udmabuf1", _16MiB, "axidma_tx", {{control_size, control_buffers}, {_1MiB, bulk_buffers}} };
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng{42};
+    std::bernoulli_distribution bulk{bulk_ratio};
+    size_t bytes = 0;
+
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < messages; i++)
+    {
+        const size_t len = bulk(rng) ? _1MiB : control_size;
+        const auto [res, buf_ptr] = dma.get_buffer(len, timeout_1s);
+        if (res != acq_result::success)
+        {
+            std::cout << "acquisition failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        std::memset(buf_ptr->data(), static_cast<int>(i), len);
+        buf_ptr->set_payload(len);
+        dma.submit_buffer(*buf_ptr);
+        bytes += len;
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    std::cout << (messages / elapsed.count()) << " messages/s, " << (bytes / elapsed.count() / 1e6) << " MB/s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "uaxidma_stats.h"
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+/**
+ * @brief Prints the counters exported by another process as CSV, once per update period
+ */
+int main(int argc, char *argv[])
+{
+    const std::string shm_name = (argc > 1) ? argv[1] : "/uaxidma_stats";
+
+    const int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        std::cerr << "can't open " << shm_name << std::endl;
+        return 1;
+    }
+
+    void *addr = mmap(nullptr, sizeof(uaxidma_stats_page), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "can't map " << shm_name << std::endl;
+        return 1;
+    }
+
+    const auto *page = static_cast<const uaxidma_stats_page*>(addr);
+    if ((page->magic != uaxidma_stats_page::magic_value) || (page->version != uaxidma_stats_page::current_version))
+    {
+        std::cerr << shm_name << " isn't a uaxidma stats page" << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::cout << "time_ns,channel,packets,bytes,interrupts,poll_timeouts,poll_retries,blocked_ns,ring_high_water,"
+                 "desc_errors,recoveries,overruns,lost_buffers,skipped_buffers,sync_errors,desc_error_bits" << std::endl;
+
+    uint64_t last_sequence = 0;
+    uaxidma_stats_page::snapshot snap;
+    while (!stop_requested)
+    {
+        // The page is read without any system call, retrying while the exporter is updating it
+        while (!page->read(snap))
+        {
+            std::this_thread::yield();
+        }
+
+        if (snap.sequence != last_sequence)
+        {
+            last_sequence = snap.sequence;
+            for (uint32_t i = 0; i < snap.channel_count; i++)
+            {
+                const auto& s = snap.channels[i].stats;
+                std::cout << snap.updated_ns << "," << snap.channels[i].name << "," << s.packets << "," << s.bytes
+                          << "," << s.interrupts << "," << s.poll_timeouts << "," << s.poll_retries << ","
+                          << s.blocked_ns << "," << s.ring_high_water << "," << s.desc_errors << ","
+                          << s.recoveries << "," << s.overruns << "," << s.lost_buffers << ","
+                          << s.skipped_buffers << "," << s.sync_errors << ",0x" << std::hex << s.desc_error_bits << std::dec << std::endl;
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(page->period_ms ? page->period_ms : 100));
+    }
+
+    munmap(addr, sizeof(uaxidma_stats_page));
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "uaxidma.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _256KiB = 256UL << 10;
+static constexpr size_t packet_size = 64;
+static constexpr size_t packets = 1UL << 20;
+static constexpr size_t batch_size = 32;
+
+/**
+ * @brief Sends packets one at a time with get_buffer()/submit_buffer()
+ * @return packets per second, 0 on errors
+ */
+static double bench_single(uaxidma& dma)
+{
+    const auto start = bench_clock::now();
+    for (size_t sent = 0; sent < packets; sent++)
+    {
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            return 0.0;
+        }
+
+        std::memset(buf_ptr->data(), static_cast<int>(sent), packet_size);
+        buf_ptr->set_payload(packet_size);
+        dma.submit_buffer(*buf_ptr);
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    return packets / elapsed.count();
+}
+
+/**
+ * @brief Sends packets in bursts with get_buffers()/submit_buffers()
+ * @return packets per second, 0 on errors
+ */
+static double bench_batch(uaxidma& dma)
+{
+    std::array<uaxidma::buffer*, batch_size> bufs;
+
+    const auto start = bench_clock::now();
+    for (size_t sent = 0; sent < packets;)
+    {
+        const auto [res, count] = dma.get_buffers(bufs, timeout_1s);
+        if (res != acq_result::success)
+        {
+            return 0.0;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            std::memset(bufs[i]->data(), static_cast<int>(sent + i), packet_size);
+            bufs[i]->set_payload(packet_size);
+        }
+        dma.submit_buffers(std::span{bufs.data(), count});
+        sent += count;
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    return packets / elapsed.count();
+}
+
+int main()
+{
+    uaxidma dma { "udmabuf1", 0, "axidma_tx", mode::normal, dir::mem_to_dev, _256KiB };
+
+    if (!dma.initialize())
+    {
+        std::cout << "initialization error!" << std::endl;
+        return 1;
+    }
+
+    const double single_pps = bench_single(dma);
+    const double batch_pps = bench_batch(dma);
+
+    std::cout << "per-buffer submission: " << single_pps << " packets/s" << std::endl;
+    std::cout << "batched submission (up to " << batch_size << "): " << batch_pps << " packets/s" << std::endl;
+
+    return 0;
+}
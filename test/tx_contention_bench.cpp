@@ -0,0 +1,121 @@
+#include "uaxidma_tx.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using acq_result = uaxidma::acquisition_result;
+using mode = uaxidma::dma_mode;
+using dir = uaxidma::transfer_direction;
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr int timeout_1s = 1000;
+static constexpr size_t _256KiB = 256UL << 10;
+static constexpr size_t packet_size = 64;
+static constexpr size_t packets_per_producer = 1UL << 18;
+static constexpr size_t max_producers = 8;
+
+/**
+ * @brief Runs the given send function on several producer threads
+ * @return packets per second, 0 on errors
+ */
+template <typename F>
+static double run_producers(size_t producers, F send)
+{
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> threads;
+
+    const auto start = bench_clock::now();
+    for (size_t p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&, p]() {
+            for (size_t i = 0; (i < packets_per_producer) && !failed.load(std::memory_order_relaxed); i++)
+            {
+                if (!send(static_cast<int>(p)))
+                {
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    return failed ? 0.0 : (producers * packets_per_producer) / elapsed.count();
+}
+
+/**
+ * @brief Producers share the channel behind a mutex
+ */
+static double bench_mutex(size_t producers)
+{
+    uaxidma dma { "udmabuf1", 0, "axidma_tx", mode::normal, dir::mem_to_dev, _256KiB };
+    if (!dma.initialize())
+    {
+        return 0.0;
+    }
+
+    std::mutex lock;
+    return run_producers(producers, [&](int fill) {
+        std::lock_guard<std::mutex> guard(lock);
+        const auto [res, buf_ptr] = dma.get_buffer(timeout_1s);
+        if (res != acq_result::success)
+        {
+            return false;
+        }
+        std::memset(buf_ptr->data(), fill, packet_size);
+        buf_ptr->set_payload(packet_size);
+        dma.submit_buffer(*buf_ptr);
+        return true;
+    });
+}
+
+/**
+ * @brief Producers go through the lock-free front end, filling buffers concurrently
+ */
+static double bench_lockfree(size_t producers)
+{
+    uaxidma dma { "udmabuf1", 0, "axidma_tx", mode::normal, dir::mem_to_dev, _256KiB };
+    if (!dma.initialize())
+    {
+        return 0.0;
+    }
+
+    uaxidma_tx_queue txq { dma };
+    return run_producers(producers, [&](int fill) {
+        const auto [res, buf_ptr] = txq.claim(timeout_1s);
+        if (res != acq_result::success)
+        {
+            return false;
+        }
+        std::memset(buf_ptr->data(), fill, packet_size);
+        buf_ptr->set_payload(packet_size);
+        txq.commit(*buf_ptr);
+        return true;
+    });
+}
+
+int main()
+{
+    std::cout << "producers,mutex_pps,lockfree_pps" << std::endl;
+    for (size_t n = 1; n <= max_producers; n++)
+    {
+        const double mutex_pps = bench_mutex(n);
+        const double lockfree_pps = bench_lockfree(n);
+        std::cout << n << "," << mutex_pps << "," << lockfree_pps << std::endl;
+
+        if ((mutex_pps == 0.0) || (lockfree_pps == 0.0))
+        {
+            std::cout << "transmission error!" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}